@@ -5,6 +5,9 @@
 //***********************************************************************************
 // Include files
 //***********************************************************************************
+#include "em_i2c.h"
+#include "i2c.h"
+#include "i2c_device.h"
 
 
 //***********************************************************************************
@@ -13,6 +16,7 @@
 #define 	SI7021_DEV_ADDR			0x40
 #define		SI7021_I2C_FREQ			I2C_FREQ_FAST_MAX // 400kHz max.
 #define		SI7021_I2C_CLK_RATIO	i2cClockHLRAsymetric // 6:3 for fast max. try standard if having issues.
+#define		SI7021_SPEED_BENCH_CASES	2 // standard and fast mode
 // for the Si7021 ROUTELOC value is #15 for both SDA and SCL (i2c0 on pc10 and 11)
 #define		SI7021_SCL_LOC			SI7021_SCL_LOC_i2c1
 #define		SI7021_SCL_LOC_i2c0			_I2C_ROUTELOC0_SCLLOC_LOC15
@@ -27,6 +31,35 @@
 #define		SI7021_SDA_EN			true
 #define 	SI7021_I2C				I2C1 // default i2c for app use
 #define 	SI7021_REF_FREQ			0 // HF peripheral clock
+#define		SI7021_I2C_LDMA			true // LDMA for the write and read phases
+#define		SI7021_RETRY_POLICY		I2C_RETRY_CONVERSION // how to poll a no hold measurement
+#define		SI7021_RETRY_DELAY_MS	4	// fixed and first exponential wait
+#define		SI7021_RETRY_MAX_MS		16	// longest exponential wait
+#define		SI7021_RH_CONV_MS		23	// 12 bit RH plus 14 bit temperature, worst case
+#define		SI7021_TEMP_CONV_MS		11	// 14 bit temperature, worst case
+#define		SI7021_RH8_CONV_MS		7	// 8 bit RH plus 12 bit temperature
+#define		SI7021_TEMP12_CONV_MS	4	// 12 bit temperature
+#define		SI7021_RH10_CONV_MS		11	// 10 bit RH plus 13 bit temperature
+#define		SI7021_TEMP13_CONV_MS	7	// 13 bit temperature
+#define		SI7021_RH11_CONV_MS		10	// 11 bit RH plus 11 bit temperature
+#define		SI7021_TEMP11_CONV_MS	3	// 11 bit temperature
+#define		SI7021_UR1_DEFAULT		0x3A	// reset value, 12 bit RH, 14 bit temperature, heater off
+#define		SI7021_UR1_RES_MASK		0x81	// RES1 is bit 7, RES0 is bit 0
+#define		SI7021_ADAPTIVE_RESOLUTION	true	// lower the resolution while readings are stable
+#define		SI7021_RES_STABLE_SAMPLES	5	// stable samples before the resolution is lowered
+#define		SI7021_RES_FAST_RH		150	// RH change between samples that raises the resolution, hundredths of a percent
+#define		SI7021_RES_FAST_TEMP	90	// temperature change that raises the resolution, hundredths of a degree F
+#define		SI7021_CHECKSUM			true	// sample with the checksum byte and check its CRC
+#define		SI7021_CRC_RETRIES		1	// reruns of a sample that fails its CRC
+#define		SI7021_CRC_POLY			0x31	// x^8 + x^5 + x^4 + 1, initial value 0
+#define		SI7021_CRC_BENCH_WORDS	64	// 2 byte measurements checked by si7021_crc_bench()
+#define		SI7021_CRC_BUDGET_CYCLES	300	// most cycles a sample may spend on its CRC
+
+// fixed point conversions, see si7021_temp_centi_f() and si7021_rh_centi()
+#define		SI7021_TEMP_CF_MUL		31630u	// 175.72 * 1.8 * 100, rounded
+#define		SI7021_TEMP_CF_OFFSET	5233	// (46.85 * 1.8 - 32) * 100
+#define		SI7021_RH_CENTI_MUL		12500u	// 125 * 100
+#define		SI7021_RH_CENTI_OFFSET	600		// 6 * 100
 
 // Command Codes
 
@@ -52,30 +85,97 @@
 #define		SI7021_NUM_BYTES_SNB				6
 
 #define		SI7021_MAX_READ_BYTES				8
-#define		SI7021_MAX_WRITE_BYTES				8
 
-#define 	SI7021_MAX_CC_LENGTH				2
+// measurement resolution, in the order of the RES1 and RES0 bits of UR1
+typedef enum {
+	SI7021_RES_RH12_T14,		// reset default, slowest
+	SI7021_RES_RH8_T12,			// fastest
+	SI7021_RES_RH10_T13,
+	SI7021_RES_RH11_T11,
+	SI7021_RESOLUTIONS
+} SI7021_RESOLUTION;
+
+// index of each command in the SI7021 command table
+typedef enum {
+	SI7021_CMD_RH,				// no hold RH measurement
+	SI7021_CMD_TEMP,			// no hold temperature measurement
+	SI7021_CMD_RH_CRC,			// no hold RH measurement with checksum
+	SI7021_CMD_TEMP_CRC,		// no hold temperature measurement with checksum
+	SI7021_CMD_TEMP_FROM_RH,	// temperature of the last RH measurement
+	SI7021_CMD_READ_UR1,
+	SI7021_CMD_WRITE_UR1,
+	SI7021_CMD_SNB,				// serial number part B
+	SI7021_COMMANDS
+} SI7021_COMMAND;
+
+#define		SI7021_BENCH_CASES					2 // 6 byte SNB and 2 byte RH reads
+
+typedef struct {
+	uint32_t		read_length;		// bytes read
+	uint32_t		irq_irqs;			// interrupts with one interrupt per byte, less busy NACKs
+	uint32_t		irq_cycles;			// I2C handler cycles with one interrupt per byte
+	uint32_t		ldma_irqs;			// interrupts with the LDMA
+	uint32_t		ldma_cycles;		// I2C handler cycles with the LDMA
+	uint32_t		nack_polls;			// busy NACKs left out of the LDMA interrupts
+} SI7021_BENCH_STRUCT;
+
+typedef struct {
+	uint32_t		polls;				// read address attempts of an RH measurement
+	uint32_t		irqs;				// I2C interrupts of the measurement
+} SI7021_RETRY_BENCH_STRUCT;
+
+typedef struct {
+	uint32_t		errors;				// reads that failed their CRC
+	uint32_t		reruns;				// samples run again after a CRC error
+	uint32_t		flagged;			// samples reported as failed after the reruns
+} SI7021_CRC_STATS_STRUCT;
+
+typedef struct {
+	uint32_t		table_cycles;		// per sample, nibble table CRC
+	uint32_t		bitwise_cycles;		// per sample, bit by bit CRC
+} SI7021_CRC_BENCH_STRUCT;
+
+typedef struct {
+	uint32_t		freq;				// SCL frequency
+	uint32_t		bus_cycles;			// core cycles the SNB read held the bus
+} SI7021_SPEED_BENCH_STRUCT;
 //***********************************************************************************
 // global variables
 //***********************************************************************************
 
 void si7021_i2c_open(void);
-void si7021_read(uint8_t command_code_length, uint8_t read_length, uint32_t event);
-void si7021_write(uint8_t command_code_length, uint8_t write_length, uint32_t event);
+I2C_DEVICE_STRUCT *si7021_device(void);
+void si7021_retry_policy_set(I2C_RETRY_POLICY policy);
 
 // r/w presets
+void si7021_sample(uint32_t event);
 void si7021_read_rh(uint32_t event);
 void si7021_read_temp(uint32_t event);
 void si7021_read_rh_temp(uint32_t event);
 void si7021_write_ur1(uint8_t byte, uint32_t event);
+void si7021_resolution_set(SI7021_RESOLUTION resolution, uint32_t event);
+SI7021_RESOLUTION si7021_resolution(void);
+void si7021_resolution_adapt(int32_t rh, int32_t temp);
 void si7021_read_ur1(uint32_t event);
 void si7021_read_SNB(uint32_t event);
 
 // get last data
-float si7021_convert_temp_f(void);
-float si7021_convert_rh(void);
+int32_t si7021_convert_temp_f(void);
+int32_t si7021_convert_rh(void);
+int32_t si7021_temp_centi_f(uint16_t temp_code);
+int32_t si7021_rh_centi(uint16_t rh_code);
+bool si7021_read_ok(void);
+bool si7021_sample_ok(void);
+I2C_STATUS si7021_sample_status(void);
+void si7021_checksum_enable(bool enable);
+uint8_t si7021_crc8(const uint8_t *data, uint32_t length);
+void si7021_crc_stats(SI7021_CRC_STATS_STRUCT *stats);
+uint8_t si7021_ur1(void);
+const uint8_t *si7021_snb(void);
 
 // TDD test
 void si7021_test(void);
+void si7021_bench(void);
+void si7021_crc_bench(void);
 
 #endif /* SRC_HEADER_FILES_SI7021_H_ */
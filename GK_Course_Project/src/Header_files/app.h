@@ -7,6 +7,8 @@
 #include "em_prs.h"
 #include "cmu.h"
 #include "gpio.h"
+#include "sleep_routines.h"
+#include "scheduler.h"
 
 //***********************************************************************************
 // defined files
@@ -24,15 +26,54 @@
 #define		BOOT_UP_EVT							0x00000008
 #define		BLE_TX_DONE_EVT						0x00000010
 #define		BLE_RX_DONE_EVT						0x00000020
-#define		SI7021_READ_RH_DONE_EVT				0x00000040
-#define 	SI7021_READ_RH_TEMP_DONE_EVT		0x00000080
+#define		SI7021_SAMPLE_DONE_EVT				0x00000040
 #define		SI7021_READ_TEMP_DONE_EVT			0x00000100
 
+#define		SLEEP_REPORT_PERIODS	20		// LETIMER periods between sleep residency reports
+#define		HISTORY_REPORT_PERIOD	(SLEEP_REPORT_PERIODS / 2)	// history report, between sleep reports
+#define		CHANNEL_REPORT_PERIOD	(SLEEP_REPORT_PERIODS / 4)	// sent and suppressed readings report
+#define		SLEEP_I2C_BOUND_MS		500		// longest expected I2C EM2 block
+#define		SLEEP_LEUART_BOUND_MS	2000	// longest expected LEUART EM3 block
+#define		FORMAT_BENCH_SAMPLES	64		// readings converted and formatted by app_format_bench()
+
+#define		APP_RH_DEADBAND_CENTI		100		// RH sent on a 1.0 % change
+#define		APP_TEMP_DEADBAND_CENTI_F	50		// temperature sent on a 0.5 F change
+#define		APP_MAX_SILENCE_MS			60000	// a reading is sent at least this often
+
+typedef enum {
+	APP_CHANNEL_RH,
+	APP_CHANNEL_TEMP,
+	APP_CHANNELS
+} APP_CHANNEL;
+
+typedef struct {
+	int32_t			deadband;			// smallest change from the last sent value that is sent
+	uint32_t		max_silence_ms;		// longest time between sent values
+	bool			sent_once;
+	int32_t			last_value;			// last value sent
+	uint32_t		last_ms;			// letimer_timer_now() when it was sent
+	uint32_t		sent;
+	uint32_t		suppressed;
+} APP_CHANNEL_STRUCT;
+
+typedef struct {
+	uint32_t		float_cycles;		// per sample, float conversions and sprintf()
+	uint32_t		fixed_cycles;		// per sample, fixed point conversions and format.c
+} FORMAT_BENCH_STRUCT;
+
 // TDD Test Enables
 // #define BLE_TEST_ENABLED
 // #define CIRC_BUFF_TEST_ENABLED
 //#define SI7021_TEST_ENABLED
 
+// Benchmark Enables
+//#define SCHEDULER_BENCH_ENABLED
+//#define LETIMER_TIMER_BENCH_ENABLED
+//#define SLEEP_BENCH_ENABLED
+//#define SI7021_BENCH_ENABLED
+//#define FORMAT_BENCH_ENABLED
+//#define SI7021_CRC_BENCH_ENABLED
+
 //***********************************************************************************
 // global variables
 //***********************************************************************************
@@ -43,14 +84,19 @@
 //***********************************************************************************
 void app_peripheral_setup(void);
 void app_letimer_pwm_open(float period, float act_period);
-void scheduled_letimer0_uf_evt(void);
+void scheduled_letimer0_uf_evt(SCHEDULER_MSG_STRUCT *msg);
 void scheduled_letimer0_comp0_evt(void);
 void scheduled_letimer0_comp1_evt(void);
 void scheduled_boot_up_evt(void);
 void scheduled_tx_done_evt(void);
 void scheduled_rx_done_evt(void);
-void scheduled_si7021_read_temp_done_evt(void);
-void scheduled_si7021_read_rh_done_evt(void);
-void scheduled_si7021_read_rh_temp_done_evt(void);
+void scheduled_si7021_read_temp_done_evt(SCHEDULER_MSG_STRUCT *msg);
+void scheduled_si7021_sample_done_evt(SCHEDULER_MSG_STRUCT *msg);
+void app_sleep_leak(SLEEP_OWNER owner, uint32_t EM, uint32_t held_ms);
+void app_i2c_trace_dump(void);
+void app_i2c_trace_next(void);
+void app_format_bench(void);
+void app_channel_policy(APP_CHANNEL channel, int32_t deadband, uint32_t max_silence_ms);
+const APP_CHANNEL_STRUCT *app_channel(APP_CHANNEL channel);
 
 #endif
@@ -0,0 +1,25 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef CYCLE_COUNT_H
+#define	CYCLE_COUNT_H
+
+#include <stdint.h>
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define		CYCLE_COUNT_GET()		(DWT->CYCCNT)	// core clock cycles, EM0/EM1 only
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void cycle_count_open(void);
+
+#endif
@@ -0,0 +1,28 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef FORMAT_H
+#define	FORMAT_H
+
+#include <stdint.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define		FORMAT_UINT_DIGITS		10	// digits of the largest uint32_t
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+char *format_str(char *dst, const char *end, const char *src);
+char *format_uint(char *dst, const char *end, uint32_t value);
+char *format_int(char *dst, const char *end, int32_t value);
+char *format_hex(char *dst, const char *end, uint32_t value, uint8_t digits);
+char *format_centi(char *dst, const char *end, int32_t centi);
+
+#endif
@@ -0,0 +1,57 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef HISTORY_H
+#define	HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define		HISTORY_BYTES			8192	// RAM for the encoded samples
+#define		HISTORY_BLOCK_BYTES		256		// the oldest block is dropped when the history is full
+#define		HISTORY_BLOCKS			(HISTORY_BYTES / HISTORY_BLOCK_BYTES)
+#define		HISTORY_TICK_MS			100		// resolution of the stored time stamps
+#define		HISTORY_RECORD_MAX		15		// three 5 byte varints
+
+typedef struct {
+	uint32_t		time_ms;		// letimer_timer_now() of the sample
+	int32_t			rh;				// hundredths of a percent
+	int32_t			temp;			// hundredths of a degree F
+} HISTORY_SAMPLE_STRUCT;
+
+typedef struct {
+	uint32_t		samples;		// samples in the window
+	int32_t			rh_min;
+	int32_t			rh_max;
+	int32_t			rh_mean;
+	int32_t			temp_min;
+	int32_t			temp_max;
+	int32_t			temp_mean;
+} HISTORY_STATS_STRUCT;
+
+typedef struct {
+	uint32_t		samples;		// samples held
+	uint32_t		bytes;			// bytes they take, the full sample at each block start included
+	uint32_t		span_ms;		// from the oldest to the newest sample
+	uint32_t		centi_bytes_per_sample;	// bytes per sample times 100
+	uint32_t		centi_hours;	// hours HISTORY_BYTES holds at this rate, times 100
+} HISTORY_USAGE_STRUCT;
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void history_clear(void);
+void history_add(uint32_t time_ms, int32_t rh, int32_t temp);
+uint32_t history_last(HISTORY_SAMPLE_STRUCT *samples, uint32_t n);
+bool history_window_stats(uint32_t window_ms, HISTORY_STATS_STRUCT *stats);
+void history_usage(HISTORY_USAGE_STRUCT *usage);
+
+#endif
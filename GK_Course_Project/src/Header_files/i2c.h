@@ -4,7 +4,7 @@
 //***********************************************************************************
 // Include files
 //***********************************************************************************
-
+#include "em_ldma.h"
 
 //***********************************************************************************
 // defined files
@@ -13,9 +13,18 @@
 #define I2C_EM_BLOCK 				EM2 // cannot enter EM2
 #define I2C_WRITE					0
 #define I2C_READ					1
-#define I2C_ONE_BYTE_CC				1
-#define I2C_TWO_BYTE_CC				2
-#define I2C_WRITE_LIMIT				20
+#define I2C_QUEUE_SIZE				8	// transactions waiting or running per bus
+#define I2C_BUSES					2	// I2C0 and I2C1
+#define I2C_LDMA_MIN_WRITE			2	// shorter write phases are cheaper by interrupt
+#define I2C_LDMA_MIN_READ			2	// the last byte is always read by interrupt
+#define I2C_LDMA_DESCRIPTORS		3	// read bytes, clear AUTOACK, enable RXDATAV
+#define I2C_LDMA_MAX_SEGMENT		2048	// most bytes one LDMA descriptor moves
+#define I2C_RETRY_MIN_MS			3	// shortest backoff, longer than the timer margin
+#define I2C_CLTO					I2C_CTRL_CLTO_1024PPC	// SCL low timeout, allows clock stretching
+#define I2C_BITO					I2C_CTRL_BITO_160PCC	// SCL high timeout while busy
+#define I2C_FAULT_INTERRUPTS		(I2C_IEN_ARBLOST | I2C_IEN_BUSERR | I2C_IEN_CLTO | I2C_IEN_BITO)
+//#define I2C_TRACE_ENABLED				// record state machine events, see i2c_trace_pop()
+#define I2C_TRACE_DEPTH				64	// trace entries kept, a power of two
 //***********************************************************************************
 // global variables
 //***********************************************************************************
@@ -25,9 +34,71 @@ typedef enum {
 	I2C_WRITE_DATA,
 	I2C_REQUEST_DATA,
 	I2C_READ_DATA,
-	I2C_CLOSE_FUNCTION
+	I2C_CLOSE_FUNCTION,
+	I2C_BACKOFF,		// bus released, waiting to poll the device again
+	I2C_NACKED			// stop sent after a NACK, completes with I2C_STATUS_NACK
 } State;
 
+typedef enum {
+	I2C_RETRY_IMMEDIATE,	// poll again as soon as the device NACKs
+	I2C_RETRY_FIXED,		// wait delay_ms after each NACK
+	I2C_RETRY_EXPONENTIAL,	// double the wait after each NACK, from delay_ms up to max_delay_ms
+	I2C_RETRY_CONVERSION,	// wait delay_ms, the conversion time, before the first poll
+	I2C_RETRY_POLICIES
+} I2C_RETRY_POLICY;
+
+typedef struct {
+	I2C_RETRY_POLICY	policy;
+	uint16_t			delay_ms;
+	uint16_t			max_delay_ms;
+} I2C_RETRY_STRUCT;
+
+typedef enum {
+	I2C_STATUS_OK,
+	I2C_STATUS_NACK,		// device did not acknowledge its address or data
+	I2C_STATUS_ARBLOST,		// arbitration lost, SDA did not follow TXDATA
+	I2C_STATUS_BUSERR,		// misplaced start or stop on the bus
+	I2C_STATUS_CLTO,		// SCL held low too long
+	I2C_STATUS_BITO,		// SCL idle high too long during a transfer
+	I2C_STATUS_PROTOCOL,	// interrupt not expected in the current state
+	I2C_STATUS_CHECKSUM,	// data read failed the device check, set by i2c_device.c
+	I2C_STATUSES
+} I2C_STATUS;
+
+#ifdef I2C_TRACE_ENABLED
+typedef enum {
+	I2C_TRACE_BEGIN,		// transaction started, byte is the write address
+	I2C_TRACE_ACK,
+	I2C_TRACE_NACK,
+	I2C_TRACE_RXDATAV,
+	I2C_TRACE_TXC,
+	I2C_TRACE_MSTOP,
+	I2C_TRACE_FAULT,		// byte is the I2C_STATUS
+	I2C_TRACE_POLL,			// backoff over, byte is the read address
+	I2C_TRACE_EVENTS
+} I2C_TRACE_EVENT;
+
+typedef struct {
+	uint32_t		cycles;		// CYCLE_COUNT_GET() when recorded
+	uint8_t			bus;		// 0 for I2C0, 1 for I2C1
+	uint8_t			event;		// I2C_TRACE_EVENT
+	uint8_t			state;		// state once the event was handled
+	uint8_t			byte;		// last byte written to TXDATA or read from RXDATA
+} I2C_TRACE_ENTRY_STRUCT;
+#endif
+
+typedef void (*I2C_DONE_FUNC)(void *arg);
+
+typedef struct {
+	uint32_t				freq;	// SCL frequency, at most the device's maximum
+	I2C_ClockHLR_TypeDef	chlr;	// clock low to high ratio
+} I2C_SPEED_STRUCT;
+
+typedef struct {
+	const uint8_t*		data;	// owned by the caller until the transaction's event
+	uint32_t			length;	// at least 1
+} I2C_SEGMENT_STRUCT;
+
 typedef struct {
 
 	// I2C_Init_TypeDef Struct Values
@@ -43,6 +114,8 @@ typedef struct {
 	bool			sda_en;		// enable out 0 route
 	bool			scl_en;		// enable out 1 route
 
+	bool			ldma;		// move write and read phases with the LDMA
+
 } I2C_OPEN_STRUCT ;
 
 typedef struct {
@@ -57,36 +130,130 @@ typedef struct {
 	I2C_TypeDef* 	i2c; // which i2c bus are we using
 	uint8_t 		device_address;
 	bool			read; // read = 1 write = 0
-	uint8_t* 		write_arr; // read: command code(s). Write: command code(s) + data
-	uint8_t			write_length; // read: command code length. Write: cc length + data length
-	uint8_t			num_bytes_written; // how many bytes have been written (iterator). Initialize to 0.
+	const I2C_SEGMENT_STRUCT* segments; // read: command code(s). Write: command code(s) + data
+	uint8_t			segment_count;
+	uint8_t			segment; // segment being written (iterator). Initialize to 0.
+	uint32_t		segment_offset; // next byte of that segment. Initialize to 0.
+	uint32_t		write_length; // total bytes of all segments
+	uint32_t		num_bytes_written; // how many bytes have been written (iterator). Initialize to 0.
 	uint8_t* 		read_arr; // read: where to save data. Write: null pointer
 	uint8_t			read_length; // read: number of bytes expected. Write: 0.
 	uint8_t			num_bytes_read; // how many bytes have been read (iterator). Initialize to 0
 	uint32_t		event; // for scheduler. 0 = no event.
+	uint8_t			sleep_token; // EM2 block held for the transaction
+	I2C_RETRY_STRUCT	retry; // how to poll a busy device
+	uint32_t		polls; // read address attempts
+	uint32_t		backoff_ms; // wait armed at the next MSTOP
+	I2C_STATUS*		status; // where to report the result, or null
+	uint32_t		bus_start; // CYCLE_COUNT_GET() when the bus was last taken
+	uint32_t		bus_cycles; // cycles the bus has been held, less backoffs
+	I2C_DONE_FUNC	done; // called on completion, or null
+	void*			done_arg;
 } I2C_PAYLOAD_STRUCT ;
 
 typedef struct {
 	uint8_t 		device_address;
 	bool			read;
-	uint8_t*		command_code; // command code
-	uint8_t			command_code_length;
-	uint8_t*		write_arr; // pure data
-	uint8_t			write_length;
+	const I2C_SEGMENT_STRUCT* segments; // written in order: command code(s), then any data
+	uint8_t			segment_count;
 	uint8_t*		read_arr; // where to put the data
 	uint8_t			read_length;
-	uint32_t		event;
+	uint32_t		event; // posted with the status as payload, or 0 for none
+	I2C_RETRY_STRUCT	retry; // how to poll a busy device for a read
+	I2C_STATUS*		status; // optional, written before the event is posted
+	const I2C_SPEED_STRUCT*	speed; // bus speed of the device, null for the speed set at open
+	I2C_DONE_FUNC	done; // optional, called from the I2C interrupt before the event
+	void*			done_arg;
 } I2C_START_STRUCT;
 
+typedef struct {
+	uint8_t			device_address;
+	bool			read;
+	const I2C_SEGMENT_STRUCT* segments; // not copied, see i2c_start()
+	uint8_t			segment_count;
+	uint32_t		write_length;
+	uint8_t*		read_arr;
+	uint8_t			read_length;
+	uint32_t		event;
+	I2C_RETRY_STRUCT	retry;
+	I2C_STATUS*		status;
+	const I2C_SPEED_STRUCT*	speed;
+	I2C_DONE_FUNC	done;
+	void*			done_arg;
+	uint32_t		submit_time; // letimer_timer_now() when queued
+} I2C_REQUEST_STRUCT;
+
+typedef struct {
+	uint32_t		submitted;		// transactions queued
+	uint32_t		completed;		// transactions finished
+	uint32_t		rejected;		// transactions refused with a full queue
+	uint32_t		max_depth;		// most transactions queued at once
+	uint32_t		total_wait_ms;	// sum of time from queued to started
+	uint32_t		max_wait_ms;	// worst time from queued to started
+	uint32_t		speed_changes;	// CLKDIV reprogrammed between transactions
+	uint32_t		last_bus_cycles;	// core cycles the last transaction held the bus
+	uint32_t		max_bus_cycles;		// longest a transaction held the bus
+	uint32_t		total_bus_cycles;	// sum of the bus time of every transaction
+} I2C_QUEUE_STATS_STRUCT;
+
+typedef struct {
+	uint32_t		irqs;			// I2C interrupts taken
+	uint32_t		isr_cycles;		// core cycles spent in the I2C interrupt handler
+	uint32_t		nack_polls;		// read address NACKs while a device was busy
+	uint32_t		last_polls;		// read address attempts of the last read
+	uint32_t		max_polls;		// most read address attempts of one read
+} I2C_CPU_STATS_STRUCT;
+
+typedef struct {
+	uint32_t		errors[I2C_STATUSES];	// failed transactions per cause, OK unused
+	uint32_t		recoveries;		// aborts and bus resets
+	uint32_t		stuck;			// resets that left SCL or SDA low
+} I2C_ERROR_STATS_STRUCT;
+
+typedef struct {
+	volatile I2C_PAYLOAD_STRUCT	payload;	// state machine of the running transaction
+	I2C_REQUEST_STRUCT		queue[I2C_QUEUE_SIZE];
+	uint32_t				head;		// running transaction
+	volatile uint32_t		count;		// running plus waiting transactions
+	I2C_QUEUE_STATS_STRUCT	stats;
+	I2C_CPU_STATS_STRUCT	cpu;
+	I2C_ERROR_STATS_STRUCT	errors;
+	I2C_IO_STRUCT			io;			// pins clocked by a bus reset
+	uint8_t					trace_byte;	// last byte moved by the CPU, for the trace
+	uint32_t				ref_freq;	// reference clock of the bus, 0 for the HFPER clock
+	I2C_SPEED_STRUCT		open_speed;	// speed set at open, used without a descriptor
+	I2C_SPEED_STRUCT		speed;		// speed CLKDIV is programmed for
+	bool					ldma;		// LDMA used for long phases
+	uint32_t				ldma_ch;	// LDMA channel of this bus
+	LDMA_TransferCfg_t		tx_cfg;		// LDMA request on TXBL
+	LDMA_TransferCfg_t		rx_cfg;		// LDMA request on RXDATAV
+	LDMA_Descriptor_t		ldma_desc[I2C_LDMA_DESCRIPTORS];
+} I2C_BUS_STRUCT;
+
 //***********************************************************************************
 // function prototypes
 //***********************************************************************************
 
 void i2c_open(I2C_TypeDef *i2c, I2C_OPEN_STRUCT *i2c_open, I2C_IO_STRUCT *i2c_io);
-void i2c_bus_reset(I2C_TypeDef *i2c, I2C_IO_STRUCT *i2c_io);
+bool i2c_bus_reset(I2C_TypeDef *i2c, I2C_IO_STRUCT *i2c_io);
 void I2C0_IRQHandler(void);
-void i2c_start(I2C_TypeDef *i2c, I2C_START_STRUCT* start_struct);
+void I2C1_IRQHandler(void);
+void LDMA_IRQHandler(void);
+bool i2c_start(I2C_TypeDef *i2c, I2C_START_STRUCT* start_struct);
 
-bool i2c_idle(void);
+bool i2c_idle(I2C_TypeDef *i2c);
+uint32_t i2c_queue_depth(I2C_TypeDef *i2c);
+void i2c_queue_stats(I2C_TypeDef *i2c, I2C_QUEUE_STATS_STRUCT *stats);
+void i2c_queue_stats_reset(I2C_TypeDef *i2c);
+void i2c_ldma_enable(I2C_TypeDef *i2c, bool enable);
+void i2c_cpu_stats(I2C_TypeDef *i2c, I2C_CPU_STATS_STRUCT *stats);
+void i2c_cpu_stats_reset(I2C_TypeDef *i2c);
+void i2c_error_stats(I2C_TypeDef *i2c, I2C_ERROR_STATS_STRUCT *stats);
+void i2c_error_stats_reset(I2C_TypeDef *i2c);
+#ifdef I2C_TRACE_ENABLED
+void i2c_trace_freeze(bool freeze);
+bool i2c_trace_pop(I2C_TRACE_ENTRY_STRUCT *entry);
+uint32_t i2c_trace_count(void);
+#endif
 
 #endif /* SRC_HEADER_FILES_I2C_H_ */
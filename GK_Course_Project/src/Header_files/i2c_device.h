@@ -0,0 +1,73 @@
+#ifndef SRC_HEADER_FILES_I2C_DEVICE_H_
+#define SRC_HEADER_FILES_I2C_DEVICE_H_
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "em_i2c.h"
+#include "i2c.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define I2C_DEVICE_DEFAULT_EVENT	0	// use the event of the device
+
+typedef void (*I2C_DECODE_FUNC)(const uint8_t *data, uint8_t length, void *result);
+typedef bool (*I2C_CHECK_FUNC)(const uint8_t *data, uint8_t length);
+
+typedef struct {
+	const I2C_SEGMENT_STRUCT*	segments;	// command code, then any data to write
+	uint8_t				segment_count;
+	uint8_t*			read_arr;		// where the read lands, null for a write
+	uint8_t				read_length;	// 0 for a write
+	uint16_t			conversion_ms;	// worst case conversion before data, 0 if none
+	I2C_DECODE_FUNC		decode;			// turns the read bytes into a result, or null
+	I2C_CHECK_FUNC		check;			// validates the read bytes in a batch, or null
+} I2C_COMMAND_STRUCT;
+
+typedef struct {
+	I2C_TypeDef*			i2c;			// bus the device sits on
+	uint8_t					address;		// 7 bit address
+	const I2C_SPEED_STRUCT*	speed;			// fastest speed the device supports
+	const I2C_COMMAND_STRUCT*	commands;	// command table, indexed by the driver's command ids
+	uint8_t					command_count;
+	I2C_RETRY_STRUCT		retry;			// polling of commands with a conversion time
+	uint32_t				event;			// completion event when none is given
+	I2C_STATUS				status;			// result of the last single command
+	uint32_t				check_errors;	// batch reads that failed their check
+} I2C_DEVICE_STRUCT;
+
+typedef struct {
+	I2C_DEVICE_STRUCT*	device;
+	uint8_t				command;
+	I2C_STATUS			status;			// result of this entry
+} I2C_BATCH_ENTRY_STRUCT;
+
+typedef struct {
+	I2C_BATCH_ENTRY_STRUCT*	entries;
+	uint8_t					count;
+	uint32_t				event;		// posted once every entry has completed, or 0
+	uint8_t					check_retries;	// reruns when a read fails its check
+	volatile uint8_t		pending;	// entries not completed yet
+	uint8_t					attempt;	// reruns of the current batch so far
+	uint32_t				reruns;		// reruns for failed checks
+	uint32_t				check_failures;	// batches that still failed a check
+} I2C_BATCH_STRUCT;
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+bool i2c_device_command(I2C_DEVICE_STRUCT *device, uint8_t command, uint32_t event);
+bool i2c_device_command_cb(I2C_DEVICE_STRUCT *device, uint8_t command, uint32_t event,
+		I2C_DONE_FUNC done, void *done_arg);
+void i2c_device_decode(const I2C_DEVICE_STRUCT *device, uint8_t command, void *result);
+bool i2c_device_batch(I2C_BATCH_STRUCT *batch);
+bool i2c_device_batch_ok(const I2C_BATCH_STRUCT *batch);
+I2C_STATUS i2c_device_batch_status(const I2C_BATCH_STRUCT *batch);
+
+#endif /* SRC_HEADER_FILES_I2C_DEVICE_H_ */
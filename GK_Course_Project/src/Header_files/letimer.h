@@ -12,6 +12,15 @@
 #define LETIMER_HZ		1000			// Utilizing ULFRCO oscillator for LETIMERs
 #define LETIMER_EM 		EM4 			// Using the ULFRCO, block from entering EM4
 
+#define LETIMER_TIMER_MAX			64		// software timers multiplexed on COMP1
+#define LETIMER_TIMER_NONE			0xFF	// invalid timer id / end of list
+#define LETIMER_TIMER_HANDLE_NONE	0		// never returned by a timer start, cancels nothing
+#define LETIMER_TIMER_GEN_SHIFT		8		// a handle is the generation above the timer id
+#define LETIMER_TIMER_GEN_MASK		0x00FFFFFF
+#define LETIMER_TIMER_MARGIN		2		// ticks, covers the COMP1 LF sync delay
+#define LETIMER_TIMER_BENCH_CASES	3		// 4, 16 and 64 active timers
+#define LETIMER_TIMER_BENCH_ITERATIONS	50
+
 //***********************************************************************************
 // global variables
 //***********************************************************************************
@@ -29,9 +38,30 @@ typedef struct {
 	bool			comp1_irq_enable;
 	uint32_t		comp1_evt;
 	bool			uf_irq_enable;
-	uint32_t		uf_evt;
+	uint32_t		uf_evt;				// posted with letimer_timer_now() of the period as payload
 } APP_LETIMER_PWM_TypeDef ;
 
+typedef void (*LETIMER_TIMER_FUNC)(void *arg);
+
+typedef struct {
+	uint32_t		deadline;			// absolute time in LETIMER ticks
+	uint32_t		period;				// ticks, 0 for a one-shot timer
+	uint32_t		event;				// scheduler event posted on expiry
+	LETIMER_TIMER_FUNC	callback;		// called on expiry instead of posting, or 0
+	void			*arg;				// passed to the callback
+	uint32_t		generation;			// counts the starts of this slot, never 0
+	uint8_t			next;				// deadline ordered list links
+	uint8_t			prev;
+	bool			active;
+} LETIMER_TIMER_STRUCT;
+
+typedef struct {
+	uint32_t		timers;				// number of active timers
+	uint32_t		insert_cycles;		// average cycles to insert one timer
+	uint32_t		cancel_cycles;		// average cycles to cancel one timer
+	uint32_t		expire_cycles;		// average cycles to expire the next timer
+} LETIMER_TIMER_BENCH_STRUCT;
+
 
 //***********************************************************************************
 // function prototypes
@@ -40,5 +70,14 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 void letimer_start(LETIMER_TypeDef *letimer, bool enable);
 void LETIMER0_IRQHandler(void);
 
+// Software timers
+uint32_t letimer_timer_start(uint32_t ms, bool periodic, uint32_t event);
+uint32_t letimer_timer_start_cb(uint32_t ms, LETIMER_TIMER_FUNC callback, void *arg);
+void letimer_timer_cancel(uint32_t handle);
+bool letimer_timer_running(void);
+uint32_t letimer_timer_now(void);
+uint32_t letimer_timer_next_us(void);
+void letimer_timer_bench(void);
+
 
 #endif
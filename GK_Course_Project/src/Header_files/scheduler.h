@@ -5,6 +5,7 @@
 #define	SCHEDULER_GUARD_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "em_assert.h"
 
 
@@ -13,7 +14,43 @@
 //***********************************************************************************
 // defined files
 //***********************************************************************************
+#define		SCHEDULER_MAX_EVENTS		32		// one handler per bit of the event mask
+#define		SCHEDULER_PRIORITY_LOW		0
+#define		SCHEDULER_PRIORITY_MEDIUM	1
+#define		SCHEDULER_PRIORITY_HIGH		2
+#define		SCHEDULER_PRIORITIES		3
+#define		SCHEDULER_LATENCY_QUEUE		SCHEDULER_PRIORITIES	// latency of the message queue
+#define		SCHEDULER_LATENCY_BINS		20		// power of two cycle bins, the last one open ended
+#define		SCHEDULER_QUEUE_SIZE		16		// must be a power of two
+#define		SCHEDULER_BENCH_ITERATIONS	100
+#define		SCHEDULER_BENCH_CASES		3		// 1, 8 and 32 registered events
 
+typedef struct {
+	uint32_t		event;				// single event bit
+	uint32_t		payload;			// data that travels with the event
+	uint32_t		timestamp;			// cycle count when it was posted
+} SCHEDULER_MSG_STRUCT;
+
+typedef void (*SCHEDULER_HANDLER)(void);
+typedef void (*SCHEDULER_MSG_HANDLER)(SCHEDULER_MSG_STRUCT *msg);
+
+typedef struct {
+	uint32_t		count;				// events dispatched
+	uint32_t		total_cycles;		// sum of post to dispatch cycles
+	uint32_t		max_cycles;			// worst post to dispatch cycles
+} SCHEDULER_LATENCY_STRUCT;
+
+typedef struct {
+	uint32_t		count;				// events and messages dispatched
+	uint32_t		max_cycles;			// worst post to dispatch cycles of any of them
+	uint32_t		bins[SCHEDULER_LATENCY_BINS];	// bin n counts waits of n significant bits
+} SCHEDULER_HISTOGRAM_STRUCT;
+
+typedef struct {
+	uint32_t		registered;			// number of registered events
+	uint32_t		chain_cycles;		// average cycles for the if-chain
+	uint32_t		dispatch_cycles;	// average cycles for scheduler_dispatch
+} SCHEDULER_BENCH_STRUCT;
 
 //***********************************************************************************
 // global variables
@@ -27,7 +64,22 @@ void scheduler_open(void);
 void add_scheduled_event(uint32_t event);
 void remove_scheduled_event(uint32_t event);
 uint32_t get_scheduled_events(void);
+uint32_t critical_enter(void);
+void critical_exit(uint32_t primask);
+void scheduler_register(uint32_t event, SCHEDULER_HANDLER handler, uint32_t priority, bool preempt);
+void scheduler_dispatch(void);
+void scheduler_latency_get(uint32_t priority, SCHEDULER_LATENCY_STRUCT *stats);
+void scheduler_latency_reset(void);
+void scheduler_latency_histogram(SCHEDULER_HISTOGRAM_STRUCT *histogram);
 
+// Event queue with payloads
+void scheduler_register_msg(uint32_t event, SCHEDULER_MSG_HANDLER handler);
+bool scheduler_post(uint32_t event, uint32_t payload);
+bool scheduler_get_msg(SCHEDULER_MSG_STRUCT *msg);
+bool scheduler_idle(void);
+uint32_t scheduler_queue_overflows(void);
 
+// Benchmark
+void scheduler_bench(void);
 
 #endif
@@ -35,8 +35,6 @@
 #include "em_assert.h"
 #include "em_core.h"
 
-#endif /* SRC_HEADER_FILES_SLEEP_ROUTINES_H_ */
-
 //***********************************************************************************
 // defined files
 //***********************************************************************************
@@ -46,6 +44,64 @@
 #define		EM3						3
 #define		EM4						4
 #define		MAX_ENERGY_MODES		5
+#define		SLEEP_NO_DEADLINE		0xFFFFFFFF	// no known wake up time
+#define		SLEEP_TICK_MS			1			// CRYOTIMER tick on the 1 kHz ULFRCO
+#define		SLEEP_TOKEN_MAX			8			// owner tracked blocks held at once
+#define		SLEEP_TOKEN_NONE		0xFF		// no block held
+#define		SLEEP_BENCH_ITERATIONS	100
+#define		SLEEP_BENCH_CASES		3			// nothing, EM2 and EM4 blocked
+
+typedef enum {
+	SLEEP_OWNER_LETIMER,
+	SLEEP_OWNER_I2C,
+	SLEEP_OWNER_LEUART,
+	SLEEP_OWNER_APP,
+	SLEEP_OWNERS
+} SLEEP_OWNER;
+
+typedef enum {
+	SLEEP_WAKE_LETIMER0,
+	SLEEP_WAKE_I2C0,
+	SLEEP_WAKE_I2C1,
+	SLEEP_WAKE_LEUART0,
+	SLEEP_WAKE_OTHER,		// any other interrupt, or already serviced
+	SLEEP_WAKE_SOURCES
+} SLEEP_WAKE_SOURCE;
+
+typedef uint32_t (*SLEEP_DEADLINE_FUNC)(void);	// microseconds to the next known wake up
+typedef void (*SLEEP_LEAK_FUNC)(SLEEP_OWNER owner, uint32_t EM, uint32_t held_ms);
+
+typedef struct {
+	bool			in_use;
+	bool			flagged;		// already reported by the watchdog
+	uint8_t			em;				// energy mode blocked
+	SLEEP_OWNER		owner;			// module holding the block
+	uint32_t		acquired;		// CRYOTIMER count when the block was taken
+} SLEEP_TOKEN_STRUCT;
+
+typedef struct {
+	uint32_t		blocked;			// energy mode blocked, MAX_ENERGY_MODES for none
+	uint32_t		ladder_cycles;		// average cycles for the if/else ladder
+	uint32_t		mask_cycles;		// average cycles for the blocked mask
+} SLEEP_BENCH_STRUCT;
+
+typedef struct {
+	uint32_t		wake_latency_us;	// time from wake up to running code
+	uint32_t		wake_energy_nj;		// energy to enter, wake up and re-clock
+	uint32_t		sleep_power_uw;		// power while in the mode
+} SLEEP_EM_COST_STRUCT;
+
+typedef struct {
+	uint32_t		entered[MAX_ENERGY_MODES];	// sleeps per energy mode chosen
+	uint32_t		shallower;					// sleeps shallower than allowed by the blocks
+	uint32_t		no_deadline;				// sleeps without a known deadline
+} SLEEP_POLICY_STATS_STRUCT;
+
+typedef struct {
+	uint32_t		elapsed_ms;						// time since the last reset
+	uint32_t		residency_ms[MAX_ENERGY_MODES];	// time spent in each energy mode
+	uint32_t		wakes[SLEEP_WAKE_SOURCES];		// wake ups per source
+} SLEEP_RESIDENCY_STRUCT;
 
 //***********************************************************************************
 // global variables
@@ -58,5 +114,22 @@
 void sleep_open(void);
 void sleep_block_mode(uint32_t EM);
 void sleep_unblock_mode(uint32_t EM);
+uint8_t sleep_block_acquire(uint32_t EM, SLEEP_OWNER owner);
+void sleep_block_release(uint8_t token);
+uint32_t sleep_block_owners(uint32_t EM);
+void sleep_watchdog_register(SLEEP_LEAK_FUNC leak);
+void sleep_watchdog_bound(uint32_t EM, uint32_t max_ms);
+uint32_t sleep_watchdog_check(void);
 void enter_sleep(void);
+void sleep_if_idle(void);
+void sleep_deadline_register(SLEEP_DEADLINE_FUNC next_deadline);
+void sleep_cost_table_set(const SLEEP_EM_COST_STRUCT *table);
+void sleep_policy_stats(SLEEP_POLICY_STATS_STRUCT *stats);
+uint32_t sleep_race_count(void);
+void sleep_residency_get(SLEEP_RESIDENCY_STRUCT *residency);
+void sleep_residency_reset(void);
+void sleep_residency_report(char *str, uint32_t size);
 uint32_t current_block_energy_mode(void);
+void sleep_bench(void);
+
+#endif /* SRC_HEADER_FILES_SLEEP_ROUTINES_H_ */
@@ -20,7 +20,11 @@
 #include "SI7021.h"
 #include "gpio.h"
 #include "i2c.h"
+#include "i2c_device.h"
 #include "HW_delay.h"
+#include "letimer.h"
+#include "scheduler.h"
+#include "cycle_count.h"
 
 //***********************************************************************************
 // defined files
@@ -28,12 +32,110 @@
 #define NO_EVENT 	0
 #define SI7021_TEST_DELAY 80 // ms
 
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void si7021_decode_rh(const uint8_t *data, uint8_t length, void *result);
+static void si7021_decode_temp_f(const uint8_t *data, uint8_t length, void *result);
+static bool si7021_crc_check(const uint8_t *data, uint8_t length);
+static uint8_t si7021_crc8_bitwise(const uint8_t *data, uint32_t length);
+static void si7021_conversion_update(void);
+static void si7021_command(SI7021_COMMAND command, uint32_t event);
+static void si7021_ur1_done(void *arg);
+static SI7021_RESOLUTION si7021_ur1_resolution(uint8_t ur1);
+
 //***********************************************************************************
 // private variables
 //***********************************************************************************
-static uint8_t command_code[SI7021_MAX_CC_LENGTH];
-static uint8_t write_arr[SI7021_MAX_WRITE_BYTES];
-static uint8_t read_arr[SI7021_MAX_READ_BYTES];
+// each command reads into its own buffer, so a batch does not overwrite its results
+static uint8_t rh_data[SI7021_NUM_BYTES_RH_CHECKSUM];
+static uint8_t temp_data[SI7021_NUM_BYTES_TEMP_CHECKSUM]; // temperature and temperature from RH
+static uint8_t ur1_data[SI7021_NUM_BYTES_USER_REG];
+static uint8_t snb_data[SI7021_NUM_BYTES_SNB];
+static uint8_t ur1_value = SI7021_UR1_DEFAULT; // UR1 as last written with I2C_STATUS_OK
+static bool ur1_written; // the sensor keeps UR1 over an MCU reset, so write before trusting ur1_value
+static uint8_t ur1_pending; // UR1 being written, sent in place
+static volatile uint32_t ur1_writes; // UR1 writes queued and not completed yet
+static int32_t adapt_rh, adapt_temp; // last sample seen by si7021_resolution_adapt()
+static uint32_t adapt_stable; // samples in a row without a fast change
+
+// command codes are sent in place by the I2C driver, so they are never reused
+static const uint8_t rh_no_hold_cc[] = {SI7021_RH_NO_HOLD};
+static const uint8_t temp_no_hold_cc[] = {SI7021_TEMP_NO_HOLD};
+static const uint8_t temp_from_rh_cc[] = {SI7021_TEMP_FROM_RH};
+static const uint8_t read_ur1_cc[] = {SI7021_READ_UR1};
+static const uint8_t write_ur1_cc[] = {SI7021_WRITE_UR1};
+static const uint8_t snb_cc[] = {SI7021_SNB_MSB, SI7021_SNB_LSB};
+
+static const I2C_SEGMENT_STRUCT rh_no_hold = {rh_no_hold_cc, sizeof(rh_no_hold_cc)};
+static const I2C_SEGMENT_STRUCT temp_no_hold = {temp_no_hold_cc, sizeof(temp_no_hold_cc)};
+static const I2C_SEGMENT_STRUCT temp_from_rh = {temp_from_rh_cc, sizeof(temp_from_rh_cc)};
+static const I2C_SEGMENT_STRUCT read_ur1 = {read_ur1_cc, sizeof(read_ur1_cc)};
+static const I2C_SEGMENT_STRUCT snb = {snb_cc, sizeof(snb_cc)};
+static const I2C_SEGMENT_STRUCT write_ur1[] = {
+	{write_ur1_cc, sizeof(write_ur1_cc)},
+	{&ur1_pending, SI7021_NUM_BYTES_USER_REG}
+};
+
+// segments, segment count, read buffer, read length, conversion time, decoder, check
+// the temperature of an RH measurement is read without a checksum
+// the conversion times follow the resolution in UR1, see si7021_conversion_update()
+static I2C_COMMAND_STRUCT commands[SI7021_COMMANDS] = {
+	[SI7021_CMD_RH] = {&rh_no_hold, 1, rh_data, SI7021_NUM_BYTES_RH_NOCHECKSUM, SI7021_RH_CONV_MS, si7021_decode_rh},
+	[SI7021_CMD_TEMP] = {&temp_no_hold, 1, temp_data, SI7021_NUM_BYTES_TEMP_NOCHECKSUM, SI7021_TEMP_CONV_MS, si7021_decode_temp_f},
+	[SI7021_CMD_RH_CRC] = {&rh_no_hold, 1, rh_data, SI7021_NUM_BYTES_RH_CHECKSUM, SI7021_RH_CONV_MS, si7021_decode_rh, si7021_crc_check},
+	[SI7021_CMD_TEMP_CRC] = {&temp_no_hold, 1, temp_data, SI7021_NUM_BYTES_TEMP_CHECKSUM, SI7021_TEMP_CONV_MS, si7021_decode_temp_f, si7021_crc_check},
+	[SI7021_CMD_TEMP_FROM_RH] = {&temp_from_rh, 1, temp_data, SI7021_NUM_BYTES_TEMP_FROM_RH, 0, si7021_decode_temp_f},
+	[SI7021_CMD_READ_UR1] = {&read_ur1, 1, ur1_data, sizeof(ur1_data), 0, 0},
+	[SI7021_CMD_WRITE_UR1] = {write_ur1, sizeof(write_ur1) / sizeof(write_ur1[0]), 0, 0, 0, 0},
+	[SI7021_CMD_SNB] = {&snb, 1, snb_data, sizeof(snb_data), 0, 0},
+};
+
+// bus speed given with every SI7021 transaction, the bench swaps it
+static const I2C_SPEED_STRUCT fast_speed = {SI7021_I2C_FREQ, SI7021_I2C_CLK_RATIO};
+static const I2C_SPEED_STRUCT standard_speed = {I2C_FREQ_STANDARD_MAX, i2cClockHLRStandard};
+
+static I2C_DEVICE_STRUCT si7021 = {
+	.i2c = SI7021_I2C,
+	.address = SI7021_DEV_ADDR,
+	.speed = &fast_speed,
+	.commands = commands,
+	.command_count = SI7021_COMMANDS,
+	.retry = {SI7021_RETRY_POLICY, SI7021_RETRY_DELAY_MS, SI7021_RETRY_MAX_MS},
+	.event = NO_EVENT,
+	.status = I2C_STATUS_OK
+};
+
+// worst case RH and temperature conversions of each resolution
+static const uint16_t rh_conv_ms[SI7021_RESOLUTIONS] = {
+	SI7021_RH_CONV_MS, SI7021_RH8_CONV_MS, SI7021_RH10_CONV_MS, SI7021_RH11_CONV_MS
+};
+static const uint16_t temp_conv_ms[SI7021_RESOLUTIONS] = {
+	SI7021_TEMP_CONV_MS, SI7021_TEMP12_CONV_MS, SI7021_TEMP13_CONV_MS, SI7021_TEMP11_CONV_MS
+};
+
+// RH, then the temperature measured with it, with one event for both
+static I2C_BATCH_ENTRY_STRUCT sample_entries[] = {
+	{&si7021, SI7021_CHECKSUM ? SI7021_CMD_RH_CRC : SI7021_CMD_RH, I2C_STATUS_OK},
+	{&si7021, SI7021_CMD_TEMP_FROM_RH, I2C_STATUS_OK}
+};
+static I2C_BATCH_STRUCT sample_batch = {
+	.entries = sample_entries,
+	.count = sizeof(sample_entries) / sizeof(sample_entries[0]),
+	.event = NO_EVENT,
+	.check_retries = SI7021_CRC_RETRIES
+};
+
+// CRC of each 4 bit value shifted through the polynomial, for si7021_crc8()
+static const uint8_t crc_nibble_table[16] = {
+	0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97,
+	0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E
+};
+
+static SI7021_BENCH_STRUCT bench_results[SI7021_BENCH_CASES];
+static SI7021_RETRY_BENCH_STRUCT retry_bench_results[I2C_RETRY_POLICIES];
+static SI7021_SPEED_BENCH_STRUCT speed_bench_results[SI7021_SPEED_BENCH_CASES];
+static SI7021_CRC_BENCH_STRUCT crc_bench_results;
 
 
 
@@ -43,21 +145,22 @@ static uint8_t read_arr[SI7021_MAX_READ_BYTES];
 //***********************************************************************************
 /***************************************************************************//**
  * @brief
- * 	A private function that clears the arrays used as parameters for the i2c
- * 	peripheral.
+ * 	A private function that clears the read buffer of a command.
  *
  *
  * @details
- * 	This function resets the write_arr, read_arr, and command_code arrays
- * 	to be filled with zeros.
+ * 	This function fills the buffer the command reads into with zeros, so a
+ * 	failed read does not leave the data of an older one behind.
  *
+ * @param[in] command
+ *   The SI7021 command.
  *
  ******************************************************************************/
-static void clear_i2c_arrays(void)
+static void clear_i2c_arrays(SI7021_COMMAND command)
 {
-	memset(&write_arr[0], 0, SI7021_MAX_WRITE_BYTES);
-	memset(&read_arr[0], 0, SI7021_MAX_READ_BYTES);
-	memset(&command_code[0], 0, SI7021_MAX_CC_LENGTH);
+	if(commands[command].read_arr){
+		memset(commands[command].read_arr, 0, commands[command].read_length);
+	}
 }
 
 /***************************************************************************//**
@@ -96,84 +199,238 @@ void si7021_i2c_open(void)
 	i2c_open_struct.scl_route0 = SI7021_SCL_LOC;
 	i2c_open_struct.sda_en = SI7021_SDA_EN;
 	i2c_open_struct.sda_route0 = SI7021_SDA_LOC;
+	i2c_open_struct.ldma = SI7021_I2C_LDMA;
 
 	i2c_open(SI7021_I2C, &i2c_open_struct, &i2c_io_struct);
 
 
 }
 
+/***************************************************************************//**
+ * @brief
+ *	Returns the device descriptor of the SI7021.
+ *
+ * @details
+ *	Lets the SI7021 commands be put in a batch with the commands of other
+ *	devices, see i2c_device_batch(). The commands are indexed by SI7021_COMMAND.
+ *
+ * @return
+ * 	The SI7021 device descriptor.
+ *
+ ******************************************************************************/
+I2C_DEVICE_STRUCT *si7021_device(void){
+	return &si7021;
+}
 
+/***************************************************************************//**
+ * @brief
+ *	Queues one SI7021 command.
+ *
+ * @details
+ *	Clears the read buffer of the command and queues it on the SI7021 bus.
+ *	The result is kept in the status of the device.
+ *
+ * @param[in] command
+ *   The SI7021 command.
+ *
+ * @param[in] event
+ * 	 The scheduler event associated with the completed command.
+ *
+ ******************************************************************************/
+static void si7021_command(SI7021_COMMAND command, uint32_t event){
+	clear_i2c_arrays(command);
+	i2c_device_command(&si7021, command, event);
+}
 
 /***************************************************************************//**
  * @brief
- *	A function that requests a read from the SI7021 Temperature and Humidity sensor.
+ *	Sets how no hold measurements poll the SI7021.
  *
  * @details
- *  This starts the I2C state machine to perform a read.
- * 	It is required to put the command code in the private command_code array
- * 	before calling this function.
- * 	Results will be stored in the private read_arr array which can be accessed
- * 	with either si7021_convert_temp_f() or si7021_convert_rh().
+ *	The SI7021 NACKs its read address until a no hold measurement is done.
+ *	I2C_RETRY_IMMEDIATE polls back to back for the whole conversion, keeping
+ *	the core awake. The other policies release the bus and let the core sleep
+ *	in EM2 between polls. I2C_RETRY_CONVERSION waits the worst case conversion
+ *	time first, so normally one poll is enough.
  *
- * @param[in] command_code_length
- *   The number of bytes in the command code array
+ * @param[in] policy
+ *   The retry policy for later measurements.
  *
- * @param[in] read_length
- *   The number of bytes expected to be read
+ ******************************************************************************/
+void si7021_retry_policy_set(I2C_RETRY_POLICY policy){
+	EFM_ASSERT(policy < I2C_RETRY_POLICIES);
+	si7021.retry.policy = policy;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	A function to start one sampling cycle of the SI7021
+ *
+ * @details
+ *	Queues the RH measurement and the read of the temperature measured with
+ *	it as one batch. The temperature read follows the RH read on the bus
+ *	straight away, so the core is woken once per sample, by the event.
+ *
+ * @note
+ *  The event is posted to the scheduler message queue with the status of the
+ *  sample, see si7021_sample_status(), as its payload. Check it in the event
+ *  handler, then use si7021_convert_rh() and si7021_convert_temp_f(). A sample
+ *  that is still running is not restarted.
  *
  * @param[in] event
- * 	 The scheduler event associated with a completed Read operation.
+ * 	 The scheduler event associated with the completed sample.
  *
  ******************************************************************************/
-void si7021_read(uint8_t command_code_length, uint8_t read_length, uint32_t event){
-	I2C_START_STRUCT start_struct;
-	// put stuff in start_struct
-	start_struct.device_address = SI7021_DEV_ADDR;
-	start_struct.read = I2C_READ;
-	start_struct.command_code = command_code;
-	start_struct.command_code_length = command_code_length;
-	start_struct.write_arr = 0; // no data in write command
-	start_struct.write_length = 0;
-	start_struct.read_arr = read_arr;
-	start_struct.read_length = read_length;
-	start_struct.event = event;
-	i2c_start(SI7021_I2C, &start_struct);
+void si7021_sample(uint32_t event){
+	if(sample_batch.pending) return;
+	clear_i2c_arrays(sample_entries[0].command);
+	clear_i2c_arrays(sample_entries[1].command);
+	sample_batch.event = event;
+	i2c_device_batch(&sample_batch);
+}
 
+/***************************************************************************//**
+ * @brief
+ *	A function which reports whether the last sample succeeded.
+ *
+ * @return
+ * 	true if both the RH and the temperature were read, and passed their CRC.
+ *
+ ******************************************************************************/
+bool si7021_sample_ok(void){
+	return i2c_device_batch_ok(&sample_batch);
 }
 
 /***************************************************************************//**
  * @brief
- *	A function that requests a write from the SI7021 Temperature and Humidity sensor.
+ *	A function which returns why the last sample failed.
  *
  * @details
- *  This starts the I2C state machine. It will write bytes to the device.
- * 	It is required to put the command code in the private command_code array,
- * 	and the desired write bytes in the private write_arr array before calling
- * 	this function.
+ *	I2C_STATUS_CHECKSUM means the data still failed its CRC after
+ *	SI7021_CRC_RETRIES reruns. Anything else but I2C_STATUS_OK is a bus
+ *	failure.
+ *
+ * @return
+ * 	The first failed status of the sample, or I2C_STATUS_OK.
+ *
+ ******************************************************************************/
+I2C_STATUS si7021_sample_status(void){
+	return i2c_device_batch_status(&sample_batch);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sets whether samples read and check the RH checksum.
  *
- * @param[in] command_code_length
- *   The number of bytes in the command code array
+ * @details
+ *	With the checksum, the RH measurement reads a third byte, the CRC-8 of the
+ *	two data bytes, and a sample that fails it is run again. The temperature
+ *	of the RH measurement has no checksum on the SI7021.
  *
- * @param[in] write_length
- *   The number of bytes of data to be written
+ * @note
+ *	Takes effect from the next sample. Ignored while a sample is running.
  *
- * @param[in] event
- * 	 The scheduler event associated with a completed Write operation.
+ * @param[in] enable
+ *   true to read and check the checksum.
  *
  ******************************************************************************/
-void si7021_write(uint8_t command_code_length, uint8_t write_length, uint32_t event){
-	I2C_START_STRUCT start_struct;
-	// put stuff in start_struct here
-	start_struct.device_address = SI7021_DEV_ADDR;
-	start_struct.read = I2C_WRITE;
-	start_struct.command_code = command_code;
-	start_struct.command_code_length = command_code_length;
-	start_struct.write_arr = write_arr;
-	start_struct.write_length = write_length;
-	start_struct.read_arr = 0;
-	start_struct.read_length = 0;
-	start_struct.event = event;
-	i2c_start(SI7021_I2C, &start_struct);
+void si7021_checksum_enable(bool enable){
+	if(sample_batch.pending) return;
+	sample_entries[0].command = enable ? SI7021_CMD_RH_CRC : SI7021_CMD_RH;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Computes the SI7021 CRC-8.
+ *
+ * @details
+ *	The polynomial is SI7021_CRC_POLY, x^8 + x^5 + x^4 + 1, with an initial
+ *	value of 0, MSB first and no final XOR. Each byte is shifted through the
+ *	polynomial four bits at a time with the 16 entry crc_nibble_table, which
+ *	costs two lookups per byte in 16 bytes of flash instead of the 256 of a
+ *	full byte table.
+ *
+ * @param[in] data
+ *   The bytes, in the order the SI7021 sends them.
+ *
+ * @param[in] length
+ *   The number of bytes.
+ *
+ * @return
+ * 	The CRC. Over data followed by its CRC the result is 0.
+ *
+ ******************************************************************************/
+uint8_t si7021_crc8(const uint8_t *data, uint32_t length){
+	uint8_t crc = 0;
+	while(length--){
+		crc ^= *data++;
+		crc = (uint8_t)(crc << 4) ^ crc_nibble_table[crc >> 4];
+		crc = (uint8_t)(crc << 4) ^ crc_nibble_table[crc >> 4];
+	}
+	return crc;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Bit by bit SI7021 CRC-8, the reference for si7021_crc_bench().
+ *
+ * @param[in] data
+ *   The bytes, in the order the SI7021 sends them.
+ *
+ * @param[in] length
+ *   The number of bytes.
+ *
+ * @return
+ * 	The CRC.
+ *
+ ******************************************************************************/
+static uint8_t si7021_crc8_bitwise(const uint8_t *data, uint32_t length){
+	uint8_t crc = 0;
+	while(length--){
+		crc ^= *data++;
+		for(int bit = 0; bit < 8; bit++){
+			crc = (crc & 0x80) ? (uint8_t)(crc << 1) ^ SI7021_CRC_POLY : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Check of the measurements read with their checksum.
+ *
+ * @details
+ *	Run from the I2C interrupt handler when a sample completes.
+ *
+ * @param[in] data
+ *   The data bytes followed by the checksum byte.
+ *
+ * @param[in] length
+ *   The number of bytes read, with the checksum.
+ *
+ * @return
+ * 	true if the checksum matches the data.
+ *
+ ******************************************************************************/
+static bool si7021_crc_check(const uint8_t *data, uint8_t length){
+	return si7021_crc8(data, length) == 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the CRC error counters of the samples.
+ *
+ * @param[out] stats
+ *   The reads that failed their CRC, the samples run again because of them,
+ *   and the samples still reported as failed.
+ *
+ ******************************************************************************/
+void si7021_crc_stats(SI7021_CRC_STATS_STRUCT *stats){
+	uint32_t primask = critical_enter();
+	stats->errors = si7021.check_errors;
+	stats->reruns = sample_batch.reruns;
+	stats->flagged = sample_batch.check_failures;
+	critical_exit(primask);
 }
 
 
@@ -190,16 +447,14 @@ void si7021_write(uint8_t command_code_length, uint8_t write_length, uint32_t ev
  *	After the RH data has been converted and stored, you can use
  *	si7021_read_rh_temp() to read the associated temperature reading without
  *	starting a whole new conversion.
- *	You must access the data before calling another reading function.
+ *	You must access the data before calling another RH reading function.
  *
  * @param[in] event
  * 	 The scheduler event associated with a completed Read RH operation.
  *
  ******************************************************************************/
 void si7021_read_rh(uint32_t event){
-	clear_i2c_arrays();
-	command_code[0] = SI7021_RH_NO_HOLD;
-	si7021_read(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_RH_NOCHECKSUM, event);
+	si7021_command(SI7021_CMD_RH, event);
 }
 
 /***************************************************************************//**
@@ -215,16 +470,14 @@ void si7021_read_rh(uint32_t event){
  *	This version of temperature read will start a conversion, and then report
  *	the results back. Use si7021_read_rh_temp() to read a temperature that was
  *	measured during a relative humidity conversion.
- *	You must access the data before calling another reading function.
+ *	You must access the data before calling another temperature reading function.
  *
  * @param[in] event
  * 	 The scheduler event associated with a completed Read Temperature operation.
  *
  ******************************************************************************/
 void si7021_read_temp(uint32_t event){
-	clear_i2c_arrays();
-	command_code[0] = SI7021_TEMP_NO_HOLD;
-	si7021_read(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_TEMP_NOCHECKSUM, event);
+	si7021_command(SI7021_CMD_TEMP, event);
 }
 
 /***************************************************************************//**
@@ -239,16 +492,14 @@ void si7021_read_temp(uint32_t event){
  * @note
  *	This version of temperature read will NOT start a new conversion, and can only
  *	be called after si7021_read_rh().
- *	You must access the data before calling another reading function.
+ *	You must access the data before calling another temperature reading function.
  *
  * @param[in] event
  * 	 The scheduler event associated with a completed Read Temperature operation.
  *
  ******************************************************************************/
 void si7021_read_rh_temp(uint32_t event){
-	clear_i2c_arrays();
-	command_code[0] = SI7021_TEMP_FROM_RH;
-	si7021_read(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_TEMP_FROM_RH, event);
+	si7021_command(SI7021_CMD_TEMP_FROM_RH, event);
 }
 
 /***************************************************************************//**
@@ -258,17 +509,14 @@ void si7021_read_rh_temp(uint32_t event){
  * @details
  *	This function initiates the read command to get the current value of the
  *	User Register from the Si7021 device
- *	To get the data read from this function, read the private read_arr array.
- *	You must access the data before calling another reading function.
+ *	To get the data read from this function, use si7021_ur1().
  *
  * @param[in] event
  * 	 The scheduler event associated with a completed Read UR1 operation.
  *
  ******************************************************************************/
 void si7021_read_ur1(uint32_t event){
-	clear_i2c_arrays();
-	command_code[0]= SI7021_READ_UR1;
-	si7021_read(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_USER_REG, event);
+	si7021_command(SI7021_CMD_READ_UR1, event);
 }
 
 /***************************************************************************//**
@@ -279,6 +527,14 @@ void si7021_read_ur1(uint32_t event){
  *	This function initiates the write command to overwrite the current value of the
  *	User Register from the Si7021 device with the provided value.
  *
+ *	The cached UR1 value used by si7021_resolution(), and the conversion times
+ *	that follow it, only change once the SI7021 has taken the write, see
+ *	si7021_ur1_done().
+ *
+ * @note
+ *	The value is sent in place from a private byte. Calling this again before
+ *	the write completes replaces the value the queued write will send.
+ *
  * @param[in] byte
  *   The byte value that will be written to the register.
  *
@@ -287,10 +543,149 @@ void si7021_read_ur1(uint32_t event){
  *
  ******************************************************************************/
 void si7021_write_ur1(uint8_t byte, uint32_t event){
-	clear_i2c_arrays();
-	command_code[0] = SI7021_WRITE_UR1;
-	write_arr[0] = byte;
-	si7021_write(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_USER_REG, event);
+	uint32_t primask = critical_enter();
+	ur1_pending = byte;
+	ur1_writes++;
+	if(!i2c_device_command_cb(&si7021, SI7021_CMD_WRITE_UR1, event, si7021_ur1_done, 0)){
+		ur1_writes--;
+	}
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Completion of a UR1 write.
+ *
+ * @details
+ *	Run from the I2C interrupt handler once the status of the write is known.
+ *	On I2C_STATUS_OK the written byte becomes the cached UR1 value and the
+ *	conversion times follow it. While a later write is still queued it is
+ *	left to that write, since ur1_pending already holds its value. A failed
+ *	write leaves the cached value alone but stops trusting it, so the next
+ *	si7021_resolution_set() writes UR1 again.
+ *
+ * @param[in] arg
+ *   Not used.
+ *
+ ******************************************************************************/
+static void si7021_ur1_done(void *arg){
+	(void)arg;
+	ur1_writes--;
+	if(si7021.status != I2C_STATUS_OK){
+		ur1_written = false; // the SI7021 may hold either value
+		return;
+	}
+	if(ur1_writes) return;
+	ur1_value = ur1_pending;
+	ur1_written = true;
+	si7021_conversion_update();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sets the conversion times of the measurements from the cached UR1.
+ *
+ * @details
+ *	The conversion policy waits out these times before polling, so they must
+ *	follow the resolution. They change for the commands queued from now on.
+ *
+ ******************************************************************************/
+static void si7021_conversion_update(void){
+	SI7021_RESOLUTION resolution = si7021_resolution();
+	commands[SI7021_CMD_RH].conversion_ms = rh_conv_ms[resolution];
+	commands[SI7021_CMD_RH_CRC].conversion_ms = rh_conv_ms[resolution];
+	commands[SI7021_CMD_TEMP].conversion_ms = temp_conv_ms[resolution];
+	commands[SI7021_CMD_TEMP_CRC].conversion_ms = temp_conv_ms[resolution];
+}
+
+/***************************************************************************//**
+ * @brief
+ *	A function to set the measurement resolution.
+ *
+ * @details
+ *	Changes the RES1 and RES0 bits of the cached UR1 value, keeps the other
+ *	bits, and writes it to the SI7021. UR1 is never read back first. Nothing
+ *	is written if the resolution is already set, except the first time, since
+ *	the SI7021 keeps UR1 over a reset of the MCU.
+ *
+ * @note
+ *	The write is queued ahead of any later sample on the bus, so the next
+ *	sample uses the new resolution. The conversion times follow once the write
+ *	completes, a sample queued before then waits the old ones and polls.
+ *	A resolution already on its way to UR1 is not written again.
+ *
+ * @param[in] resolution
+ *   The RH and temperature resolution.
+ *
+ * @param[in] event
+ * 	 The scheduler event associated with a completed write, if one is made.
+ *
+ ******************************************************************************/
+void si7021_resolution_set(SI7021_RESOLUTION resolution, uint32_t event){
+	EFM_ASSERT(resolution < SI7021_RESOLUTIONS);
+	uint8_t ur1 = ur1_writes ? ur1_pending : ur1_value; // where UR1 is headed
+	if((ur1_writes || ur1_written) && resolution == si7021_ur1_resolution(ur1)) return;
+	uint8_t res_bits = ((resolution & 0x2) << 6) | (resolution & 0x1);
+	si7021_write_ur1((ur1 & ~SI7021_UR1_RES_MASK) | res_bits, event);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	A function which returns the measurement resolution.
+ *
+ * @return
+ * 	The resolution in the cached UR1 value, the last one the SI7021 took.
+ *
+ ******************************************************************************/
+SI7021_RESOLUTION si7021_resolution(void){
+	return si7021_ur1_resolution(ur1_value);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the resolution held in the RES1 and RES0 bits of a UR1 value.
+ *
+ ******************************************************************************/
+static SI7021_RESOLUTION si7021_ur1_resolution(uint8_t ur1){
+	return (SI7021_RESOLUTION)(((ur1 >> 6) & 0x2) | (ur1 & 0x1));
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Adapts the measurement resolution to how fast the readings change.
+ *
+ * @details
+ *	Called with each good sample. A change of at least SI7021_RES_FAST_RH or
+ *	SI7021_RES_FAST_TEMP since the last sample raises the resolution to 12 bit
+ *	RH and 14 bit temperature straight away. After SI7021_RES_STABLE_SAMPLES
+ *	samples in a row without one, it drops to 8 bit RH and 12 bit temperature,
+ *	which converts in 7 ms instead of 23 ms. The thresholds are several steps
+ *	of the low resolution, about 0.5 % RH and 0.08 F, so its coarser readings
+ *	do not raise it again on their own.
+ *
+ * @note
+ *	Does nothing unless SI7021_ADAPTIVE_RESOLUTION is true.
+ *
+ * @param[in] rh
+ *   The relative humidity of the sample, in hundredths of a percent.
+ *
+ * @param[in] temp
+ *   The temperature of the sample, in hundredths of a degree Fahrenheit.
+ *
+ ******************************************************************************/
+void si7021_resolution_adapt(int32_t rh, int32_t temp){
+	if(!SI7021_ADAPTIVE_RESOLUTION) return;
+	int32_t rh_change = rh > adapt_rh ? rh - adapt_rh : adapt_rh - rh;
+	int32_t temp_change = temp > adapt_temp ? temp - adapt_temp : adapt_temp - temp;
+	bool first = !ur1_written;
+	adapt_rh = rh;
+	adapt_temp = temp;
+	if(first || rh_change >= SI7021_RES_FAST_RH || temp_change >= SI7021_RES_FAST_TEMP){
+		adapt_stable = 0;
+		si7021_resolution_set(SI7021_RES_RH12_T14, NO_EVENT);
+	} else if(++adapt_stable >= SI7021_RES_STABLE_SAMPLES){
+		si7021_resolution_set(SI7021_RES_RH8_T12, NO_EVENT);
+	}
 }
 
 /***************************************************************************//**
@@ -301,18 +696,121 @@ void si7021_write_ur1(uint8_t byte, uint32_t event){
  *	This function initiates the read command to get the Electronic Serial
  *	Number part B from the Si7021 device. The first byte return indicates the
  *	sensor part number of the device you are communicating with.
- *
- *	You must access the data before calling another reading function.
+ *	To get the data read from this function, use si7021_snb().
  *
  * @param[in] event
  * 	 The scheduler event associated with a completed Write UR1 operation.
  *
  ******************************************************************************/
 void si7021_read_SNB(uint32_t event){
-	clear_i2c_arrays();
-	command_code[0] = SI7021_SNB_MSB;
-	command_code[1] = SI7021_SNB_LSB;
-	si7021_read(I2C_TWO_BYTE_CC, SI7021_NUM_BYTES_SNB, event);
+	si7021_command(SI7021_CMD_SNB, event);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the User Register 1 value of the last si7021_read_ur1().
+ *
+ ******************************************************************************/
+uint8_t si7021_ur1(void){
+	return ur1_data[0];
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the Serial Number B bytes of the last si7021_read_SNB().
+ *
+ * @return
+ * 	SI7021_NUM_BYTES_SNB bytes, the part number first.
+ *
+ ******************************************************************************/
+const uint8_t *si7021_snb(void){
+	return snb_data;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Converts a raw temperature code into hundredths of a degree Fahrenheit.
+ *
+ * @details
+ *	The data sheet gives T = 175.72 * code / 65536 - 46.85 in Celsius, so in
+ *	hundredths of a degree Fahrenheit
+ *	T = (175.72 * 1.8 * 100) * code / 65536 - (46.85 * 1.8 - 32) * 100
+ *	  = 31629.6 * code / 65536 - 5233.
+ *	The multiplier is rounded to SI7021_TEMP_CF_MUL so the product fits in
+ *	32 bits. With the rounding shift the result is within 0.9 hundredths of
+ *	the floating point formula over every code.
+ *
+ * @param[in] temp_code
+ *   The 16 bit temperature code, MSB first from the sensor.
+ *
+ * @return
+ * 	The temperature in hundredths of a degree Fahrenheit.
+ *
+ ******************************************************************************/
+int32_t si7021_temp_centi_f(uint16_t temp_code){
+	return (int32_t)((temp_code * SI7021_TEMP_CF_MUL + 0x8000) >> 16) - SI7021_TEMP_CF_OFFSET;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Converts a raw humidity code into hundredths of a percent.
+ *
+ * @details
+ *	The data sheet gives RH = 125 * code / 65536 - 6, so in hundredths of a
+ *	percent RH = 12500 * code / 65536 - 600, with no rounding of the
+ *	multiplier. The shift rounds to the nearest hundredth.
+ *
+ * @note
+ *	Like the data sheet formula, the result can be a little below 0 or above
+ *	100 %.
+ *
+ * @param[in] rh_code
+ *   The 16 bit humidity code, MSB first from the sensor.
+ *
+ * @return
+ * 	The relative humidity in hundredths of a percent.
+ *
+ ******************************************************************************/
+int32_t si7021_rh_centi(uint16_t rh_code){
+	return (int32_t)((rh_code * SI7021_RH_CENTI_MUL + 0x8000) >> 16) - SI7021_RH_CENTI_OFFSET;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Decoder of the temperature commands.
+ *
+ * @param[in] data
+ *   The bytes read, MSB first.
+ *
+ * @param[in] length
+ *   The number of bytes read.
+ *
+ * @param[out] result
+ *   An int32_t, in hundredths of a degree Fahrenheit.
+ *
+ ******************************************************************************/
+static void si7021_decode_temp_f(const uint8_t *data, uint8_t length, void *result){
+	(void)length; // the code is the first two bytes, a checksum may follow
+	*(int32_t*)result = si7021_temp_centi_f((data[0] << 8) | data[1]);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Decoder of the RH command.
+ *
+ * @param[in] data
+ *   The bytes read, MSB first.
+ *
+ * @param[in] length
+ *   The number of bytes read.
+ *
+ * @param[out] result
+ *   An int32_t, in hundredths of a percent.
+ *
+ ******************************************************************************/
+static void si7021_decode_rh(const uint8_t *data, uint8_t length, void *result){
+	(void)length; // the code is the first two bytes, a checksum may follow
+	*(int32_t*)result = si7021_rh_centi((data[0] << 8) | data[1]);
 }
 
 /***************************************************************************//**
@@ -320,23 +818,44 @@ void si7021_read_SNB(uint32_t event){
  *	A function which returns the most recently read temperature measurement.
  *
  * @details
- *	This function reads the raw temperature data received from the SI7021
- *	Temperature and Humidity sensor, converts it into Celsius per the
- *	data sheet specifications, and then converts it into Fahrenheit to return.
+ *	This function decodes the raw temperature data received from the SI7021
+ *	Temperature and Humidity sensor into hundredths of a degree Fahrenheit,
+ *	with integer math only.
+ *
+ * @note
+ *	This should only be called upon the completion of si7021_read_temp,
+ *	si7021_read_rh_temp or si7021_sample. Calling it at any other time will
+ *	give an invalid result
+ *
+ * @return
+ * 	the last received temperature in hundredths of a degree Fahrenheit,
+ * 	so 7250 is 72.5 F.
+ *
+ ******************************************************************************/
+int32_t si7021_convert_temp_f(void){
+	int32_t temp;
+	i2c_device_decode(&si7021, SI7021_CMD_TEMP, &temp);
+	return temp;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	A function which reports whether the most recent command succeeded.
+ *
+ * @details
+ *	A read that failed, because the SI7021 did not answer or the bus faulted,
+ *	still posts its event. The read buffer then holds no valid data.
  *
  * @note
- *	This should only be called upon the completion of either si7021_read_temp
- *	or si7021_read_rh_temp functions. Calling it at any other time will give
- *	an invalid result
+ *	Call this from the event handler of the read, before converting the data.
+ *	A sample is checked with si7021_sample_ok() instead.
  *
  * @return
- * 	the last received temperature, as a float, in degrees Fahrenheit.
+ * 	true if the last completed command succeeded.
  *
  ******************************************************************************/
-float si7021_convert_temp_f(void){
-	uint16_t temp_code = (read_arr[0] << 8) | read_arr[1];
-	float temp_c = ((float)175.72*(float)temp_code / (float)65536) - (float)46.85;
-	return (temp_c * (float)1.8 + (float)32);
+bool si7021_read_ok(void){
+	return si7021.status == I2C_STATUS_OK;
 }
 
 /***************************************************************************//**
@@ -344,25 +863,27 @@ float si7021_convert_temp_f(void){
  *	A function which returns the most recently read relative humidity measurement.
  *
  * @details
- *	This function interprets the data received from the SI7021 as raw humidity
- *	data and converts it to Relative Humidity as a percent.
+ *	This function decodes the data received from the SI7021 as raw humidity
+ *	data into hundredths of a percent Relative Humidity, with integer math
+ *	only.
  *
  * @note
- *	This should only be called upon the completion of the si7021_read_rh function.
- *  Calling it at any other time will give an invalid result
+ *	This should only be called upon the completion of the si7021_read_rh or
+ *	si7021_sample functions. Calling it at any other time will give an
+ *	invalid result
  *
  * @return
- * 	the last received relative humidity value as a percentage.
+ * 	the last received relative humidity in hundredths of a percent, so 4520
+ * 	is 45.2 %.
  *
  ******************************************************************************/
-float si7021_convert_rh(void){
-	uint16_t rh_code = (read_arr[0] << 8) | read_arr[1];
-	float rh = ((float)125.0*(float)rh_code / (float)65536) - (float)6.0;
+int32_t si7021_convert_rh(void){
+	int32_t rh;
+	i2c_device_decode(&si7021, SI7021_CMD_RH, &rh);
 	return rh;
 }
 
 
-
 /***************************************************************************//**
  * @brief
  *   SI7021 Read/Write test. This is a Test Driven Development routine to verify
@@ -395,44 +916,30 @@ void si7021_test(void){
 	timer_delay(SI7021_TEST_DELAY); // wait for SI7021 to initialize
 	// Test 1: Read from User Register 1.
 	// This is a single byte read to test simplest read functionality
-	clear_i2c_arrays();
-	read_arr[0] = 0xff; // this is just for debugging purposes
-	command_code[0]= SI7021_READ_UR1;
-	si7021_read(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_USER_REG, NO_EVENT);
-	//si7021_read_ur1(NO_EVENT); // this also works :)
+	si7021_read_ur1(NO_EVENT);
 
-	while(!i2c_idle());// stall until i2c is done
+	while(!i2c_idle(SI7021_I2C));// stall until i2c is done
 	uint8_t expected_value = 0b00111010;	// compare with expected value (default)
-	EFM_ASSERT(read_arr[0] == expected_value); // will fail if not default value
-	//EFM_ASSERT(read_arr[0] == expected_value || read_arr[0] == 0b10111010); // for testing
+	EFM_ASSERT(si7021_ur1() == expected_value); // will fail if not default value
+	//EFM_ASSERT(si7021_ur1() == expected_value || si7021_ur1() == 0b10111010); // for testing
 
 	// Test 2: Write to User Register 1 to change from 12b to 13b temp measurement
 	// this is a single byte write to test simplest write functionality
-	clear_i2c_arrays();
-	command_code[0]= SI7021_WRITE_UR1;
-	write_arr[0] = 0b10111010;
-	si7021_write(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_USER_REG, NO_EVENT);
-	//si7021_write_ur1(write_data, NO_EVENT);
+	si7021_write_ur1(0b10111010, NO_EVENT); // command code and data are two segments
 
-	while(!i2c_idle());// stall until i2c is done
+	while(!i2c_idle(SI7021_I2C));// stall until i2c is done
 	timer_delay(SI7021_TEST_DELAY); // 80 ms delay to assure write completes before attempting to read
 	// Read User Register 1 to confirm successful write.
-	read_arr[0] = 0xff;
 	si7021_read_ur1(NO_EVENT);
-	while(!i2c_idle());// stall until i2c is done
-	EFM_ASSERT(read_arr[0] == 0b10111010); // will fail if not modified value
+	while(!i2c_idle(SI7021_I2C));// stall until i2c is done
+	EFM_ASSERT(si7021_ur1() == 0b10111010); // will fail if not modified value
 
 	// Test 3: Read temp and validate within room temperature range
 	// This will test a multi-byte read
-	clear_i2c_arrays();
-	read_arr[0] = 0xff;
-	read_arr[1] = 0xff;
-	command_code[0]= SI7021_TEMP_NO_HOLD;
-	si7021_read(I2C_ONE_BYTE_CC, SI7021_NUM_BYTES_TEMP_NOCHECKSUM, NO_EVENT);
-	//si7021_read_temp(NO_EVENT);
-	while(!i2c_idle()); // stall until i2c is done
-	float temp = si7021_convert_temp_f();	// get data and compare
-	EFM_ASSERT(temp > 60 && temp < 90); // will fail if the temperature isn't in a reasonable range
+	si7021_read_temp(NO_EVENT);
+	while(!i2c_idle(SI7021_I2C)); // stall until i2c is done
+	int32_t temp = si7021_convert_temp_f();	// get data and compare
+	EFM_ASSERT(temp > 6000 && temp < 9000); // will fail if the temperature isn't in a reasonable range
 
 	// Test 4: Read Electronic Serial Number
 	// This will test a multi-byte command code (2 byte command code) as well as
@@ -442,18 +949,148 @@ void si7021_test(void){
 	// honestly i don't think this really tests a multibyte read since we can only
 	// really validate the first returned byte and not the subsequent ones.
 	// but it's cool to see all 6 bytes end up in the read array from the debugger!
-	clear_i2c_arrays();
-	command_code[0] = SI7021_SNB_MSB;
-	command_code[1] = SI7021_SNB_LSB;
-	int i;
-	for(i=0; i< SI7021_NUM_BYTES_SNB; i++){
-		read_arr[i] = 0xaa;
-	}
-	si7021_read(I2C_TWO_BYTE_CC, SI7021_NUM_BYTES_SNB, NO_EVENT);
-	//si7021_read_SNB(NO_EVENT);
+	si7021_read_SNB(NO_EVENT);
 
-	while(!i2c_idle());
+	while(!i2c_idle(SI7021_I2C));
 		//compare to expected value
-	EFM_ASSERT(read_arr[0] == 0x15);
+	EFM_ASSERT(si7021_snb()[0] == 0x15);
+
+}
+
+/***************************************************************************//**
+ * @brief
+ *   SI7021 I2C benchmark. Compares the interrupts and CPU time of a transaction
+ *   with one interrupt per byte and with the LDMA.
+ *
+ * @details
+ *   Runs the 6 byte Serial Number B read and the 2 byte no hold RH read once in
+ *   each mode, and keeps the number of I2C interrupts and the cycles spent in
+ *   the I2C interrupt handler for each. The interrupts counted are the whole
+ *   transaction: address, data, restart and stop.
+ *
+ *   The RH read also takes one NACK interrupt each time the sensor is polled
+ *   while it is still converting, which the LDMA does not change. Those are
+ *   left out of the interrupt counts and reported in nack_polls for the LDMA
+ *   run, but their cycles are still included.
+ *
+ *   Then the RH read is repeated with each retry policy, and the read address
+ *   attempts and interrupts of each are kept. Every poll but the last was
+ *   NACKed by the converting sensor.
+ *
+ *   Last the SNB read is run in standard and fast mode, and the core cycles
+ *   it held the bus are kept for each.
+ *
+ *   The results are kept in the private bench_results, retry_bench_results
+ *   and speed_bench_results arrays so they can be read from the debugger.
+ *
+ * @note
+ *   Requires cycle_count_open() to have been called. Blocks until each read
+ *   completes, so run it at boot like si7021_test(). LETIMER0 is started so
+ *   the backoff timers run. The LDMA mode and retry policy are left as
+ *   configured by SI7021_I2C_LDMA and SI7021_RETRY_POLICY.
+ *
+ ******************************************************************************/
+void si7021_bench(void){
+	static const uint8_t read_length[SI7021_BENCH_CASES] = {SI7021_NUM_BYTES_SNB, SI7021_NUM_BYTES_RH_NOCHECKSUM};
+	I2C_CPU_STATS_STRUCT stats;
+
+	timer_delay(SI7021_TEST_DELAY); // wait for SI7021 to initialize
+	letimer_start(LETIMER0, true); // the backoff timers run on LETIMER0
+	for(int ldma = 0; ldma < 2; ldma++){
+		i2c_ldma_enable(SI7021_I2C, ldma);
+		for(int n = 0; n < SI7021_BENCH_CASES; n++){
+			i2c_cpu_stats_reset(SI7021_I2C);
+			if(read_length[n] == SI7021_NUM_BYTES_SNB){
+				si7021_read_SNB(NO_EVENT);
+			} else {
+				si7021_read_rh(NO_EVENT);
+			}
+			while(!i2c_idle(SI7021_I2C));
+			i2c_cpu_stats(SI7021_I2C, &stats);
+
+			bench_results[n].read_length = read_length[n];
+			if(ldma){
+				bench_results[n].ldma_irqs = stats.irqs - stats.nack_polls;
+				bench_results[n].ldma_cycles = stats.isr_cycles;
+				bench_results[n].nack_polls = stats.nack_polls;
+			} else {
+				bench_results[n].irq_irqs = stats.irqs - stats.nack_polls;
+				bench_results[n].irq_cycles = stats.isr_cycles;
+			}
+		}
+	}
+	i2c_ldma_enable(SI7021_I2C, SI7021_I2C_LDMA);
+
+	for(int policy = 0; policy < I2C_RETRY_POLICIES; policy++){
+		si7021_retry_policy_set(policy);
+		i2c_cpu_stats_reset(SI7021_I2C);
+		si7021_read_rh(NO_EVENT);
+		while(!i2c_idle(SI7021_I2C));
+		i2c_cpu_stats(SI7021_I2C, &stats);
+		retry_bench_results[policy].polls = stats.last_polls;
+		retry_bench_results[policy].irqs = stats.irqs;
+	}
+	si7021_retry_policy_set(SI7021_RETRY_POLICY);
+
+	static const I2C_SPEED_STRUCT *speeds[SI7021_SPEED_BENCH_CASES] = {&standard_speed, &fast_speed};
+	for(int n = 0; n < SI7021_SPEED_BENCH_CASES; n++){
+		I2C_QUEUE_STATS_STRUCT queue_stats;
+		si7021.speed = speeds[n];
+		si7021_read_SNB(NO_EVENT);
+		while(!i2c_idle(SI7021_I2C));
+		i2c_queue_stats(SI7021_I2C, &queue_stats);
+		speed_bench_results[n].freq = si7021.speed->freq;
+		speed_bench_results[n].bus_cycles = queue_stats.last_bus_cycles;
+	}
+	si7021.speed = &fast_speed;
+
+	// the 6 byte read must take fewer interrupts with the LDMA
+	EFM_ASSERT(bench_results[0].ldma_irqs < bench_results[0].irq_irqs);
+	// waiting out the conversion must poll less than polling back to back
+	EFM_ASSERT(retry_bench_results[I2C_RETRY_CONVERSION].polls < retry_bench_results[I2C_RETRY_IMMEDIATE].polls);
+	// the same read must hold the bus for less time in fast mode
+	EFM_ASSERT(speed_bench_results[1].bus_cycles < speed_bench_results[0].bus_cycles);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   SI7021 CRC benchmark. Measures the cost of checking a sample.
+ *
+ * @details
+ *   Runs the CRC of SI7021_CRC_BENCH_WORDS two byte measurements followed by
+ *   their checksum, once with the nibble table of si7021_crc8() and once bit
+ *   by bit, and keeps the mean core cycles per sample of each in the private
+ *   crc_bench_results so they can be read from the debugger. A sample is one
+ *   checked measurement, the temperature of an RH measurement has none.
+ *
+ * @note
+ *   Requires cycle_count_open() to have been called. Does not use the bus.
+ *
+ ******************************************************************************/
+void si7021_crc_bench(void){
+	uint8_t words[SI7021_CRC_BENCH_WORDS][SI7021_NUM_BYTES_RH_CHECKSUM];
+	uint32_t table_total = 0, bitwise_total = 0;
+	uint32_t failed = 0;
+
+	for(int n = 0; n < SI7021_CRC_BENCH_WORDS; n++){
+		uint16_t code = n * (65536 / SI7021_CRC_BENCH_WORDS) + n;
+		words[n][0] = code >> 8;
+		words[n][1] = code & 0xFF;
+		words[n][2] = si7021_crc8_bitwise(words[n], 2);
+	}
+	for(int n = 0; n < SI7021_CRC_BENCH_WORDS; n++){
+		uint32_t start = CYCLE_COUNT_GET();
+		failed += !si7021_crc_check(words[n], SI7021_NUM_BYTES_RH_CHECKSUM);
+		table_total += CYCLE_COUNT_GET() - start;
+
+		start = CYCLE_COUNT_GET();
+		failed += si7021_crc8_bitwise(words[n], SI7021_NUM_BYTES_RH_CHECKSUM) != 0;
+		bitwise_total += CYCLE_COUNT_GET() - start;
+	}
+	crc_bench_results.table_cycles = table_total / SI7021_CRC_BENCH_WORDS;
+	crc_bench_results.bitwise_cycles = bitwise_total / SI7021_CRC_BENCH_WORDS;
 
+	// both must agree with the checksums, and the check must stay cheap
+	EFM_ASSERT(failed == 0);
+	EFM_ASSERT(crc_bench_results.table_cycles < SI7021_CRC_BUDGET_CYCLES);
 }
@@ -15,16 +15,43 @@
 #include "scheduler.h"
 #include "SI7021.h"
 #include "ble.h"
+#include "cycle_count.h"
+#include "format.h"
+#include "history.h"
+#ifdef FORMAT_BENCH_ENABLED
 #include <stdio.h>
+#endif
 
 //***********************************************************************************
 // defined files
 //***********************************************************************************
+#define		APP_TEMP_LED_CENTI_F	8000	// LED 1 on at 80.0 F and above
 
 //***********************************************************************************
 // global variables
 //***********************************************************************************
-char buffer[50];
+static char buffer[50];
+static char sleep_report[64];
+static uint32_t report_periods;
+#ifdef I2C_TRACE_ENABLED
+static bool trace_dumping;		// I2C trace being sent, one entry per TX done
+#endif
+#ifdef FORMAT_BENCH_ENABLED
+static FORMAT_BENCH_STRUCT format_bench_results;
+#endif
+static APP_CHANNEL_STRUCT channels[APP_CHANNELS] = {
+	[APP_CHANNEL_RH] = { .deadband = APP_RH_DEADBAND_CENTI, .max_silence_ms = APP_MAX_SILENCE_MS },
+	[APP_CHANNEL_TEMP] = { .deadband = APP_TEMP_DEADBAND_CENTI_F, .max_silence_ms = APP_MAX_SILENCE_MS },
+};
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void app_report_rh(int32_t rh);
+static void app_report_temp(int32_t temp);
+static void app_history_report(void);
+static bool app_channel_send(APP_CHANNEL channel, int32_t value);
+static void app_channel_report(void);
 
 //***********************************************************************************
 // function
@@ -37,18 +64,36 @@ char buffer[50];
  * @details
  *	This application uses the CMU to enable the LE clock tree,
  *	and initializes the GPIO and LETIMER needed to produce a
- *	PWM signal.
+ *	PWM signal. It also registers the handler of every scheduled
+ *	event with the scheduler.
  *
  * @note
  *	This should be called only once at the beginning of main.
  *
  ******************************************************************************/
 void app_peripheral_setup(void){
+	cycle_count_open();
 	cmu_open();
 	gpio_open();
 	app_letimer_pwm_open(PWM_PER, PWM_ACT_PER);
 	scheduler_open();
+	// The TX done path restarts the LETIMER and drains the BLE buffer, so it
+	// runs first and may cut short slower sensor and boot work.
+	scheduler_register(BLE_TX_DONE_EVT, scheduled_tx_done_evt, SCHEDULER_PRIORITY_HIGH, true);
+	scheduler_register(BLE_RX_DONE_EVT, scheduled_rx_done_evt, SCHEDULER_PRIORITY_HIGH, false);
+	// The LETIMER underflow and the I2C completions are posted with a payload
+	// to the message queue, which is drained before the bitmask events.
+	scheduler_register_msg(LETIMER0_UF_EVT, scheduled_letimer0_uf_evt);
+	scheduler_register_msg(SI7021_SAMPLE_DONE_EVT, scheduled_si7021_sample_done_evt);
+	scheduler_register_msg(SI7021_READ_TEMP_DONE_EVT, scheduled_si7021_read_temp_done_evt);
+	scheduler_register(LETIMER0_COMP0_EVT, scheduled_letimer0_comp0_evt, SCHEDULER_PRIORITY_LOW, false);
+	scheduler_register(LETIMER0_COMP1_EVT, scheduled_letimer0_comp1_evt, SCHEDULER_PRIORITY_LOW, false);
+	scheduler_register(BOOT_UP_EVT, scheduled_boot_up_evt, SCHEDULER_PRIORITY_LOW, false);
 	sleep_open();
+	sleep_deadline_register(letimer_timer_next_us);
+	sleep_watchdog_register(app_sleep_leak);
+	sleep_watchdog_bound(EM2, SLEEP_I2C_BOUND_MS); // the I2C is the only EM2 block
+	sleep_watchdog_bound(EM3, SLEEP_LEUART_BOUND_MS); // the LEUART is the only EM3 block
 	si7021_i2c_open();
 	ble_open(BLE_TX_DONE_EVT, BLE_RX_DONE_EVT);
 	add_scheduled_event(BOOT_UP_EVT);
@@ -105,14 +150,127 @@ void app_letimer_pwm_open(float period, float act_period){
  *	Handles the letimer0 underflow event
  *
  * @details
- *	This function clears the scheduled event and then handles the underflow event.
+ *	This function handles the underflow message, one per LETIMER period.
+ *	Every SLEEP_REPORT_PERIODS underflows it also sends the sleep residency
+ *	report and starts a new residency interval. The report is queued before the
+ *	sensor read so it is already sending when the readings are written. Halfway
+ *	between those reports it sends the history report instead, and a quarter
+ *	of the way the sent and suppressed readings. It also runs the sleep block
+ *	watchdog.
+ *
+ * @param[in] msg
+ *	The underflow message, its payload is the time base of the new period.
+ *
+ ******************************************************************************/
+void scheduled_letimer0_uf_evt(SCHEDULER_MSG_STRUCT *msg){
+	EFM_ASSERT(msg->event == LETIMER0_UF_EVT);
+	if(++report_periods >= SLEEP_REPORT_PERIODS){
+		report_periods = 0;
+		sleep_residency_report(sleep_report, sizeof(sleep_report));
+		sleep_residency_reset();
+		ble_write(sleep_report);
+	} else if(report_periods == HISTORY_REPORT_PERIOD){
+		app_history_report();
+	} else if(report_periods == CHANNEL_REPORT_PERIOD){
+		app_channel_report();
+	}
+	sleep_watchdog_check();
+	si7021_sample(SI7021_SAMPLE_DONE_EVT);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Reports a leaked sleep block
+ *
+ * @details
+ *	Called by sleep_watchdog_check() for each sleep block held longer than
+ *	its bound, and sends the owner, energy mode and time held over BLE.
+ *
+ * @param[in] owner
+ *	The module holding the block.
+ *
+ * @param[in] EM
+ *	The energy mode blocked.
+ *
+ * @param[in] held_ms
+ *	How long the block has been held in milliseconds.
+ *
+ ******************************************************************************/
+void app_sleep_leak(SLEEP_OWNER owner, uint32_t EM, uint32_t held_ms){
+	char *end = buffer + sizeof(buffer);
+	char *p = format_str(buffer, end, "Leak o");
+	p = format_uint(p, end, owner);
+	p = format_str(p, end, " EM");
+	p = format_uint(p, end, EM);
+	p = format_str(p, end, " ");
+	p = format_uint(p, end, held_ms);
+	format_str(p, end, "ms\n");
+	ble_write(buffer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts sending the I2C trace over BLE
+ *
+ * @details
+ *	Freezes the trace so the entries leading up to a failed transfer are kept,
+ *	and sends a "TRACE <entries>" header. The entries follow one per TX done
+ *	so they never fill the BLE buffer, each as
+ *	"T <bus> <event> <state> <byte hex> <cycles>", then "TRACE END".
+ *	GK_Course_Project/tools/i2c_trace_decode.py turns the log back into a
+ *	ladder diagram.
  *
+ * @note
+ *	Does nothing unless I2C_TRACE_ENABLED is defined in i2c.h, or while a
+ *	dump is already being sent.
  *
  ******************************************************************************/
-void scheduled_letimer0_uf_evt(void){
-	EFM_ASSERT(get_scheduled_events() & LETIMER0_UF_EVT);
-	remove_scheduled_event(LETIMER0_UF_EVT);
-	si7021_read_rh(SI7021_READ_RH_DONE_EVT);
+void app_i2c_trace_dump(void){
+#ifdef I2C_TRACE_ENABLED
+	if(trace_dumping) return;
+	i2c_trace_freeze(true);
+	trace_dumping = true;
+	char *end = buffer + sizeof(buffer);
+	char *p = format_str(buffer, end, "TRACE ");
+	p = format_uint(p, end, i2c_trace_count());
+	format_str(p, end, "\n");
+	ble_write(buffer);
+#endif
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sends the next entry of an I2C trace dump
+ *
+ * @details
+ *	Called on each TX done. Once the trace is empty it sends the end marker
+ *	and lets the trace record again.
+ *
+ ******************************************************************************/
+void app_i2c_trace_next(void){
+#ifdef I2C_TRACE_ENABLED
+	I2C_TRACE_ENTRY_STRUCT entry;
+	if(!trace_dumping) return;
+	if(i2c_trace_pop(&entry)){
+		char *end = buffer + sizeof(buffer);
+		char *p = format_str(buffer, end, "T ");
+		p = format_uint(p, end, entry.bus);
+		p = format_str(p, end, " ");
+		p = format_uint(p, end, entry.event);
+		p = format_str(p, end, " ");
+		p = format_uint(p, end, entry.state);
+		p = format_str(p, end, " ");
+		p = format_hex(p, end, entry.byte, 2);
+		p = format_str(p, end, " ");
+		p = format_uint(p, end, entry.cycles);
+		format_str(p, end, "\n");
+	} else {
+		format_str(buffer, buffer + sizeof(buffer), "TRACE END\n");
+		i2c_trace_freeze(false);
+		trace_dumping = false;
+	}
+	ble_write(buffer);
+#endif
 }
 
 /***************************************************************************//**
@@ -148,75 +306,251 @@ void scheduled_letimer0_comp1_evt(void){
 
 /***************************************************************************//**
  * @brief
- *	Handles the SI7021 Relative Humidity Read Complete event
+ *	Sends a relative humidity reading over BLE
  *
  * @details
- *	This function clears the scheduled event and then handles the
- *	Relative Humidity Read Complete event.
+ *	Formats "Humidity = 45.2 % " with integer math only. The reading is only
+ *	sent if it passes the dead-band or heartbeat of the RH channel.
  *
+ * @param[in] rh
+ *	Relative humidity in hundredths of a percent.
  *
  ******************************************************************************/
-void scheduled_si7021_read_rh_done_evt(void){
-	EFM_ASSERT(get_scheduled_events() & SI7021_READ_RH_DONE_EVT);
-	remove_scheduled_event(SI7021_READ_RH_DONE_EVT);
-
-	float rh = si7021_convert_rh();
-	sprintf(buffer, "Humidity = %d.%d %% \n", (int)rh, (int)(rh*10)%10);
+static void app_report_rh(int32_t rh){
+	if(!app_channel_send(APP_CHANNEL_RH, rh)){
+		return;
+	}
+	char *end = buffer + sizeof(buffer);
+	char *p = format_str(buffer, end, "Humidity = ");
+	p = format_centi(p, end, rh);
+	format_str(p, end, " % \n");
 	ble_write(buffer);
-	si7021_read_rh_temp(SI7021_READ_RH_TEMP_DONE_EVT);
 }
 
 /***************************************************************************//**
  * @brief
- *	Handles the SI7021 Read Temperature from RH Complete event
+ *	Sends a temperature reading over BLE
  *
  * @details
- *	This function clears the scheduled event and then handles the
- *	Read Temperature from RH Complete event.
+ *	Turns LED 1 on at APP_TEMP_LED_CENTI_F and above, and formats
+ *	"Temp = 72.5 F" with integer math only. The LED follows every reading,
+ *	but the reading is only sent if it passes the dead-band or heartbeat of
+ *	the temperature channel.
  *
+ * @param[in] temp
+ *	Temperature in hundredths of a degree Fahrenheit.
  *
  ******************************************************************************/
-void scheduled_si7021_read_rh_temp_done_evt(void){
-	EFM_ASSERT(get_scheduled_events() & SI7021_READ_RH_TEMP_DONE_EVT);
-	remove_scheduled_event(SI7021_READ_RH_TEMP_DONE_EVT);
-
-	float temp = si7021_convert_temp_f();
-	if(temp >= 80.0) {
+static void app_report_temp(int32_t temp){
+	if(temp >= APP_TEMP_LED_CENTI_F) {
 		// turn on GPIO pin LED 1
 		GPIO_PinOutSet(LED1_port, LED1_pin);
 	} else {
 		// turn off LED 1
 		GPIO_PinOutClear(LED1_port, LED1_pin);
 	}
-	sprintf(buffer, "Temp = %d.%d F\n", (int)temp, (int)(temp*10)%10);
+	if(!app_channel_send(APP_CHANNEL_TEMP, temp)){
+		return;
+	}
+	char *end = buffer + sizeof(buffer);
+	char *p = format_str(buffer, end, "Temp = ");
+	p = format_centi(p, end, temp);
+	format_str(p, end, " F\n");
 	ble_write(buffer);
 }
 
 /***************************************************************************//**
  * @brief
- *	Handles the SI7021 Temperature Read Complete event
+ *	Decides whether a reading of a channel is sent
  *
  * @details
- *	This function clears the scheduled event and then handles the
- *	Temperature Read Complete event.
+ *	Report by exception: a reading is sent when it is the first of the
+ *	channel, when it differs from the last value sent by at least the dead-band,
+ *	or as a heartbeat when nothing has been sent for max_silence_ms. Anything
+ *	else is suppressed, which saves the LEUART time, and its EM3 block, of the
+ *	message. Comparing with the last value sent, not the last reading, keeps a
+ *	slow drift from going unreported.
+ *
+ * @note
+ *	A dead-band of 0, or a max_silence_ms of 0, sends every reading.
  *
+ * @param[in] channel
+ *	The channel of the reading.
+ *
+ * @param[in] value
+ *	The reading, in the units of the dead-band.
+ *
+ * @return
+ *	true if the reading is to be sent.
  *
  ******************************************************************************/
-void scheduled_si7021_read_temp_done_evt(void){
-	EFM_ASSERT(get_scheduled_events() & SI7021_READ_TEMP_DONE_EVT);
-	remove_scheduled_event(SI7021_READ_TEMP_DONE_EVT);
-	float temp = si7021_convert_temp_f();
-	if(temp >= 80.0) {
-		// turn on GPIO pin LED 1
-		GPIO_PinOutSet(LED1_port, LED1_pin);
-	} else {
-		// turn off LED 1
-		GPIO_PinOutClear(LED1_port, LED1_pin);
+static bool app_channel_send(APP_CHANNEL channel, int32_t value){
+	EFM_ASSERT(channel < APP_CHANNELS);
+	APP_CHANNEL_STRUCT *ch = &channels[channel];
+	uint32_t now = letimer_timer_now();
+	int32_t change = value - ch->last_value;
+	if(change < 0){
+		change = -change;
 	}
-	sprintf(buffer, "Temp = %d.%d F\n", (int)temp, (int)(temp*10)%10);
+	if(ch->sent_once && change < ch->deadband && now - ch->last_ms < ch->max_silence_ms){
+		ch->suppressed++;
+		return false;
+	}
+	ch->sent_once = true;
+	ch->last_value = value;
+	ch->last_ms = now;
+	ch->sent++;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sets the report by exception policy of a channel
+ *
+ * @details
+ *	The next reading is compared with the new dead-band. The sent and
+ *	suppressed counts are kept.
+ *
+ * @param[in] channel
+ *	The channel.
+ *
+ * @param[in] deadband
+ *	Smallest change from the last value sent that is sent, in the units of the
+ *	channel. 0 sends every reading.
+ *
+ * @param[in] max_silence_ms
+ *	Longest time between sent values. 0 sends every reading.
+ *
+ ******************************************************************************/
+void app_channel_policy(APP_CHANNEL channel, int32_t deadband, uint32_t max_silence_ms){
+	EFM_ASSERT(channel < APP_CHANNELS);
+	EFM_ASSERT(deadband >= 0);
+	channels[channel].deadband = deadband;
+	channels[channel].max_silence_ms = max_silence_ms;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the policy and counts of a channel
+ *
+ * @param[in] channel
+ *	The channel.
+ *
+ * @return
+ *	The channel, with its sent and suppressed reading counts.
+ *
+ ******************************************************************************/
+const APP_CHANNEL_STRUCT *app_channel(APP_CHANNEL channel){
+	EFM_ASSERT(channel < APP_CHANNELS);
+	return &channels[channel];
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sends the sent and suppressed reading counts over BLE
+ *
+ * @details
+ *	Sends "Sent RH <sent>/<readings> T <sent>/<readings>". Each suppressed
+ *	reading is a 14 to 19 byte message, 15 to 20 ms of LEUART time at
+ *	HM10_BAUDRATE that the core would spend in EM2 instead of EM3.
+ *
+ ******************************************************************************/
+static void app_channel_report(void){
+	const APP_CHANNEL_STRUCT *rh = &channels[APP_CHANNEL_RH];
+	const APP_CHANNEL_STRUCT *temp = &channels[APP_CHANNEL_TEMP];
+	char *end = buffer + sizeof(buffer);
+	char *p = format_str(buffer, end, "Sent RH ");
+	p = format_uint(p, end, rh->sent);
+	p = format_str(p, end, "/");
+	p = format_uint(p, end, rh->sent + rh->suppressed);
+	p = format_str(p, end, " T ");
+	p = format_uint(p, end, temp->sent);
+	p = format_str(p, end, "/");
+	p = format_uint(p, end, temp->sent + temp->suppressed);
+	format_str(p, end, "\n");
 	ble_write(buffer);
 }
 
+/***************************************************************************//**
+ * @brief
+ *	Sends how densely the sample history is stored over BLE
+ *
+ * @details
+ *	Sends "Hist <samples> smp <bytes per sample> B <hours> h", where hours is
+ *	how much history HISTORY_BYTES holds at the current density and sampling
+ *	rate.
+ *
+ ******************************************************************************/
+static void app_history_report(void){
+	HISTORY_USAGE_STRUCT usage;
+	history_usage(&usage);
+	char *end = buffer + sizeof(buffer);
+	char *p = format_str(buffer, end, "Hist ");
+	p = format_uint(p, end, usage.samples);
+	p = format_str(p, end, " smp ");
+	p = format_centi(p, end, usage.centi_bytes_per_sample);
+	p = format_str(p, end, " B ");
+	p = format_centi(p, end, usage.centi_hours);
+	format_str(p, end, " h\n");
+	ble_write(buffer);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles the SI7021 Sample Complete event
+ *
+ * @details
+ *	This function reports the Relative Humidity and the Temperature of the
+ *	sample, which were read back to back,
+ *	where they changed past their dead-band or are due a heartbeat.
+ *	A sample whose RH still failed its CRC after the reruns is dropped. Good
+ *	samples are kept in the history and set the resolution of the next ones.
+ *
+ * @param[in] msg
+ *	The sample done message, its payload is the I2C_STATUS of the sample.
+ *
+ ******************************************************************************/
+void scheduled_si7021_sample_done_evt(SCHEDULER_MSG_STRUCT *msg){
+	EFM_ASSERT(msg->event == SI7021_SAMPLE_DONE_EVT);
+
+	if(msg->payload != I2C_STATUS_OK){
+		if(msg->payload == I2C_STATUS_CHECKSUM){
+			ble_write("Sample checksum failed\n"); // the bus worked, no trace
+		} else {
+			ble_write("Sample read failed\n");
+			app_i2c_trace_dump();
+		}
+		return;
+	}
+	int32_t rh = si7021_convert_rh();
+	int32_t temp = si7021_convert_temp_f();
+	history_add(letimer_timer_now(), rh, temp);
+	app_report_rh(rh);
+	app_report_temp(temp);
+	si7021_resolution_adapt(rh, temp);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Handles the SI7021 Temperature Read Complete event
+ *
+ * @details
+ *	This function handles the Temperature Read Complete message.
+ *
+ * @param[in] msg
+ *	The read done message, its payload is the I2C_STATUS of the read.
+ *
+ ******************************************************************************/
+void scheduled_si7021_read_temp_done_evt(SCHEDULER_MSG_STRUCT *msg){
+	EFM_ASSERT(msg->event == SI7021_READ_TEMP_DONE_EVT);
+	if(msg->payload != I2C_STATUS_OK){
+		ble_write("Temp read failed\n");
+		app_i2c_trace_dump();
+		return;
+	}
+	app_report_temp(si7021_convert_temp_f());
+}
+
 /***************************************************************************//**
  * @brief
  *	Handles the BOOT UP event
@@ -242,6 +576,24 @@ void scheduled_boot_up_evt(void){
 #endif
 #ifdef SI7021_TEST_ENABLED
 	si7021_test();
+#endif
+#ifdef SCHEDULER_BENCH_ENABLED
+	scheduler_bench();
+#endif
+#ifdef LETIMER_TIMER_BENCH_ENABLED
+	letimer_timer_bench();
+#endif
+#ifdef SLEEP_BENCH_ENABLED
+	sleep_bench();
+#endif
+#ifdef SI7021_BENCH_ENABLED
+	si7021_bench();
+#endif
+#ifdef FORMAT_BENCH_ENABLED
+	app_format_bench();
+#endif
+#ifdef SI7021_CRC_BENCH_ENABLED
+	si7021_crc_bench();
 #endif
 	ble_write("\nHello World\n");
 	ble_write("Circular Buffer Lab\n");
@@ -257,7 +609,8 @@ void scheduled_boot_up_evt(void){
  * @details
  *	This function clears the scheduled event and then handles the
  *	TX Done event. It checks to see if there's more things to send in the
- *	circular buffer, and initiates that transmit if there is.
+ *	circular buffer, and initiates that transmit if there is. During an I2C
+ *	trace dump it also queues the next trace entry.
  *
  *	Then it restarts the timer.
  *
@@ -267,6 +620,7 @@ void scheduled_tx_done_evt(void){
 	EFM_ASSERT(get_scheduled_events() & BLE_TX_DONE_EVT);
 	remove_scheduled_event(BLE_TX_DONE_EVT);
 	ble_circ_pop(false); // if there's other stuff to send, pop it off. otherwise this will return true.
+	app_i2c_trace_next();
 
 	letimer_start(LETIMER0, true);
 
@@ -290,3 +644,70 @@ void scheduled_rx_done_evt(void){
 	// TODO: complete this function if needed
 
 }
+
+#ifdef FORMAT_BENCH_ENABLED
+/***************************************************************************//**
+ * @brief
+ *	Floating point reference for app_format_bench()
+ *
+ * @details
+ *	The conversions and formatting the SI7021 readings used before they were
+ *	done in fixed point.
+ *
+ ******************************************************************************/
+static void app_format_float(uint16_t rh_code, uint16_t temp_code, char *rh_str, char *temp_str){
+	float rh = ((float)125.0*(float)rh_code / (float)65536) - (float)6.0;
+	sprintf(rh_str, "Humidity = %d.%d %% \n", (int)rh, (int)(rh*10)%10);
+	float temp_c = ((float)175.72*(float)temp_code / (float)65536) - (float)46.85;
+	float temp = temp_c * (float)1.8 + (float)32;
+	sprintf(temp_str, "Temp = %d.%d F\n", (int)temp, (int)(temp*10)%10);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Benchmark of the SI7021 sample conversion and formatting
+ *
+ * @details
+ *	Converts FORMAT_BENCH_SAMPLES raw RH and temperature code pairs spread over
+ *	the sensor range and formats both BLE strings, once with floating point and
+ *	sprintf() and once with the fixed point conversions and format.c. The mean
+ *	core cycles per sample of each are kept in the private format_bench_results
+ *	so they can be read from the debugger.
+ *
+ * @note
+ *	Requires cycle_count_open() to have been called. Defining
+ *	FORMAT_BENCH_ENABLED links sprintf() and the float library back in for the
+ *	reference, so measure flash with it undefined. tools/format_bench_size.sh
+ *	builds both ways and prints the arm-none-eabi-size .text difference.
+ *
+ ******************************************************************************/
+void app_format_bench(void){
+	char rh_str[50], temp_str[50];
+	uint32_t float_total = 0, fixed_total = 0;
+
+	for(uint32_t n = 0; n < FORMAT_BENCH_SAMPLES; n++){
+		// RH codes for about 0 - 100 %, temperature codes for about 30 - 110 F
+		uint16_t rh_code = 3146 + n * (55574 / FORMAT_BENCH_SAMPLES);
+		uint16_t temp_code = 20400 + n * (16800 / FORMAT_BENCH_SAMPLES);
+
+		uint32_t start = CYCLE_COUNT_GET();
+		app_format_float(rh_code, temp_code, rh_str, temp_str);
+		float_total += CYCLE_COUNT_GET() - start;
+
+		start = CYCLE_COUNT_GET();
+		char *end = rh_str + sizeof(rh_str);
+		char *p = format_str(rh_str, end, "Humidity = ");
+		p = format_centi(p, end, si7021_rh_centi(rh_code));
+		format_str(p, end, " % \n");
+		end = temp_str + sizeof(temp_str);
+		p = format_str(temp_str, end, "Temp = ");
+		p = format_centi(p, end, si7021_temp_centi_f(temp_code));
+		format_str(p, end, " F\n");
+		fixed_total += CYCLE_COUNT_GET() - start;
+	}
+	format_bench_results.float_cycles = float_total / FORMAT_BENCH_SAMPLES;
+	format_bench_results.fixed_cycles = fixed_total / FORMAT_BENCH_SAMPLES;
+
+	EFM_ASSERT(format_bench_results.fixed_cycles < format_bench_results.float_cycles);
+}
+#endif
@@ -12,6 +12,7 @@
 // Include files
 //***********************************************************************************
 #include "ble.h"
+#include "scheduler.h"
 #include <string.h>
 
 //***********************************************************************************
@@ -462,11 +463,11 @@ void ble_circ_init(void){
  *
  ******************************************************************************/
 void ble_circ_push(char *string){
-	__disable_irq();
+	uint32_t primask = critical_enter();
 
 	uint8_t str_len= strlen(string);
 	if(str_len == 0) {
-		__enable_irq();
+		critical_exit(primask);
 		return;
 	}
 
@@ -488,7 +489,7 @@ void ble_circ_push(char *string){
 		ble_cbuf.size++; // increment byte counter
 	}
 
-	__enable_irq();
+	critical_exit(primask);
 }
 
 
@@ -508,15 +509,15 @@ void ble_circ_push(char *string){
  *
  ******************************************************************************/
 bool ble_circ_pop(bool test){
-	__disable_irq();
+	uint32_t primask = critical_enter();
 
 	if (!leuart_idle()) {
-		__enable_irq();
+		critical_exit(primask);
 		return false;
 	}
 
 	if(ble_cbuf.size == 0) {
-		__enable_irq();
+		critical_exit(primask);
 		return true;
 	}
 	EFM_ASSERT(ble_cbuf.size != 1); // if only 1 byte in buffer, malformed packet, halt
@@ -549,7 +550,7 @@ bool ble_circ_pop(bool test){
 		//ble_write(pop_str); // ble write calls leuart start
 	}
 
-	__enable_irq();
+	critical_exit(primask);
 	return false;
 }
 
@@ -0,0 +1,43 @@
+/**
+ * @file cycle_count.c
+ * @author Giselle Koo
+ * @date May 2, 2020
+ * @brief Contains the DWT cycle counter used for timing measurements
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_device.h"
+
+//** User/developer include files
+#include "cycle_count.h"
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Enable the DWT cycle counter
+ *
+ * @details
+ * 	 This routine enables the trace block and starts the free running 32 bit
+ * 	 CYCCNT register of the Cortex-M4 Data Watchpoint and Trace unit. Once it
+ * 	 is running, CYCLE_COUNT_GET() returns the number of core clock cycles
+ * 	 since it was started.
+ *
+ * @note
+ * 	 The counter only advances while the core is clocked, so it does not count
+ * 	 time spent in EM2 or EM3. It wraps every ~165 seconds at 26 MHz, so always
+ * 	 compare two readings with unsigned subtraction.
+ *
+ ******************************************************************************/
+void cycle_count_open(void){
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
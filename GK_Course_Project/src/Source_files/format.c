@@ -0,0 +1,208 @@
+/**
+ * @file format.c
+ * @author Giselle Koo
+ * @date May 20, 2020
+ * @brief Integer to text formatting for the BLE strings, without printf
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** User/developer include files
+#include "format.h"
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static char *format_char(char *dst, const char *end, char c);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Appends one character
+ *
+ * @details
+ *	Every format function appends through this one. The last byte before end
+ *	is kept for the terminator, so a full string is cut short instead of
+ *	overrun.
+ *
+ * @param[in] dst
+ *   Where the character goes.
+ *
+ * @param[in] end
+ *   One past the last byte of the string buffer.
+ *
+ * @param[in] c
+ *   The character.
+ *
+ * @return
+ *   Where the next character goes.
+ *
+ ******************************************************************************/
+static char *format_char(char *dst, const char *end, char c){
+	if(dst + 1 < end){
+		*dst++ = c;
+	}
+	if(dst < end){
+		*dst = 0;
+	}
+	return dst;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Appends a string
+ *
+ * @details
+ *	The format functions each append to dst, null terminate, and return the
+ *	new end of the string, so a message is built by chaining them:
+ *
+ *	p = format_str(buffer, end, "Temp = ");
+ *	p = format_centi(p, end, temp);
+ *	p = format_str(p, end, " F\n");
+ *
+ * @param[in] dst
+ *   Where the string goes.
+ *
+ * @param[in] end
+ *   One past the last byte of the string buffer.
+ *
+ * @param[in] src
+ *   The null terminated string to append.
+ *
+ * @return
+ *   The new end of the string.
+ *
+ ******************************************************************************/
+char *format_str(char *dst, const char *end, const char *src){
+	if(dst < end){
+		*dst = 0; // terminates an empty string too
+	}
+	while(*src){
+		dst = format_char(dst, end, *src++);
+	}
+	return dst;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Appends an unsigned decimal number
+ *
+ * @details
+ *	The digits are found least significant first with a divide by 10, which
+ *	the compiler turns into a multiply, then copied out in order.
+ *
+ * @param[in] dst
+ *   Where the number goes.
+ *
+ * @param[in] end
+ *   One past the last byte of the string buffer.
+ *
+ * @param[in] value
+ *   The number.
+ *
+ * @return
+ *   The new end of the string.
+ *
+ ******************************************************************************/
+char *format_uint(char *dst, const char *end, uint32_t value){
+	char digits[FORMAT_UINT_DIGITS];
+	int count = 0;
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while(value);
+	while(count){
+		dst = format_char(dst, end, digits[--count]);
+	}
+	return dst;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Appends a signed decimal number
+ *
+ * @param[in] dst
+ *   Where the number goes.
+ *
+ * @param[in] end
+ *   One past the last byte of the string buffer.
+ *
+ * @param[in] value
+ *   The number.
+ *
+ * @return
+ *   The new end of the string.
+ *
+ ******************************************************************************/
+char *format_int(char *dst, const char *end, int32_t value){
+	if(value < 0){
+		dst = format_char(dst, end, '-');
+		return format_uint(dst, end, -(uint32_t)value);
+	}
+	return format_uint(dst, end, value);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Appends a lower case hexadecimal number
+ *
+ * @param[in] dst
+ *   Where the number goes.
+ *
+ * @param[in] end
+ *   One past the last byte of the string buffer.
+ *
+ * @param[in] value
+ *   The number.
+ *
+ * @param[in] digits
+ *   Number of digits, with leading zeros. Higher digits are dropped.
+ *
+ * @return
+ *   The new end of the string.
+ *
+ ******************************************************************************/
+char *format_hex(char *dst, const char *end, uint32_t value, uint8_t digits){
+	while(digits){
+		digits--;
+		dst = format_char(dst, end, "0123456789abcdef"[(value >> (digits * 4)) & 0xF]);
+	}
+	return dst;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Appends a value in hundredths with one decimal
+ *
+ * @details
+ *	Rounds to the nearest tenth, so 2347 is "23.5", -5 is "-0.1" and -4 is
+ *	"0.0".
+ *
+ * @param[in] dst
+ *   Where the number goes.
+ *
+ * @param[in] end
+ *   One past the last byte of the string buffer.
+ *
+ * @param[in] centi
+ *   The value times 100.
+ *
+ * @return
+ *   The new end of the string.
+ *
+ ******************************************************************************/
+char *format_centi(char *dst, const char *end, int32_t centi){
+	uint32_t tenths = ((centi < 0 ? -(uint32_t)centi : (uint32_t)centi) + 5) / 10;
+	if(centi < 0 && tenths){
+		dst = format_char(dst, end, '-');
+	}
+	dst = format_uint(dst, end, tenths / 10);
+	dst = format_char(dst, end, '.');
+	return format_char(dst, end, '0' + tenths % 10);
+}
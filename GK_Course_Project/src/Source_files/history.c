@@ -0,0 +1,380 @@
+/**
+ * @file history.c
+ * @author Giselle Koo
+ * @date May 24, 2020
+ * @brief Fixed RAM history of the SI7021 samples, stored as packed deltas
+ *
+ */
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <string.h>
+
+//** User/developer include files
+#include "history.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+typedef struct {
+	uint8_t					block;			// block being decoded
+	uint16_t				offset;			// next record in the block
+	uint8_t					blocks_left;	// blocks after this one, up to the newest
+	HISTORY_SAMPLE_STRUCT	sample;			// last decoded sample
+} HISTORY_CURSOR_STRUCT;
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+// Each block starts with a full sample, the others are deltas from the sample
+// before, so dropping the oldest block never loses the base of a delta.
+static uint8_t blocks[HISTORY_BLOCKS][HISTORY_BLOCK_BYTES];
+static uint16_t block_used[HISTORY_BLOCKS];		// bytes of records in the block
+static uint16_t block_samples[HISTORY_BLOCKS];	// samples in the block
+static uint32_t block_start_ms[HISTORY_BLOCKS];	// time of the first sample of the block
+static uint8_t oldest;							// first block in use
+static uint8_t newest;							// block being filled
+static uint8_t blocks_used;						// 0 when the history is empty
+static HISTORY_SAMPLE_STRUCT last;				// newest sample as stored, base of the next delta
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static uint32_t history_zigzag(int32_t value);
+static int32_t history_unzigzag(uint32_t value);
+static uint8_t *history_varint_put(uint8_t *p, uint32_t value);
+static const uint8_t *history_varint_get(const uint8_t *p, uint32_t *value);
+static void history_block_start(void);
+static void history_cursor_start(HISTORY_CURSOR_STRUCT *cursor, uint8_t block);
+static bool history_next(HISTORY_CURSOR_STRUCT *cursor);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *   Maps a signed value to an unsigned one with small magnitudes first
+ *
+ * @details
+ *	0, -1, 1, -2, 2 ... become 0, 1, 2, 3, 4 ..., so a small negative delta
+ *	also takes a single varint byte.
+ *
+ ******************************************************************************/
+static uint32_t history_zigzag(int32_t value){
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Inverse of history_zigzag()
+ *
+ ******************************************************************************/
+static int32_t history_unzigzag(uint32_t value){
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Writes a varint
+ *
+ * @details
+ *	Seven bits per byte, least significant first, with the top bit set on
+ *	every byte but the last. Values under 128 take one byte, a full 32 bit
+ *	value takes five.
+ *
+ * @param[in] p
+ *   Where the varint goes.
+ *
+ * @param[in] value
+ *   The value.
+ *
+ * @return
+ *   The byte after the varint.
+ *
+ ******************************************************************************/
+static uint8_t *history_varint_put(uint8_t *p, uint32_t value){
+	while(value >= 0x80){
+		*p++ = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	*p++ = (uint8_t)value;
+	return p;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Reads a varint
+ *
+ * @param[in] p
+ *   The first byte of the varint.
+ *
+ * @param[out] value
+ *   The value.
+ *
+ * @return
+ *   The byte after the varint.
+ *
+ ******************************************************************************/
+static const uint8_t *history_varint_get(const uint8_t *p, uint32_t *value){
+	uint32_t result = 0;
+	uint32_t shift = 0;
+	uint8_t byte;
+	do {
+		byte = *p++;
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+	*value = result;
+	return p;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Empties the history
+ *
+ ******************************************************************************/
+void history_clear(void){
+	blocks_used = 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Moves to a new block, dropping the oldest one if the history is full
+ *
+ ******************************************************************************/
+static void history_block_start(void){
+	if(blocks_used == 0){
+		oldest = 0;
+		newest = 0;
+		blocks_used = 1;
+	} else {
+		newest = (newest + 1) % HISTORY_BLOCKS;
+		if(blocks_used == HISTORY_BLOCKS){
+			oldest = (oldest + 1) % HISTORY_BLOCKS;
+		} else {
+			blocks_used++;
+		}
+	}
+	block_used[newest] = 0;
+	block_samples[newest] = 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Adds a sample to the history
+ *
+ * @details
+ *	The sample is stored as three varints: the time since the sample before
+ *	in HISTORY_TICK_MS steps, then the zigzag encoded changes of RH and
+ *	temperature. Samples 3.1 s apart whose readings moved less than 0.64 %
+ *	and 0.64 F take 3 bytes. The first sample of a block is stored whole,
+ *	with the time in ms, so it can be decoded without the blocks before it.
+ *
+ *	The time stamps are rounded to HISTORY_TICK_MS, and the rounding does not
+ *	add up over the samples. Once every block is in use the oldest one is
+ *	dropped, HISTORY_BLOCK_BYTES at a time.
+ *
+ * @param[in] time_ms
+ *   letimer_timer_now() of the sample.
+ *
+ * @param[in] rh
+ *   Relative humidity in hundredths of a percent.
+ *
+ * @param[in] temp
+ *   Temperature in hundredths of a degree Fahrenheit.
+ *
+ ******************************************************************************/
+void history_add(uint32_t time_ms, int32_t rh, int32_t temp){
+	uint8_t record[HISTORY_RECORD_MAX];
+	uint8_t *p = record;
+	bool full = blocks_used == 0;
+
+	if(!full){
+		uint32_t ticks = (time_ms - last.time_ms + HISTORY_TICK_MS / 2) / HISTORY_TICK_MS;
+		p = history_varint_put(p, ticks);
+		p = history_varint_put(p, history_zigzag(rh - last.rh));
+		p = history_varint_put(p, history_zigzag(temp - last.temp));
+		full = block_used[newest] + (p - record) > HISTORY_BLOCK_BYTES;
+		last.time_ms += ticks * HISTORY_TICK_MS;
+	}
+	if(full){
+		history_block_start();
+		p = history_varint_put(record, time_ms);
+		p = history_varint_put(p, history_zigzag(rh));
+		p = history_varint_put(p, history_zigzag(temp));
+		last.time_ms = time_ms;
+		block_start_ms[newest] = time_ms;
+	}
+	memcpy(&blocks[newest][block_used[newest]], record, p - record);
+	block_used[newest] += p - record;
+	block_samples[newest]++;
+	last.rh = rh;
+	last.temp = temp;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Starts decoding at the first sample of a block
+ *
+ ******************************************************************************/
+static void history_cursor_start(HISTORY_CURSOR_STRUCT *cursor, uint8_t block){
+	cursor->block = block;
+	cursor->offset = 0;
+	cursor->blocks_left = (newest + HISTORY_BLOCKS - block) % HISTORY_BLOCKS;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Decodes the next sample
+ *
+ * @param[in] cursor
+ *   The cursor, the sample is left in cursor->sample.
+ *
+ * @return
+ *   false once the newest sample has been decoded.
+ *
+ ******************************************************************************/
+static bool history_next(HISTORY_CURSOR_STRUCT *cursor){
+	uint32_t time, rh, temp;
+	while(cursor->offset >= block_used[cursor->block]){
+		if(cursor->blocks_left == 0) return false;
+		cursor->block = (cursor->block + 1) % HISTORY_BLOCKS;
+		cursor->offset = 0;
+		cursor->blocks_left--;
+	}
+	const uint8_t *start = &blocks[cursor->block][cursor->offset];
+	const uint8_t *p = history_varint_get(start, &time);
+	p = history_varint_get(p, &rh);
+	p = history_varint_get(p, &temp);
+	if(cursor->offset == 0){
+		cursor->sample.time_ms = time;
+		cursor->sample.rh = history_unzigzag(rh);
+		cursor->sample.temp = history_unzigzag(temp);
+	} else {
+		cursor->sample.time_ms += time * HISTORY_TICK_MS;
+		cursor->sample.rh += history_unzigzag(rh);
+		cursor->sample.temp += history_unzigzag(temp);
+	}
+	cursor->offset += p - start;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the newest samples
+ *
+ * @details
+ *	Only the blocks holding the last n samples are decoded.
+ *
+ * @param[out] samples
+ *   Room for n samples, filled oldest first.
+ *
+ * @param[in] n
+ *   The number of samples wanted.
+ *
+ * @return
+ *   The number of samples returned, less than n if the history holds fewer.
+ *
+ ******************************************************************************/
+uint32_t history_last(HISTORY_SAMPLE_STRUCT *samples, uint32_t n){
+	HISTORY_CURSOR_STRUCT cursor;
+	uint32_t count = 0;
+	if(blocks_used == 0 || n == 0) return 0;
+
+	uint8_t block = newest;
+	uint32_t held = block_samples[block];
+	while(held < n && block != oldest){
+		block = (block + HISTORY_BLOCKS - 1) % HISTORY_BLOCKS;
+		held += block_samples[block];
+	}
+	uint32_t skip = held > n ? held - n : 0;
+	history_cursor_start(&cursor, block);
+	while(history_next(&cursor)){
+		if(skip){
+			skip--;
+		} else {
+			samples[count++] = cursor.sample;
+		}
+	}
+	return count;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Minimum, maximum and mean of the recent samples
+ *
+ * @details
+ *	Covers the samples at most window_ms older than the newest one. Only the
+ *	blocks that can hold them are decoded. The means are truncated to the
+ *	hundredth.
+ *
+ * @param[in] window_ms
+ *   Length of the window.
+ *
+ * @param[out] stats
+ *   The statistics of the window.
+ *
+ * @return
+ *   false if the history is empty.
+ *
+ ******************************************************************************/
+bool history_window_stats(uint32_t window_ms, HISTORY_STATS_STRUCT *stats){
+	HISTORY_CURSOR_STRUCT cursor;
+	int64_t rh_sum = 0, temp_sum = 0;
+	if(blocks_used == 0) return false;
+
+	uint8_t block = newest;
+	while(block != oldest && last.time_ms - block_start_ms[block] <= window_ms){
+		block = (block + HISTORY_BLOCKS - 1) % HISTORY_BLOCKS;
+	}
+	stats->samples = 0;
+	history_cursor_start(&cursor, block);
+	while(history_next(&cursor)){
+		HISTORY_SAMPLE_STRUCT *sample = &cursor.sample;
+		if(last.time_ms - sample->time_ms > window_ms) continue;
+		if(stats->samples == 0){
+			stats->rh_min = stats->rh_max = sample->rh;
+			stats->temp_min = stats->temp_max = sample->temp;
+		}
+		if(sample->rh < stats->rh_min) stats->rh_min = sample->rh;
+		if(sample->rh > stats->rh_max) stats->rh_max = sample->rh;
+		if(sample->temp < stats->temp_min) stats->temp_min = sample->temp;
+		if(sample->temp > stats->temp_max) stats->temp_max = sample->temp;
+		rh_sum += sample->rh;
+		temp_sum += sample->temp;
+		stats->samples++;
+	}
+	stats->rh_mean = rh_sum / stats->samples;
+	stats->temp_mean = temp_sum / stats->samples;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Reports how densely the history stores the samples
+ *
+ * @details
+ *	Gives the bytes per sample so far, and how many hours of samples
+ *	HISTORY_BYTES holds at that density and sampling rate.
+ *
+ * @param[out] usage
+ *   The sample count, bytes, time span and the figures derived from them.
+ *   The derived figures are 0 until there are two samples.
+ *
+ ******************************************************************************/
+void history_usage(HISTORY_USAGE_STRUCT *usage){
+	memset(usage, 0, sizeof(*usage));
+	if(blocks_used == 0) return;
+	for(uint8_t i = 0, block = oldest; i < blocks_used; i++, block = (block + 1) % HISTORY_BLOCKS){
+		usage->samples += block_samples[block];
+		usage->bytes += block_used[block];
+	}
+	usage->span_ms = last.time_ms - block_start_ms[oldest];
+	if(usage->samples < 2) return;
+	usage->centi_bytes_per_sample = usage->bytes * 100 / usage->samples;
+	usage->centi_hours = (uint64_t)HISTORY_BYTES * usage->span_ms * 100 / usage->bytes / 3600000;
+}
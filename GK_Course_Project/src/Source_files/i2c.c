@@ -9,34 +9,76 @@
 // Include files
 //***********************************************************************************
 
+//** Standard Libraries
+#include <string.h>
+
 //** Silicon Lab include files
 #include "em_i2c.h"
 #include "em_cmu.h"
 #include "em_assert.h"
+#include "em_gpio.h"
+#include "em_ldma.h"
 
 //** User/developer include files
 #include "i2c.h"
 #include "sleep_routines.h"
 #include "scheduler.h"
+#include "letimer.h"
+#include "cycle_count.h"
 
 //***********************************************************************************
 // defined files
 //***********************************************************************************
+#ifdef I2C_TRACE_ENABLED
+#define I2C_TRACE(bus, event)		i2c_trace_record(bus, event)
+#define I2C_TRACE_BYTE(bus, value)	((bus)->trace_byte = (value))
+#else
+#define I2C_TRACE(bus, event)
+#define I2C_TRACE_BYTE(bus, value)
+#endif
 
+// bit set and bit clear aliases of a peripheral register, so the LDMA can
+// change single bits of it without a read-modify-write
+#define I2C_REG_SET(reg)	((volatile uint32_t *)((uintptr_t)&(reg) - PER_MEM_BASE + PER_BITSET_MEM_BASE))
+#define I2C_REG_CLR(reg)	((volatile uint32_t *)((uintptr_t)&(reg) - PER_MEM_BASE + PER_BITCLR_MEM_BASE))
 
 //***********************************************************************************
 // private variables
 //***********************************************************************************
-static volatile I2C_PAYLOAD_STRUCT i2c_payload;
-static uint8_t write_arr[I2C_WRITE_LIMIT];
+static I2C_BUS_STRUCT buses[I2C_BUSES];	// one context per I2C peripheral
+static bool ldma_opened;
+#ifdef I2C_TRACE_ENABLED
+static I2C_TRACE_ENTRY_STRUCT trace[I2C_TRACE_DEPTH];	// shared by both buses, oldest overwritten
+static uint32_t trace_head;		// next entry written
+static uint32_t trace_count;	// entries held
+static bool trace_frozen;		// recording stopped while the trace is read out
+#endif
 
 //***********************************************************************************
 // private function prototypes
 //***********************************************************************************
-static void i2c_ack();
-static void i2c_nack();
-static void i2c_rxdatav();
-static void i2c_mstop();
+static I2C_BUS_STRUCT *i2c_bus(I2C_TypeDef *i2c);
+static void i2c_irq(I2C_BUS_STRUCT *bus);
+static void i2c_ack(I2C_BUS_STRUCT *bus);
+static void i2c_nack(I2C_BUS_STRUCT *bus);
+static void i2c_nack_stop(I2C_BUS_STRUCT *bus);
+static void i2c_rxdatav(I2C_BUS_STRUCT *bus);
+static void i2c_mstop(I2C_BUS_STRUCT *bus);
+static void i2c_txc(I2C_BUS_STRUCT *bus);
+static void i2c_write_done(I2C_BUS_STRUCT *bus);
+static void i2c_write_next(I2C_BUS_STRUCT *bus);
+static void i2c_ldma_write(I2C_BUS_STRUCT *bus);
+static void i2c_ldma_read(I2C_BUS_STRUCT *bus);
+static void i2c_backoff(I2C_BUS_STRUCT *bus, uint32_t ms);
+static void i2c_backoff_expire(void *arg);
+static void i2c_read_address(I2C_BUS_STRUCT *bus);
+static void i2c_begin(I2C_BUS_STRUCT *bus);
+static void i2c_complete(I2C_BUS_STRUCT *bus, I2C_STATUS status);
+static void i2c_fault(I2C_BUS_STRUCT *bus, I2C_STATUS status);
+static void i2c_backoff_arm(I2C_BUS_STRUCT *bus);
+#ifdef I2C_TRACE_ENABLED
+static void i2c_trace_record(I2C_BUS_STRUCT *bus, I2C_TRACE_EVENT event);
+#endif
 
 //***********************************************************************************
 // functions
@@ -51,6 +93,7 @@ static void i2c_mstop();
  *
  * @note
  *	This function enables the interrupt flags ACK, NACK, RXDATATV and MSTOP.
+ *	TXC is enabled only while the LDMA moves a write phase.
  *
  * @param[in] i2c
  * 	Pointer to the base peripheral address of the I2C peripheral being used. The
@@ -64,6 +107,7 @@ static void i2c_mstop();
  *
  ******************************************************************************/
 void i2c_open(I2C_TypeDef *i2c, I2C_OPEN_STRUCT *i2c_open, I2C_IO_STRUCT *i2c_io){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
 	I2C_Init_TypeDef init;
 
 	/*  Enable the routed clock to the I2C peripheral */
@@ -102,11 +146,15 @@ void i2c_open(I2C_TypeDef *i2c, I2C_OPEN_STRUCT *i2c_open, I2C_IO_STRUCT *i2c_io
 	i2c->ROUTEPEN = ((i2c_open->scl_en << _I2C_ROUTEPEN_SCLPEN_SHIFT )
 				    | (i2c_open->sda_en << _I2C_ROUTEPEN_SDAPEN_SHIFT ));
 
-	// set interrupt flag bits: ACK, NACK, and RXDATAV.
+	// Hardware timeouts for a clock held low and a bus left idle mid transfer
+	i2c->CTRL = (i2c->CTRL & ~(_I2C_CTRL_CLTO_MASK | _I2C_CTRL_BITO_MASK)) | I2C_CLTO | I2C_BITO;
+
+	// set interrupt flag bits: ACK, NACK, RXDATAV, MSTOP and the bus faults.
 	uint32_t interrupts = (1 << _I2C_IEN_ACK_SHIFT)
 						| (1 << _I2C_IEN_NACK_SHIFT)
 						| (1 << _I2C_IEN_RXDATAV_SHIFT)
-						| (1 << _I2C_IEN_MSTOP_SHIFT);
+						| (1 << _I2C_IEN_MSTOP_SHIFT)
+						| I2C_FAULT_INTERRUPTS;
 
 	// clear interrupt flags
 	I2C_IntClear(i2c, interrupts);
@@ -122,8 +170,61 @@ void i2c_open(I2C_TypeDef *i2c, I2C_OPEN_STRUCT *i2c_open, I2C_IO_STRUCT *i2c_io
 		EFM_ASSERT(false);
 		// we only have i2c0 and i2c1
 	}
-	i2c_bus_reset(i2c, i2c_io);
-	i2c_payload.state = I2C_IDLE; // start in idle mode
+	// Each bus has its own LDMA channel for its write and read phases
+	if(!ldma_opened){
+		LDMA_Init_t ldma_init = LDMA_INIT_DEFAULT;
+		LDMA_Init(&ldma_init);
+		ldma_opened = true;
+	}
+	if(i2c == I2C0){
+		LDMA_TransferCfg_t tx_cfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_I2C0_TXBL);
+		LDMA_TransferCfg_t rx_cfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_I2C0_RXDATAV);
+		bus->tx_cfg = tx_cfg;
+		bus->rx_cfg = rx_cfg;
+		bus->ldma_ch = 0;
+	} else {
+		LDMA_TransferCfg_t tx_cfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_I2C1_TXBL);
+		LDMA_TransferCfg_t rx_cfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_I2C1_RXDATAV);
+		bus->tx_cfg = tx_cfg;
+		bus->rx_cfg = rx_cfg;
+		bus->ldma_ch = 1;
+	}
+	bus->ldma = i2c_open->ldma;
+	bus->ref_freq = i2c_open->refFreq;
+	bus->open_speed.freq = i2c_open->freq;
+	bus->open_speed.chlr = i2c_open->chlr;
+	bus->speed = bus->open_speed;
+
+	bus->io = *i2c_io;
+	bool released = i2c_bus_reset(i2c, i2c_io);
+	EFM_ASSERT(released);
+	bus->payload.state = I2C_IDLE; // start in idle mode
+	bus->payload.i2c = i2c;
+	bus->head = 0;
+	bus->count = 0;
+	i2c_queue_stats_reset(i2c);
+	i2c_cpu_stats_reset(i2c);
+	i2c_error_stats_reset(i2c);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the context of an I2C peripheral
+ *
+ * @param[in] i2c
+ * 	Pointer to the base peripheral address of the I2C peripheral. The
+ * 	Pearl Gecko has 2 I2C peripherals.
+ *
+ ******************************************************************************/
+static I2C_BUS_STRUCT *i2c_bus(I2C_TypeDef *i2c){
+	if(i2c == I2C0){
+		return &buses[0];
+	} else if (i2c == I2C1){
+		return &buses[1];
+	}
+	EFM_ASSERT(false);
+	// we only have i2c0 and i2c1
+	return &buses[0];
 }
 
 /***************************************************************************//**
@@ -136,7 +237,8 @@ void i2c_open(I2C_TypeDef *i2c, I2C_OPEN_STRUCT *i2c_open, I2C_IO_STRUCT *i2c_io
  *
  * @note
  * 	This function resets the peripheral I2C devices by NACKing 9 times by manually
- * 	clocking the SCK pin while leaving SDA in its default asserted state.
+ * 	clocking the SCK pin while leaving SDA in its default asserted state. A
+ * 	device stuck holding SDA low mid byte lets it go within those clocks.
  *
  * @param[in] i2c
  *	Pointer to the base peripheral address of the I2C peripheral being used. The
@@ -145,92 +247,163 @@ void i2c_open(I2C_TypeDef *i2c, I2C_OPEN_STRUCT *i2c_open, I2C_IO_STRUCT *i2c_io
  * 	@param[in] i2c_io
  * 	The struct which specifies port and pin routing information for the I2C bus.
  *
+ * @return
+ * 	true if both SCL and SDA are released after the reset.
+ *
  ******************************************************************************/
-void i2c_bus_reset(I2C_TypeDef *i2c, I2C_IO_STRUCT *i2c_io){
-	EFM_ASSERT(GPIO_PinInGet(i2c_io->scl_port, i2c_io->scl_pin));
-	EFM_ASSERT(GPIO_PinInGet(i2c_io->sda_port, i2c_io->sda_pin));
+bool i2c_bus_reset(I2C_TypeDef *i2c, I2C_IO_STRUCT *i2c_io){
 	int i;
 	for(i = 0; i < RESET_TOGGLE_NUMBER; i++){
 		GPIO_PinOutToggle(i2c_io->scl_port, i2c_io->scl_pin);
 	}
 
 	i2c->CMD = I2C_CMD_ABORT;
+	return GPIO_PinInGet(i2c_io->scl_port, i2c_io->scl_pin)
+			&& GPIO_PinInGet(i2c_io->sda_port, i2c_io->sda_pin);
 }
 /***************************************************************************//**
  * @brief
- *	IRQ handler for I2C0
+ *	Services the interrupts of one I2C peripheral
  *
  * @details
- *	This is an IRQ handler for I2C0.
+ *	Runs the state machine of the bus context the interrupt belongs to, so
+ *	I2C0 and I2C1 transfers can be in progress at the same time.
  *
  * @note
  *	This is currently configured to handle the interrupts for ACK, NACK, RXDATAV,
- *	and MSTOP. Interrupts are enabled in the i2c_open function.
- *
+ *	TXC and MSTOP, and the ARBLOST, BUSERR, CLTO and BITO faults. A fault is
+ *	handled before, and instead of, any other flag of the same interrupt.
+ *	Interrupts are enabled in the i2c_open function. The interrupts taken and
+ *	the cycles spent here are counted per bus.
  *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
  *
  ******************************************************************************/
-void I2C0_IRQHandler(void){
-	uint32_t interrupt_flags = I2C_IntGet(I2C0) & I2C_IntGetEnabled(I2C0);
-	I2C_IntClear(I2C0, interrupt_flags);
+static void i2c_irq(I2C_BUS_STRUCT *bus){
+	uint32_t start = CYCLE_COUNT_GET();
+	I2C_TypeDef *i2c = bus->payload.i2c;
+	uint32_t interrupt_flags = I2C_IntGet(i2c) & I2C_IntGetEnabled(i2c);
+	I2C_IntClear(i2c, interrupt_flags);
+	uint32_t faults = interrupt_flags & I2C_FAULT_INTERRUPTS;
+	if(bus->payload.state == I2C_IDLE || (bus->payload.state == I2C_BACKOFF && !bus->payload.backoff_ms)){
+		faults &= ~(I2C_IEN_CLTO | I2C_IEN_BITO); // the bus is released, an idle clock is expected
+	}
+	if(faults & I2C_IEN_ARBLOST){
+		i2c_fault(bus, I2C_STATUS_ARBLOST);
+	} else if(faults & I2C_IEN_BUSERR){
+		i2c_fault(bus, I2C_STATUS_BUSERR);
+	} else if(faults & I2C_IEN_CLTO){
+		i2c_fault(bus, I2C_STATUS_CLTO);
+	} else if(faults & I2C_IEN_BITO){
+		i2c_fault(bus, I2C_STATUS_BITO);
+	}
+	if(faults){
+		interrupt_flags = 0; // the transaction has ended
+	}
 	if(interrupt_flags & I2C_IEN_ACK){
-		i2c_ack();
+		i2c_ack(bus);
+		I2C_TRACE(bus, I2C_TRACE_ACK);
 	}
 	if(interrupt_flags & I2C_IEN_NACK){
-		i2c_nack();
+		i2c_nack(bus);
+		I2C_TRACE(bus, I2C_TRACE_NACK);
 	}
 	if(interrupt_flags & I2C_IEN_RXDATAV){
-		i2c_rxdatav();
+		i2c_rxdatav(bus);
+		I2C_TRACE(bus, I2C_TRACE_RXDATAV);
+	}
+	if(interrupt_flags & I2C_IEN_TXC){
+		i2c_txc(bus);
+		I2C_TRACE(bus, I2C_TRACE_TXC);
 	}
 	if(interrupt_flags & I2C_IEN_MSTOP){
-		i2c_mstop();
+		i2c_mstop(bus);
+		I2C_TRACE(bus, I2C_TRACE_MSTOP);
 	}
+	bus->cpu.irqs++;
+	bus->cpu.isr_cycles += CYCLE_COUNT_GET() - start;
 }
 
 /***************************************************************************//**
  * @brief
- *	IRQ handler for I2C1
+ *	IRQ handler for I2C0
  *
  * @details
- *	This is an IRQ handler for I2C1.
+ *	This is an IRQ handler for I2C0. It runs the I2C0 state machine.
  *
- * @note
- *	This is currently configured to handle the interrupts for ACK, NACK, RXDATAV,
- *	and MSTOP. Interrupts are enabled in the i2c_open function.
+ ******************************************************************************/
+void I2C0_IRQHandler(void){
+	i2c_irq(&buses[0]);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	IRQ handler for I2C1
  *
+ * @details
+ *	This is an IRQ handler for I2C1. It runs the I2C1 state machine.
  *
  ******************************************************************************/
 void I2C1_IRQHandler(void){
-	uint32_t interrupt_flags = I2C_IntGet(I2C1) & I2C_IntGetEnabled(I2C1);
-	I2C_IntClear(I2C1, interrupt_flags);
-	if(interrupt_flags & I2C_IEN_ACK){
-		i2c_ack();
-	}
-	if(interrupt_flags & I2C_IEN_NACK){
-		i2c_nack();
-	}
-	if(interrupt_flags & I2C_IEN_RXDATAV){
-		i2c_rxdatav();
-	}
-	if(interrupt_flags & I2C_IEN_MSTOP){
-		i2c_mstop();
-	}
+	i2c_irq(&buses[1]);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	IRQ handler for the LDMA
+ *
+ * @details
+ *	LDMA_Init() enables the LDMA interrupt in the NVIC, and the I2C buses are
+ *	its only users. Their descriptors do not set a done flag and their channel
+ *	interrupts are disabled once started, so only the error flag can interrupt.
+ *	Any flag that gets here is cleared so it cannot interrupt again.
+ *
+ * @note
+ *	An error means a descriptor addressed memory the LDMA may not reach.
+ *
+ ******************************************************************************/
+void LDMA_IRQHandler(void){
+	uint32_t flags = LDMA_IntGetEnabled();
+	LDMA_IntClear(flags);
+	EFM_ASSERT(!(flags & LDMA_IF_ERROR));
 }
+
 /***************************************************************************//**
  * @brief
- *	Function to start an I2C read or write operation
+ *	Function to queue an I2C read or write operation
  *
  * @details
- *	Initializes the I2C payload which stores the state of the I2C operation.
- *	All information required by the I2C state machine interacts with this
- *	I2C payload struct.
+ *	Copies the request into the next free descriptor of the transaction queue
+ *	of the I2C peripheral and returns without waiting. If the bus is idle the transaction is started
+ *	right away, otherwise it is started from the MSTOP interrupt of the
+ *	transaction ahead of it. Transactions run in the order they were queued,
+ *	and each one schedules its own event when it completes.
  *
- *	Once the payload is initialized, this function initiates the I2C operation
- *	by entering the first state of the state machine
+ *	A transaction that fails, for example with a NACK from an absent device or
+ *	a bus fault, still completes and posts its event. The event goes through
+ *	the scheduler message queue with the I2C_STATUS as its payload, so it must
+ *	be registered with scheduler_register_msg(), and the handler can tell a
+ *	good read from a failed one. If status is set, the result is also written
+ *	there. If done is set it is called with done_arg from the I2C interrupt
+ *	handler once the status is written, before the event is posted.
+ *
+ *	Each device can give its own bus speed. The clock divider is reprogrammed
+ *	between transactions when the speed changes, so a slow device on the bus
+ *	does not slow down the others. The time each transaction holds the bus
+ *	is kept in the queue statistics.
+ *
+ *	The write phase is a list of segments, each a pointer and a length, sent
+ *	back to back in order. Nothing is copied: the segment list, the bytes it
+ *	points to and the read array are owned by the caller and must stay valid
+ *	and unchanged from this call until the transaction's event is posted, or
+ *	until i2c_idle() for a transaction without an event. Constant command
+ *	codes and segment lists can simply be static const.
  *
  *	@note
- *	This function must only be called if the state of the I2C peripheral and
- *	the state of the I2C state machine are both in the idle state.
+ *	Each I2C peripheral has its own queue, so I2C0 and I2C1 transactions run
+ *	in parallel. Each blocks EM2 from its first queued transaction until its
+ *	queue is empty.
  *
  *
  * @param[in] i2c
@@ -241,40 +414,115 @@ void I2C1_IRQHandler(void){
  * 	Pointer to the i2c start struct which contains all parameters required to
  * 	configure the i2c payload for a read or write sequence.
  *
+ * @return
+ * 	true if the transaction was queued, false if the queue was full.
+ *
  ******************************************************************************/
 
-void i2c_start(I2C_TypeDef *i2c, I2C_START_STRUCT* start_struct){
-	EFM_ASSERT((i2c->STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE); // this assert will trigger if your i2c peripheral hasn't completed its previous operation
-	EFM_ASSERT(i2c_payload.state == I2C_IDLE); // state machine should only be started in idle mode.
-	__disable_irq();
-	sleep_block_mode(I2C_EM_BLOCK);
-	i2c_payload.i2c = i2c;
-	i2c_payload.device_address = start_struct->device_address;
-	i2c_payload.read = start_struct->read;
-	i2c_payload.write_length = start_struct->command_code_length + start_struct->write_length;
-	EFM_ASSERT(i2c_payload.write_length <= I2C_WRITE_LIMIT);
-	// construct write array
+bool i2c_start(I2C_TypeDef *i2c, I2C_START_STRUCT* start_struct){
+	uint32_t write_length = 0;
+	EFM_ASSERT(start_struct->segment_count > 0); // the write phase addresses the device
+	for(int i = 0; i < start_struct->segment_count; i++){
+		EFM_ASSERT(start_struct->segments[i].length > 0);
+		write_length += start_struct->segments[i].length;
+	}
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	if(bus->count >= I2C_QUEUE_SIZE){
+		bus->stats.rejected++;
+		critical_exit(primask);
+		return false;
+	}
+
+	I2C_REQUEST_STRUCT *request = &bus->queue[(bus->head + bus->count) % I2C_QUEUE_SIZE];
+	request->device_address = start_struct->device_address;
+	request->read = start_struct->read;
+	request->segments = start_struct->segments;
+	request->segment_count = start_struct->segment_count;
+	request->write_length = write_length;
+	request->read_arr = start_struct->read_arr;
+	request->read_length = start_struct->read_length;
+	request->event = start_struct->event;
+	request->retry = start_struct->retry;
+	request->status = start_struct->status;
+	request->speed = start_struct->speed;
+	request->done = start_struct->done;
+	request->done_arg = start_struct->done_arg;
+	request->submit_time = letimer_timer_now();
+
+	bus->count++;
+	bus->stats.submitted++;
+	if(bus->count > bus->stats.max_depth) bus->stats.max_depth = bus->count;
 
-	for(int i = 0; i < start_struct->command_code_length; i++){
-		write_arr[i] = start_struct->command_code[i];
+	if(bus->count == 1){
+		bus->payload.sleep_token = sleep_block_acquire(I2C_EM_BLOCK, SLEEP_OWNER_I2C);
+		i2c_begin(bus);
 	}
-	for(int i = 0; i < start_struct->write_length; i++){
-		write_arr[i + start_struct->command_code_length] = start_struct->write_arr[i];
+	critical_exit(primask);
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts the transaction at the head of a bus queue
+ *
+ * @details
+ *	Initializes the I2C payload which stores the state of the I2C operation
+ *	from the head descriptor, then initiates the I2C operation by entering the
+ *	first state of the state machine.
+ *
+ *	@note
+ *	Called with interrupts masked, or from the I2C interrupt handler. Both the
+ *	I2C peripheral and the state machine must be idle.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral to start.
+ *
+ ******************************************************************************/
+static void i2c_begin(I2C_BUS_STRUCT *bus){
+	I2C_REQUEST_STRUCT *request = &bus->queue[bus->head];
+	EFM_ASSERT((bus->payload.i2c->STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE); // this assert will trigger if your i2c peripheral hasn't completed its previous operation
+	EFM_ASSERT(bus->payload.state == I2C_IDLE); // state machine should only be started in idle mode.
+
+	uint32_t wait = letimer_timer_now() - request->submit_time;
+	bus->stats.total_wait_ms += wait;
+	if(wait > bus->stats.max_wait_ms) bus->stats.max_wait_ms = wait;
+
+	bus->payload.device_address = request->device_address;
+	bus->payload.read = request->read;
+	bus->payload.segments = request->segments;
+	bus->payload.segment_count = request->segment_count;
+	bus->payload.segment = 0;
+	bus->payload.segment_offset = 0;
+	bus->payload.write_length = request->write_length;
+	bus->payload.read_arr = request->read_arr;
+	bus->payload.read_length = request->read_length;
+	bus->payload.num_bytes_written = 0;
+	bus->payload.num_bytes_read = 0;
+	bus->payload.event = request->event;
+	bus->payload.retry = request->retry;
+	bus->payload.status = request->status;
+	bus->payload.done = request->done;
+	bus->payload.done_arg = request->done_arg;
+	bus->payload.bus_cycles = 0;
+
+	// the clock divider may only change while the bus is idle, as it is here
+	const I2C_SPEED_STRUCT *speed = request->speed ? request->speed : &bus->open_speed;
+	if(speed->freq != bus->speed.freq || speed->chlr != bus->speed.chlr){
+		I2C_BusFreqSet(bus->payload.i2c, bus->ref_freq, speed->freq, speed->chlr);
+		bus->speed = *speed;
+		bus->stats.speed_changes++;
 	}
-	i2c_payload.write_arr = write_arr;
-	i2c_payload.read_arr = start_struct->read_arr;
-	i2c_payload.read_length = start_struct->read_length;
-	i2c_payload.num_bytes_written = 0;
-	i2c_payload.num_bytes_read = 0;
-	i2c_payload.event = start_struct->event;
+	bus->payload.polls = 0;
 
-	i2c_payload.state = I2C_REQUEST_DEVICE;
+	bus->payload.state = I2C_REQUEST_DEVICE;
+	bus->payload.bus_start = CYCLE_COUNT_GET();
 
 	// Start bit, Device address, write bit.
-	i2c_payload.i2c->CMD = I2C_CMD_START;
-	i2c_payload.i2c->TXDATA = (i2c_payload.device_address << 1) | I2C_WRITE;
-	__enable_irq();
-
+	bus->payload.i2c->CMD = I2C_CMD_START;
+	bus->payload.i2c->TXDATA = (bus->payload.device_address << 1) | I2C_WRITE;
+	I2C_TRACE_BYTE(bus, (bus->payload.device_address << 1) | I2C_WRITE);
+	I2C_TRACE(bus, I2C_TRACE_BEGIN);
 }
 
 /***************************************************************************//**
@@ -286,46 +534,48 @@ void i2c_start(I2C_TypeDef *i2c, I2C_START_STRUCT* start_struct){
  *	This function defines the behavior of the state machine in each state
  *	when an ACK is received.
  *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
+ *
  ******************************************************************************/
-static void i2c_ack(){
-	switch(i2c_payload.state){
+static void i2c_ack(I2C_BUS_STRUCT *bus){
+	switch(bus->payload.state){
 		case I2C_IDLE:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_REQUEST_DEVICE:
-			i2c_payload.state = I2C_WRITE_DATA;
-			// send measurement command
-			uint8_t tx_data = i2c_payload.write_arr[0];
-			i2c_payload.i2c->TXDATA = tx_data;//i2c_payload.write_arr[0]; // write the first byte
+			bus->payload.state = I2C_WRITE_DATA;
+			if(bus->ldma && bus->payload.write_length >= I2C_LDMA_MIN_WRITE
+					&& bus->payload.segment_count <= I2C_LDMA_DESCRIPTORS){
+				i2c_ldma_write(bus); // TXC ends the write phase
+			} else {
+				i2c_write_next(bus); // send measurement command
+			}
 			break;
 		case I2C_WRITE_DATA:
-			i2c_payload.num_bytes_written++;
-			if(i2c_payload.num_bytes_written >= i2c_payload.write_length){
-				if(i2c_payload.read){
-					i2c_payload.state = I2C_REQUEST_DATA;
-					i2c_payload.i2c->CMD = I2C_CMD_START;
-					i2c_payload.i2c->TXDATA = (i2c_payload.device_address << 1) | I2C_READ;
-				} else {
-					// write mode - jump to close function.
-					i2c_payload.state = I2C_CLOSE_FUNCTION;
-					i2c_payload.i2c->CMD = I2C_CMD_STOP; // no NACK needed to end write
-				}
+			bus->payload.num_bytes_written++;
+			if(bus->payload.num_bytes_written >= bus->payload.write_length){
+				i2c_write_done(bus);
 			} else { // not done writing - put next byte
-				uint8_t tx_data = i2c_payload.write_arr[i2c_payload.num_bytes_written];;
-				i2c_payload.i2c->TXDATA = tx_data;
+				i2c_write_next(bus);
 			}
 			break;
 		case I2C_REQUEST_DATA:
-			i2c_payload.state = I2C_READ_DATA;
+			bus->payload.state = I2C_READ_DATA;
+			if(bus->ldma && bus->payload.read_length >= I2C_LDMA_MIN_READ){
+				i2c_ldma_read(bus); // RXDATAV is re-enabled for the last byte
+			}
 			break;
 		case I2C_READ_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_CLOSE_FUNCTION:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
+		case I2C_NACKED:
+			break; // a byte the LDMA queued before the NACK, the stop follows it
 		default:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 	}
 }
@@ -339,39 +589,96 @@ static void i2c_ack(){
  *	This function defines the behavior of the state machine in each state
  *	when a NACK is received.
  *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
+ *
  ******************************************************************************/
-static void i2c_nack(){
-	switch(i2c_payload.state){
+static void i2c_nack(I2C_BUS_STRUCT *bus){
+	switch(bus->payload.state){
 		case I2C_IDLE:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_REQUEST_DEVICE:
-			EFM_ASSERT(false);
+			i2c_nack_stop(bus); // no device at the address, or it is busy
 			break;
 		case I2C_WRITE_DATA:
-			EFM_ASSERT(false);
+			i2c_nack_stop(bus); // the device refused a byte
 			break;
 		case I2C_REQUEST_DATA:
 			// request data again
-			if(i2c_payload.read){
-				i2c_payload.i2c->CMD = I2C_CMD_START;
-				uint8_t tx_byte = (i2c_payload.device_address << 1) | I2C_READ;
-				i2c_payload.i2c->TXDATA = tx_byte;
+			if(bus->payload.read){
+				bus->cpu.nack_polls++;
+				uint32_t wait = 0;
+				uint32_t nacks = bus->payload.polls;
+				switch(bus->payload.retry.policy){
+					case I2C_RETRY_FIXED:
+						wait = bus->payload.retry.delay_ms;
+						break;
+					case I2C_RETRY_EXPONENTIAL:
+						wait = nacks > 16 ? bus->payload.retry.max_delay_ms
+								: (uint32_t)bus->payload.retry.delay_ms << (nacks - 1);
+						if(wait > bus->payload.retry.max_delay_ms) wait = bus->payload.retry.max_delay_ms;
+						break;
+					case I2C_RETRY_CONVERSION:
+						wait = I2C_RETRY_MIN_MS; // the conversion should be nearly done
+						break;
+					default:
+						break;
+				}
+				if(wait && letimer_timer_running()){
+					i2c_backoff(bus, wait < I2C_RETRY_MIN_MS ? I2C_RETRY_MIN_MS : wait);
+				} else {
+					i2c_read_address(bus);
+				}
 			} else{
-				EFM_ASSERT(false);
+				i2c_nack_stop(bus);
 			}
 			break;
 		case I2C_READ_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_CLOSE_FUNCTION:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
+		case I2C_NACKED:
+			break; // a byte the LDMA queued before the NACK, the stop follows it
 		default:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 	}
 }
+
+/***************************************************************************//**
+ * @brief
+ *	Ends a transaction the device NACKed
+ *
+ * @details
+ *	A NACK is an answer from the device, not a bus fault. The controller still
+ *	owns a working bus, so a stop releases it and the MSTOP interrupt completes
+ *	the transaction with I2C_STATUS_NACK, without an abort or a bus reset.
+ *	A NACK in an LDMA write phase also stops the LDMA, drops the byte it may
+ *	have left in TXDATA, and puts back the ACK interrupt in place of TXC. A
+ *	byte already on its way still goes out before the stop, and its ACK or
+ *	NACK is ignored.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
+ *
+ ******************************************************************************/
+static void i2c_nack_stop(I2C_BUS_STRUCT *bus){
+	I2C_TypeDef *i2c = bus->payload.i2c;
+
+	if(bus->payload.state == I2C_WRITE_DATA){
+		LDMA_StopTransfer(bus->ldma_ch);
+		I2C_IntDisable(i2c, I2C_IEN_TXC);
+		I2C_IntClear(i2c, I2C_IF_ACK | I2C_IF_TXC); // acknowledges of the LDMA bytes
+		I2C_IntEnable(i2c, I2C_IEN_ACK);
+		i2c->CMD = I2C_CMD_CLEARTX;
+	}
+	bus->payload.state = I2C_NACKED;
+	i2c->CMD = I2C_CMD_STOP;
+}
+
 /***************************************************************************//**
  * @brief
  *	Function that the I2C interrupt handler will call upon receiving
@@ -381,44 +688,278 @@ static void i2c_nack(){
  *	This function defines the behavior of the state machine in each state
  *	when data becomes available in the receive buffer.
  *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
+ *
  ******************************************************************************/
-static void i2c_rxdatav(){
-	switch(i2c_payload.state){
+static void i2c_rxdatav(I2C_BUS_STRUCT *bus){
+	switch(bus->payload.state){
 		case I2C_IDLE:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_REQUEST_DEVICE:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_WRITE_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_REQUEST_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_READ_DATA:;
 			// read byte
-			uint32_t rx_byte = i2c_payload.i2c->RXDATA;//(i2c_payload.device_address << 1) | I2C_READ;
-			i2c_payload.read_arr[i2c_payload.num_bytes_read] = rx_byte; //i2c_payload.i2c->RXDATA; //data;
-			i2c_payload.num_bytes_read++;
-			if(i2c_payload.num_bytes_read >= i2c_payload.read_length){
-				i2c_payload.state = I2C_CLOSE_FUNCTION;
-				i2c_payload.i2c->CMD = I2C_CMD_NACK;
-				i2c_payload.i2c->CMD = I2C_CMD_STOP;
+			uint32_t rx_byte = bus->payload.i2c->RXDATA;//(bus->payload.device_address << 1) | I2C_READ;
+			I2C_TRACE_BYTE(bus, rx_byte);
+			bus->payload.read_arr[bus->payload.num_bytes_read] = rx_byte; //bus->payload.i2c->RXDATA; //data;
+			bus->payload.num_bytes_read++;
+			if(bus->payload.num_bytes_read >= bus->payload.read_length){
+				bus->payload.state = I2C_CLOSE_FUNCTION;
+				bus->payload.i2c->CMD = I2C_CMD_NACK;
+				bus->payload.i2c->CMD = I2C_CMD_STOP;
 			} else {
 				// send ACK
-				i2c_payload.i2c->CMD = I2C_CMD_ACK;
+				bus->payload.i2c->CMD = I2C_CMD_ACK;
 			}
 			break;
 		case I2C_CLOSE_FUNCTION:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		default:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 	}
 }
 
+/***************************************************************************//**
+ * @brief
+ *	Function that the I2C interrupt handler will call upon receiving
+ *	the I2C TXC interrupt
+ *
+ * @details
+ *	TXC is only enabled while the LDMA moves the write phase. It is set once the
+ *	transmit buffer and shift register are empty, so the last byte has been
+ *	acknowledged and the restart or stop can be sent.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
+ *
+ ******************************************************************************/
+static void i2c_txc(I2C_BUS_STRUCT *bus){
+	switch(bus->payload.state){
+		case I2C_WRITE_DATA:
+			if(!LDMA_TransferDone(bus->ldma_ch)) break; // LDMA fell behind the bus, wait for the next TXC
+			I2C_IntDisable(bus->payload.i2c, I2C_IEN_TXC);
+			I2C_IntClear(bus->payload.i2c, I2C_IF_ACK); // acknowledges of the LDMA bytes
+			I2C_IntEnable(bus->payload.i2c, I2C_IEN_ACK);
+			bus->payload.num_bytes_written = bus->payload.write_length;
+			i2c_write_done(bus);
+			break;
+		case I2C_NACKED:
+			break; // the byte that was NACKed, taken with the NACK
+		default:
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
+			break;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Ends the write phase of a transaction
+ *
+ * @details
+ *	Sends a repeated start with the read address for a read, or a stop for a
+ *	write. A read with the conversion retry policy stops instead, and polls
+ *	the device once its conversion time has passed.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_write_done(I2C_BUS_STRUCT *bus){
+	if(bus->payload.read && bus->payload.retry.policy == I2C_RETRY_CONVERSION
+			&& bus->payload.retry.delay_ms && letimer_timer_running()){
+		i2c_backoff(bus, bus->payload.retry.delay_ms); // poll once the conversion is done
+	} else if(bus->payload.read){
+		i2c_read_address(bus);
+	} else {
+		// write mode - jump to close function.
+		bus->payload.state = I2C_CLOSE_FUNCTION;
+		bus->payload.i2c->CMD = I2C_CMD_STOP; // no NACK needed to end write
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Writes the next byte of the write phase
+ *
+ * @details
+ *	Walks the segment list in place, moving to the next segment once the
+ *	current one has been sent.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_write_next(I2C_BUS_STRUCT *bus){
+	const I2C_SEGMENT_STRUCT *segment = &bus->payload.segments[bus->payload.segment];
+	bus->payload.i2c->TXDATA = segment->data[bus->payload.segment_offset];
+	I2C_TRACE_BYTE(bus, segment->data[bus->payload.segment_offset]);
+	bus->payload.segment_offset++;
+	if(bus->payload.segment_offset >= segment->length){
+		bus->payload.segment++;
+		bus->payload.segment_offset = 0;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts the LDMA on the write phase
+ *
+ * @details
+ *	The LDMA feeds each segment to TXDATA on TXBL, one linked descriptor per
+ *	segment. The ACK interrupt is disabled for the data bytes and TXC is
+ *	enabled to mark the end of the phase, so the phase costs one interrupt
+ *	instead of one per byte.
+ *
+ * @note
+ *	Only used when the segments fit in the descriptors of the bus. A segment
+ *	longer than one descriptor can move is sent by interrupt instead.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_ldma_write(I2C_BUS_STRUCT *bus){
+	I2C_TypeDef *i2c = bus->payload.i2c;
+	uint32_t last = bus->payload.segment_count - 1;
+
+	for(uint32_t i = 0; i <= last; i++){
+		const I2C_SEGMENT_STRUCT *segment = &bus->payload.segments[i];
+		if(segment->length > I2C_LDMA_MAX_SEGMENT){
+			i2c_write_next(bus);
+			return;
+		}
+		LDMA_Descriptor_t single = LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(segment->data, &i2c->TXDATA, segment->length);
+		LDMA_Descriptor_t link = LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(segment->data, &i2c->TXDATA, segment->length, 1);
+		single.xfer.doneIfs = 0; // TXC ends the phase, not the LDMA
+		bus->ldma_desc[i] = (i == last) ? single : link;
+	}
+	I2C_IntDisable(i2c, I2C_IEN_ACK);
+	I2C_IntClear(i2c, I2C_IF_TXC);
+	I2C_IntEnable(i2c, I2C_IEN_TXC);
+	LDMA_StartTransfer(bus->ldma_ch, &bus->tx_cfg, &bus->ldma_desc[0]);
+	LDMA_IntDisable(1 << bus->ldma_ch); // enabled by LDMA_StartTransfer()
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts the LDMA on the read phase
+ *
+ * @details
+ *	With AUTOACK set the I2C acknowledges each byte on its own, and the LDMA
+ *	moves all but the last byte from RXDATA into the read array. Two more
+ *	descriptors then clear AUTOACK and enable RXDATAV, so the last byte is
+ *	read by interrupt and NACKed as before. Clearing AUTOACK from the LDMA
+ *	rather than an interrupt handler makes sure it happens before the last
+ *	byte is received.
+ *
+ *	Both bits are written through the bit clear and bit set aliases, so the
+ *	descriptors do not carry a copy of CTRL and IEN taken when they were
+ *	built. A fault or a timer changing either register in the meantime is
+ *	not undone.
+ *
+ * @note
+ *	The RXDATAV flag follows the receive buffer, so enabling it does not
+ *	pick up the bytes the LDMA has already read.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_ldma_read(I2C_BUS_STRUCT *bus){
+	I2C_TypeDef *i2c = bus->payload.i2c;
+	uint32_t ldma_bytes = bus->payload.read_length - 1;
+	LDMA_Descriptor_t read = LDMA_DESCRIPTOR_LINKREL_P2M_BYTE(&i2c->RXDATA, bus->payload.read_arr, ldma_bytes, 1);
+	LDMA_Descriptor_t nack = LDMA_DESCRIPTOR_LINKREL_WRITE(I2C_CTRL_AUTOACK, I2C_REG_CLR(i2c->CTRL), 1);
+	LDMA_Descriptor_t last = LDMA_DESCRIPTOR_SINGLE_WRITE(I2C_IEN_RXDATAV, I2C_REG_SET(i2c->IEN));
+	last.wri.doneIfs = 0; // RXDATAV ends the phase, not the LDMA
+
+	bus->ldma_desc[0] = read;
+	bus->ldma_desc[1] = nack;
+	bus->ldma_desc[2] = last;
+	bus->payload.num_bytes_read = ldma_bytes;
+	I2C_IntDisable(i2c, I2C_IEN_RXDATAV);
+	i2c->CTRL |= I2C_CTRL_AUTOACK;
+	LDMA_StartTransfer(bus->ldma_ch, &bus->rx_cfg, &bus->ldma_desc[0]);
+	LDMA_IntDisable(1 << bus->ldma_ch); // enabled by LDMA_StartTransfer()
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sends a start with the read address
+ *
+ * @details
+ *	Used for the repeated start after the write phase and for each poll of a
+ *	device that NACKed because it is still converting.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_read_address(I2C_BUS_STRUCT *bus){
+	bus->payload.polls++;
+	bus->payload.state = I2C_REQUEST_DATA;
+	bus->payload.i2c->CMD = I2C_CMD_START;
+	bus->payload.i2c->TXDATA = (bus->payload.device_address << 1) | I2C_READ;
+	I2C_TRACE_BYTE(bus, (bus->payload.device_address << 1) | I2C_READ);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Releases the bus before polling the device again
+ *
+ * @details
+ *	Sends a stop, and the MSTOP interrupt then releases the EM2 block and arms
+ *	a LETIMER software timer. The core can sleep in EM2 for the wait instead of
+ *	taking a NACK interrupt for every poll.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ * @param[in] ms
+ * 	Time to wait before the next poll.
+ *
+ ******************************************************************************/
+static void i2c_backoff(I2C_BUS_STRUCT *bus, uint32_t ms){
+	bus->payload.backoff_ms = ms;
+	bus->payload.state = I2C_BACKOFF;
+	bus->payload.i2c->CMD = I2C_CMD_STOP;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Polls the device once a backoff has passed
+ *
+ * @details
+ *	Called by the LETIMER software timer armed in the MSTOP of a backoff. It
+ *	blocks EM2 again and sends the read address.
+ *
+ * @note
+ *	Runs in the LETIMER0 IRQ handler.
+ *
+ * @param[in] arg
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_backoff_expire(void *arg){
+	I2C_BUS_STRUCT *bus = arg;
+	EFM_ASSERT(bus->payload.state == I2C_BACKOFF);
+	bus->payload.sleep_token = sleep_block_acquire(I2C_EM_BLOCK, SLEEP_OWNER_I2C);
+	bus->payload.bus_start = CYCLE_COUNT_GET();
+	i2c_read_address(bus);
+	I2C_TRACE(bus, I2C_TRACE_POLL);
+}
+
 /***************************************************************************//**
  * @brief
  *	Function that the I2C interrupt handler will call upon receiving
@@ -426,50 +967,408 @@ static void i2c_rxdatav(){
  *
  * @details
  *	This function defines the behavior of the state machine in each state
- *	when a STOP condition has been successfully transmitted.
+ *	when a STOP condition has been successfully transmitted. A completed
+ *	transaction is removed from the queue and the next one, if any, is started.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral that interrupted.
  *
  ******************************************************************************/
-static void i2c_mstop(){
-	switch(i2c_payload.state){
+static void i2c_mstop(I2C_BUS_STRUCT *bus){
+	switch(bus->payload.state){
 		case I2C_IDLE:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_REQUEST_DEVICE:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_WRITE_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_REQUEST_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 		case I2C_READ_DATA:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
+			break;
+		case I2C_BACKOFF:
+			i2c_backoff_arm(bus);
 			break;
 		case I2C_CLOSE_FUNCTION:
-			sleep_unblock_mode(I2C_EM_BLOCK); // allow sleep
-			add_scheduled_event(i2c_payload.event); // schedule event
-			i2c_payload.state = I2C_IDLE;
+			i2c_complete(bus, I2C_STATUS_OK);
+			break;
+		case I2C_NACKED:
+			bus->errors.errors[I2C_STATUS_NACK]++;
+			i2c_complete(bus, I2C_STATUS_NACK);
 			break;
 		default:
-			EFM_ASSERT(false);
+			i2c_fault(bus, I2C_STATUS_PROTOCOL);
 			break;
 	}
 }
 
+/***************************************************************************//**
+ * @brief
+ *	Ends the running transaction
+ *
+ * @details
+ *	Reports the status, calls the done function, posts the event of the
+ *	transaction to the scheduler message queue with the status as its payload
+ *	and removes it from the queue. The next transaction, if any, is started,
+ *	otherwise the EM2 block is released.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ * @param[in] status
+ * 	I2C_STATUS_OK, or why the transaction failed.
+ *
+ ******************************************************************************/
+static void i2c_complete(I2C_BUS_STRUCT *bus, I2C_STATUS status){
+	if(bus->payload.status){
+		*bus->payload.status = status;
+	}
+	if(bus->payload.read){
+		bus->cpu.last_polls = bus->payload.polls;
+		if(bus->payload.polls > bus->cpu.max_polls) bus->cpu.max_polls = bus->payload.polls;
+	}
+	uint32_t bus_cycles = bus->payload.bus_cycles + CYCLE_COUNT_GET() - bus->payload.bus_start;
+	bus->stats.last_bus_cycles = bus_cycles;
+	bus->stats.total_bus_cycles += bus_cycles;
+	if(bus_cycles > bus->stats.max_bus_cycles) bus->stats.max_bus_cycles = bus_cycles;
+	if(bus->payload.done){
+		bus->payload.done(bus->payload.done_arg);
+	}
+	if(bus->payload.event){
+		scheduler_post(bus->payload.event, status); // the handler gets the status with the event
+	}
+	bus->payload.state = I2C_IDLE;
+	bus->head = (bus->head + 1) % I2C_QUEUE_SIZE;
+	bus->count--;
+	bus->stats.completed++;
+	if(bus->count){
+		i2c_begin(bus);
+	} else {
+		sleep_block_release(bus->payload.sleep_token); // allow sleep
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Recovers the bus from a fault and fails the running transaction
+ *
+ * @details
+ *	Stops the LDMA and restores the interrupts and AUTOACK it may have changed,
+ *	aborts the transfer and clocks out any device holding the bus with
+ *	i2c_bus_reset(). The running transaction then completes with the fault as
+ *	its status, and the queue moves on. A fault while waiting for the stop of
+ *	a backoff arms the backoff timer as the MSTOP interrupt would have, so the
+ *	device is still polled again. The fault is counted per type.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ * @param[in] status
+ * 	The type of fault.
+ *
+ ******************************************************************************/
+static void i2c_fault(I2C_BUS_STRUCT *bus, I2C_STATUS status){
+	I2C_TypeDef *i2c = bus->payload.i2c;
+	State state = bus->payload.state;
+
+	I2C_TRACE_BYTE(bus, status);
+	I2C_TRACE(bus, I2C_TRACE_FAULT);
+	bus->errors.errors[status]++;
+	bus->errors.recoveries++;
+	LDMA_StopTransfer(bus->ldma_ch);
+	I2C_IntDisable(i2c, I2C_IEN_TXC);
+	I2C_IntEnable(i2c, I2C_IEN_ACK | I2C_IEN_RXDATAV);
+	i2c->CTRL &= ~I2C_CTRL_AUTOACK;
+	i2c->CMD = I2C_CMD_ABORT;
+	if(!i2c_bus_reset(i2c, &bus->io)){
+		bus->errors.stuck++;
+	}
+	I2C_IntClear(i2c, I2C_IEN_ACK | I2C_IEN_NACK | I2C_IEN_RXDATAV | I2C_IEN_TXC
+			| I2C_IEN_MSTOP | I2C_FAULT_INTERRUPTS);
+
+	if(state == I2C_BACKOFF){
+		if(bus->payload.backoff_ms){
+			i2c_backoff_arm(bus);
+		}
+	} else if(state != I2C_IDLE){
+		i2c_complete(bus, status);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Arms the wait of a backoff once the bus is released
+ *
+ * @details
+ *	Releases the EM2 block and starts a LETIMER software timer that polls the
+ *	device again. backoff_ms is cleared to mark the timer as armed.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ ******************************************************************************/
+static void i2c_backoff_arm(I2C_BUS_STRUCT *bus){
+	// the bus is free, sleep in EM2 until the device is polled again
+	bus->payload.bus_cycles += CYCLE_COUNT_GET() - bus->payload.bus_start;
+	sleep_block_release(bus->payload.sleep_token);
+	letimer_timer_start_cb(bus->payload.backoff_ms, i2c_backoff_expire, bus);
+	bus->payload.backoff_ms = 0;
+}
+
 /***************************************************************************//**
  * @brief
  *   I2C Idle indicates whether the I2C state machine is in the IDLE state
  *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
  * @return
- * 	 Returns TRUE if the state machine is IDLE and the i2c peripheral is IDLE,
- * 	 and FALSE if the state machine is busy (ie. any state other than IDLE)
- * 	 or the i2c peripheral is not idle.
+ * 	 Returns TRUE if the queue is empty, the state machine is IDLE and the i2c
+ * 	 peripheral is IDLE, and FALSE if the state machine is busy (ie. any state
+ * 	 other than IDLE) or the i2c peripheral is not idle.
+ *
+ ******************************************************************************/
+
+bool i2c_idle(I2C_TypeDef *i2c){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	return ((bus->count == 0) && (bus->payload.state == I2C_IDLE) &&
+			(i2c->STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the number of transactions running or waiting in an I2C queue
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ ******************************************************************************/
+uint32_t i2c_queue_depth(I2C_TypeDef *i2c){
+	return i2c_bus(i2c)->count;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   I2C Queue Stats
+ *
+ * @details
+ *	Copies the queue statistics of an I2C peripheral: transactions queued,
+ *	completed and refused, the deepest the queue has been, and the time
+ *	transactions spent waiting for the bus in milliseconds of the LETIMER
+ *	time base. Also the speed changes and the core cycles each transaction
+ *	held the bus, from its start to its stop without the backoff waits.
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ * @param[out] stats
+ *   Where the statistics are copied.
+ *
+ ******************************************************************************/
+void i2c_queue_stats(I2C_TypeDef *i2c, I2C_QUEUE_STATS_STRUCT *stats){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	*stats = bus->stats;
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Clears the queue statistics of an I2C peripheral
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
  *
  ******************************************************************************/
+void i2c_queue_stats_reset(I2C_TypeDef *i2c){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	memset(&bus->stats, 0, sizeof(bus->stats));
+	critical_exit(primask);
+}
 
-bool i2c_idle(void){
-	return ((i2c_payload.state == I2C_IDLE) &&
-			(i2c_payload.i2c->STATE & _I2C_STATE_STATE_MASK) == I2C_STATE_STATE_IDLE);
+/***************************************************************************//**
+ * @brief
+ *   Turns the LDMA mode of an I2C peripheral on or off
+ *
+ * @details
+ *	With the LDMA mode on, write phases of I2C_LDMA_MIN_WRITE or more bytes and
+ *	read phases of I2C_LDMA_MIN_READ or more bytes are moved by the LDMA, and
+ *	interrupts only happen at the address, restart and stop boundaries.
+ *
+ * @note
+ *	Takes effect from the next phase, so change it while the bus is idle.
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ * @param[in] enable
+ *   true to use the LDMA, false for one interrupt per byte.
+ *
+ ******************************************************************************/
+void i2c_ldma_enable(I2C_TypeDef *i2c, bool enable){
+	i2c_bus(i2c)->ldma = enable;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   I2C CPU Stats
+ *
+ * @details
+ *	Copies the number of I2C interrupts, the core cycles spent in the I2C
+ *	interrupt handler, and the read address NACKs of a busy device for an
+ *	I2C peripheral.
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ * @param[out] stats
+ *   Where the statistics are copied.
+ *
+ ******************************************************************************/
+void i2c_cpu_stats(I2C_TypeDef *i2c, I2C_CPU_STATS_STRUCT *stats){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	*stats = bus->cpu;
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Clears the CPU statistics of an I2C peripheral
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ ******************************************************************************/
+void i2c_cpu_stats_reset(I2C_TypeDef *i2c){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	memset(&bus->cpu, 0, sizeof(bus->cpu));
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   I2C Error Stats
+ *
+ * @details
+ *	Copies the failed transactions per cause, the bus recoveries, and the
+ *	resets that left a line held low for an I2C peripheral.
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ * @param[out] stats
+ *   Where the statistics are copied.
+ *
+ ******************************************************************************/
+void i2c_error_stats(I2C_TypeDef *i2c, I2C_ERROR_STATS_STRUCT *stats){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	*stats = bus->errors;
+	critical_exit(primask);
 }
 
+/***************************************************************************//**
+ * @brief
+ *   Clears the error statistics of an I2C peripheral
+ *
+ * @param[in] i2c
+ *   Pointer to the base peripheral address of the I2C peripheral.
+ *
+ ******************************************************************************/
+void i2c_error_stats_reset(I2C_TypeDef *i2c){
+	I2C_BUS_STRUCT *bus = i2c_bus(i2c);
+	uint32_t primask = critical_enter();
+	memset(&bus->errors, 0, sizeof(bus->errors));
+	critical_exit(primask);
+}
+
+#ifdef I2C_TRACE_ENABLED
+/***************************************************************************//**
+ * @brief
+ *	Adds an entry to the trace
+ *
+ * @details
+ *	Records the event, the state once it was handled, the last byte the CPU
+ *	moved and the cycle count. Bytes moved by the LDMA are not seen. Kept to
+ *	a few stores so tracing barely changes the timing it records.
+ *
+ * @note
+ *	Called from the I2C and LETIMER0 interrupt handlers, or with interrupts
+ *	masked, so entries are never written concurrently.
+ *
+ * @param[in] bus
+ * 	The context of the I2C peripheral.
+ *
+ * @param[in] event
+ * 	What happened.
+ *
+ ******************************************************************************/
+static void i2c_trace_record(I2C_BUS_STRUCT *bus, I2C_TRACE_EVENT event){
+	if(trace_frozen) return;
+	I2C_TRACE_ENTRY_STRUCT *entry = &trace[trace_head];
+	entry->cycles = CYCLE_COUNT_GET();
+	entry->bus = bus - buses;
+	entry->event = event;
+	entry->state = bus->payload.state;
+	entry->byte = bus->trace_byte;
+	trace_head = (trace_head + 1) & (I2C_TRACE_DEPTH - 1);
+	if(trace_count < I2C_TRACE_DEPTH) trace_count++;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Stops or restarts recording the trace
+ *
+ * @details
+ *	Freeze the trace before reading it out with i2c_trace_pop(), so the
+ *	entries that led up to a failure are not overwritten by the transfers
+ *	that follow it.
+ *
+ * @param[in] freeze
+ *   true to stop recording, false to record again.
+ *
+ ******************************************************************************/
+void i2c_trace_freeze(bool freeze){
+	trace_frozen = freeze;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Removes the oldest entry from the trace
+ *
+ * @param[out] entry
+ *   Where the entry is copied.
+ *
+ * @return
+ * 	true if an entry was copied, false if the trace is empty.
+ *
+ ******************************************************************************/
+bool i2c_trace_pop(I2C_TRACE_ENTRY_STRUCT *entry){
+	uint32_t primask = critical_enter();
+	if(trace_count == 0){
+		critical_exit(primask);
+		return false;
+	}
+	*entry = trace[(trace_head - trace_count) & (I2C_TRACE_DEPTH - 1)];
+	trace_count--;
+	critical_exit(primask);
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of entries in the trace
+ *
+ ******************************************************************************/
+uint32_t i2c_trace_count(void){
+	return trace_count;
+}
+#endif
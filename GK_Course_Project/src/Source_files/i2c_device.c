@@ -0,0 +1,376 @@
+/**
+ * @file i2c_device.c
+ * @author Giselle Koo
+ * @date Feb 20, 2020
+ * @brief Device descriptors and batch reads over the I2C transaction queue
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_assert.h"
+
+//** User/developer include files
+#include "i2c_device.h"
+#include "scheduler.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void i2c_device_start(I2C_DEVICE_STRUCT *device, uint8_t command, uint32_t event,
+		I2C_STATUS *status, I2C_DONE_FUNC done, void *done_arg, I2C_START_STRUCT *start_struct);
+static bool i2c_device_batch_queue(I2C_BATCH_STRUCT *batch);
+static void i2c_device_batch_done(void *arg);
+static bool i2c_device_batch_check(I2C_BATCH_STRUCT *batch);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Builds the transaction of a device command
+ *
+ * @details
+ *	Fills the start struct from the device descriptor and its command table.
+ *	A command with a conversion time polls the device with the retry policy of
+ *	the device, and with the conversion policy waits out that time before the
+ *	first poll. Other commands are polled straight away.
+ *
+ * @param[in] device
+ * 	The device descriptor.
+ *
+ * @param[in] command
+ * 	Index of the command in the command table of the device.
+ *
+ * @param[in] event
+ * 	The scheduler event of the completed transaction.
+ *
+ * @param[in] status
+ * 	Where the result is written.
+ *
+ * @param[in] done
+ * 	Called on completion, or null.
+ *
+ * @param[in] done_arg
+ * 	Argument of done.
+ *
+ * @param[out] start_struct
+ * 	The transaction to pass to i2c_start().
+ *
+ ******************************************************************************/
+static void i2c_device_start(I2C_DEVICE_STRUCT *device, uint8_t command, uint32_t event,
+		I2C_STATUS *status, I2C_DONE_FUNC done, void *done_arg, I2C_START_STRUCT *start_struct){
+	EFM_ASSERT(command < device->command_count);
+	const I2C_COMMAND_STRUCT *cmd = &device->commands[command];
+
+	start_struct->device_address = device->address;
+	start_struct->read = cmd->read_length ? I2C_READ : I2C_WRITE;
+	start_struct->segments = cmd->segments;
+	start_struct->segment_count = cmd->segment_count;
+	start_struct->read_arr = cmd->read_arr;
+	start_struct->read_length = cmd->read_length;
+	start_struct->event = event;
+	start_struct->retry.policy = I2C_RETRY_IMMEDIATE;
+	start_struct->retry.delay_ms = 0;
+	start_struct->retry.max_delay_ms = 0;
+	if(cmd->conversion_ms){
+		start_struct->retry = device->retry;
+		if(device->retry.policy == I2C_RETRY_CONVERSION){
+			start_struct->retry.delay_ms = cmd->conversion_ms;
+		}
+	}
+	start_struct->status = status;
+	start_struct->speed = device->speed;
+	start_struct->done = done;
+	start_struct->done_arg = done_arg;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Queues one command of a device
+ *
+ * @details
+ *	The command is sent to the device at its own address, bus and speed, and
+ *	a read lands in the buffer of the command table entry. The result of the
+ *	command is kept in the status of the device.
+ *
+ * @note
+ *	The command table, the bytes it points to and the read buffer follow the
+ *	lifetime rules of i2c_start(): they are used in place until the event.
+ *	The check of the command is only run in a batch, so a single command
+ *	reports the status of the bus alone.
+ *
+ * @param[in] device
+ * 	The device descriptor.
+ *
+ * @param[in] command
+ * 	Index of the command in the command table of the device.
+ *
+ * @param[in] event
+ * 	The scheduler event of the completed command, or I2C_DEVICE_DEFAULT_EVENT
+ * 	for the event of the device.
+ *
+ * @return
+ * 	true if the command was queued, false if the queue of the bus was full.
+ *
+ ******************************************************************************/
+bool i2c_device_command(I2C_DEVICE_STRUCT *device, uint8_t command, uint32_t event){
+	return i2c_device_command_cb(device, command, event, 0, 0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Queues one command of a device with a completion function
+ *
+ * @details
+ *	Works like i2c_device_command(), and done is called from the I2C interrupt
+ *	handler once the status of the device has been written, before the event
+ *	is posted. A driver can use it to keep state that must only change once
+ *	the device has taken a write.
+ *
+ * @param[in] device
+ * 	The device descriptor.
+ *
+ * @param[in] command
+ * 	Index of the command in the command table of the device.
+ *
+ * @param[in] event
+ * 	The scheduler event of the completed command, or I2C_DEVICE_DEFAULT_EVENT
+ * 	for the event of the device.
+ *
+ * @param[in] done
+ * 	Called on completion, whatever the status, or null.
+ *
+ * @param[in] done_arg
+ * 	Argument of done.
+ *
+ * @return
+ * 	true if the command was queued, false if the queue of the bus was full.
+ *
+ ******************************************************************************/
+bool i2c_device_command_cb(I2C_DEVICE_STRUCT *device, uint8_t command, uint32_t event,
+		I2C_DONE_FUNC done, void *done_arg){
+	I2C_START_STRUCT start_struct;
+	if(event == I2C_DEVICE_DEFAULT_EVENT){
+		event = device->event;
+	}
+	i2c_device_start(device, command, event, &device->status, done, done_arg, &start_struct);
+	return i2c_start(device->i2c, &start_struct);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Decodes the last read of a device command
+ *
+ * @details
+ *	Runs the decoder of the command table entry on its read buffer. What the
+ *	result points to is up to the decoder.
+ *
+ * @note
+ *	Check the status of the command, or of its batch entry, first. The buffer
+ *	of a failed read holds no valid data.
+ *
+ * @param[in] device
+ * 	The device descriptor.
+ *
+ * @param[in] command
+ * 	Index of the command in the command table of the device.
+ *
+ * @param[out] result
+ * 	Where the decoder writes the result.
+ *
+ ******************************************************************************/
+void i2c_device_decode(const I2C_DEVICE_STRUCT *device, uint8_t command, void *result){
+	EFM_ASSERT(command < device->command_count);
+	const I2C_COMMAND_STRUCT *cmd = &device->commands[command];
+	EFM_ASSERT(cmd->decode);
+	cmd->decode(cmd->read_arr, cmd->read_length, result);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Queues the commands of a sampling cycle back to back
+ *
+ * @details
+ *	Every entry is queued with interrupts masked, so each bus runs its entries
+ *	one after the other without going idle in between. The EM2 block of a bus
+ *	is then held once for the whole batch, and the core wakes once per sampling
+ *	cycle instead of once per device. Devices on different buses run in
+ *	parallel. The batch event is posted once, when the last entry has
+ *	completed, with i2c_device_batch_status() as its payload, and each entry
+ *	keeps its own status.
+ *
+ *	Once every entry has completed, the reads with a check, such as a CRC, are
+ *	checked. A read that fails gets I2C_STATUS_CHECKSUM and counts in the
+ *	check_errors of its device. The whole batch is then run again, up to
+ *	check_retries times, before the event is posted, so the entries always
+ *	come from the same run.
+ *
+ *	If a bus queue does not have room for all of its entries nothing is
+ *	queued, so a batch never runs in part.
+ *
+ * @note
+ *	A command with a conversion time still releases the bus while its device
+ *	converts, and the entries behind it on that bus wait for it. Put those
+ *	commands last, or on their own bus.
+ *	The batch and its entries are used in place until the batch event.
+ *
+ * @param[in] batch
+ * 	The entries and the event of the batch.
+ *
+ * @return
+ * 	true if the batch was queued, false if a bus queue was too full.
+ *
+ ******************************************************************************/
+bool i2c_device_batch(I2C_BATCH_STRUCT *batch){
+	batch->attempt = 0;
+	return i2c_device_batch_queue(batch);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Queues every entry of a batch
+ *
+ * @details
+ *	Also used to run a batch again from the I2C interrupt handler, while the
+ *	last entry is still at the head of its queue.
+ *
+ * @param[in] batch
+ * 	The batch.
+ *
+ * @return
+ * 	true if the batch was queued, false if a bus queue was too full.
+ *
+ ******************************************************************************/
+static bool i2c_device_batch_queue(I2C_BATCH_STRUCT *batch){
+	uint32_t needed[I2C_BUSES] = {0};
+	I2C_START_STRUCT start_struct;
+	EFM_ASSERT(batch->count > 0);
+
+	uint32_t primask = critical_enter();
+	for(int i = 0; i < batch->count; i++){
+		I2C_TypeDef *i2c = batch->entries[i].device->i2c;
+		EFM_ASSERT(i2c == I2C0 || i2c == I2C1);
+		needed[i2c == I2C0 ? 0 : 1]++;
+	}
+	if(needed[0] + i2c_queue_depth(I2C0) > I2C_QUEUE_SIZE
+			|| needed[1] + i2c_queue_depth(I2C1) > I2C_QUEUE_SIZE){
+		critical_exit(primask);
+		return false;
+	}
+	batch->pending = batch->count;
+	for(int i = 0; i < batch->count; i++){
+		I2C_BATCH_ENTRY_STRUCT *entry = &batch->entries[i];
+		i2c_device_start(entry->device, entry->command, 0, &entry->status,
+				i2c_device_batch_done, batch, &start_struct);
+		if(!i2c_start(entry->device->i2c, &start_struct)){
+			EFM_ASSERT(false); // room was checked above, with interrupts masked
+		}
+	}
+	critical_exit(primask);
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Counts down the entries of a batch
+ *
+ * @details
+ *	Called from the I2C interrupt handler as each entry completes. The last
+ *	one checks the reads, and either runs the batch again or posts the batch
+ *	event with the status of the batch as its payload.
+ *
+ * @param[in] arg
+ * 	The batch.
+ *
+ ******************************************************************************/
+static void i2c_device_batch_done(void *arg){
+	I2C_BATCH_STRUCT *batch = arg;
+	batch->pending--;
+	if(batch->pending){
+		return;
+	}
+	if(!i2c_device_batch_check(batch)){
+		if(batch->attempt < batch->check_retries && i2c_device_batch_queue(batch)){
+			batch->attempt++;
+			batch->reruns++;
+			return;
+		}
+		batch->check_failures++;
+	}
+	if(batch->event){
+		scheduler_post(batch->event, i2c_device_batch_status(batch));
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs the checks of the reads of a completed batch
+ *
+ * @param[in] batch
+ * 	The batch.
+ *
+ * @return
+ * 	false if a read failed its check.
+ *
+ ******************************************************************************/
+static bool i2c_device_batch_check(I2C_BATCH_STRUCT *batch){
+	bool passed = true;
+	for(int i = 0; i < batch->count; i++){
+		I2C_BATCH_ENTRY_STRUCT *entry = &batch->entries[i];
+		const I2C_COMMAND_STRUCT *cmd = &entry->device->commands[entry->command];
+		if(entry->status == I2C_STATUS_OK && cmd->check
+				&& !cmd->check(cmd->read_arr, cmd->read_length)){
+			entry->status = I2C_STATUS_CHECKSUM;
+			entry->device->check_errors++;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Reports whether every entry of a batch succeeded
+ *
+ * @param[in] batch
+ * 	A completed batch.
+ *
+ * @return
+ * 	true if every entry completed with I2C_STATUS_OK.
+ *
+ ******************************************************************************/
+bool i2c_device_batch_ok(const I2C_BATCH_STRUCT *batch){
+	return i2c_device_batch_status(batch) == I2C_STATUS_OK;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns why a batch failed
+ *
+ * @param[in] batch
+ * 	A completed batch.
+ *
+ * @return
+ * 	The status of the first entry that failed, or I2C_STATUS_OK.
+ *
+ ******************************************************************************/
+I2C_STATUS i2c_device_batch_status(const I2C_BATCH_STRUCT *batch){
+	for(int i = 0; i < batch->count; i++){
+		if(batch->entries[i].status != I2C_STATUS_OK) return batch->entries[i].status;
+	}
+	return I2C_STATUS_OK;
+}
@@ -20,6 +20,7 @@
 //** User/developer include files
 #include "letimer.h"
 #include "scheduler.h"
+#include "cycle_count.h"
 
 //***********************************************************************************
 // defined files
@@ -36,6 +37,23 @@
 static uint32_t scheduled_comp0_evt;
 static uint32_t scheduled_comp1_evt;
 static uint32_t scheduled_uf_evt;
+static uint8_t letimer_sleep_token = SLEEP_TOKEN_NONE;
+
+static LETIMER_TIMER_STRUCT timers[LETIMER_TIMER_MAX];
+static uint8_t timer_head;					// timer with the nearest deadline
+static volatile uint32_t timer_epoch;		// ticks at the start of the current period
+static uint32_t timer_top;					// COMP0, the counter reload value
+static LETIMER_TIMER_BENCH_STRUCT timer_bench_results[LETIMER_TIMER_BENCH_CASES];
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static uint32_t timer_start(uint32_t ms, bool periodic, uint32_t event, LETIMER_TIMER_FUNC callback, void *arg);
+static uint32_t timer_now(uint32_t *cnt);
+static void timer_insert(uint8_t id);
+static void timer_unlink(uint8_t id);
+static void timer_expire(void);
+static void timer_arm(uint32_t now, uint32_t cnt);
 
 //***********************************************************************************
 // functions
@@ -104,6 +122,7 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 	 */
 	uint16_t period_cnt = app_letimer_struct->period * LETIMER_HZ;
 	LETIMER_CompareSet(letimer, 0, (uint32_t)period_cnt);
+	timer_top = period_cnt;
 
 	uint16_t act_period_cnt = app_letimer_struct->active_period * LETIMER_HZ;
 	LETIMER_CompareSet(letimer, 1, (uint32_t)act_period_cnt);
@@ -119,6 +138,16 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 	letimer->ROUTEPEN = ((app_letimer_struct->out_pin_1_en << 1) | app_letimer_struct->out_pin_0_en);
 	letimer->ROUTELOC0 = ((app_letimer_struct->out_pin_route1 << 8) | app_letimer_struct->out_pin_route0);
 
+	/* COMP1 is the moving deadline compare of the software timers, see
+	 * letimer_timer_start(), so it cannot also be an application interrupt.
+	 */
+	EFM_ASSERT(!app_letimer_struct->comp1_irq_enable);
+	timer_head = LETIMER_TIMER_NONE;
+	timer_epoch = 0;
+	for(int i = 0; i < LETIMER_TIMER_MAX; i++){
+		timers[i].active = false;
+	}
+
 	/* Enable interrupts now */
 
 	uint32_t interrupts = (app_letimer_struct->uf_irq_enable << 2 )
@@ -138,7 +167,7 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
 	/* We will not enable the LETIMER0 at this time */
 
 	if(letimer->STATUS & LETIMER_STATUS_RUNNING){
-		sleep_block_mode(LETIMER_EM); // add EM4 to sleep block.
+		letimer_sleep_token = sleep_block_acquire(LETIMER_EM, SLEEP_OWNER_LETIMER); // add EM4 to sleep block.
 	}
 
 	while(letimer->SYNCBUSY);
@@ -169,9 +198,10 @@ void letimer_pwm_open(LETIMER_TypeDef *letimer, APP_LETIMER_PWM_TypeDef *app_let
  ******************************************************************************/
 void letimer_start(LETIMER_TypeDef *letimer, bool enable){
 	if(enable && !(letimer->STATUS & LETIMER_STATUS_RUNNING)){ // if we want to enable it and it is currently not running
-		sleep_block_mode(LETIMER_EM); // block EM4
+		letimer_sleep_token = sleep_block_acquire(LETIMER_EM, SLEEP_OWNER_LETIMER); // block EM4
 	} else if(!enable && (letimer->STATUS & LETIMER_STATUS_RUNNING)){
-		sleep_unblock_mode(LETIMER_EM);
+		sleep_block_release(letimer_sleep_token);
+		letimer_sleep_token = SLEEP_TOKEN_NONE;
 	}
 	LETIMER_Enable(letimer, enable);
 	while(letimer->SYNCBUSY);
@@ -187,7 +217,9 @@ void letimer_start(LETIMER_TypeDef *letimer, bool enable){
  * @note
  *   Interrupts are enabled in letimer_pwm_open() and can be enabled by modifying
  *   the comp0_irq_enable, comp1_irq_enable, or uf_irq_enable fields in the
- *   APP_LETIMER_PWM struct.
+ *   APP_LETIMER_PWM struct. The underflow event is posted to the scheduler
+ *   message queue with the time base of the new period as its payload, so it
+ *   must be registered with scheduler_register_msg().
  *
  *
  ******************************************************************************/
@@ -196,17 +228,433 @@ void LETIMER0_IRQHandler(void){
 	uint32_t int_flag;
 	int_flag = LETIMER0->IF & LETIMER0->IEN;
 	LETIMER0->IFC = int_flag;
+	if(int_flag & LETIMER_IF_UF){
+		timer_epoch += timer_top + 1; // the counter reloaded from COMP0
+	}
 	if(int_flag & LETIMER_IF_COMP0){
 		EFM_ASSERT(!(LETIMER0->IF & LETIMER_IF_COMP0));
 		add_scheduled_event(scheduled_comp0_evt);
 	}
 	if(int_flag & LETIMER_IF_COMP1){
 		EFM_ASSERT(!(LETIMER0->IF & LETIMER_IF_COMP1));
-		add_scheduled_event(scheduled_comp1_evt);
 	}
 	if(int_flag & LETIMER_IF_UF){
 		EFM_ASSERT(!(LETIMER0->IF & LETIMER_IF_UF));
-		add_scheduled_event(scheduled_uf_evt);
+		scheduler_post(scheduled_uf_evt, timer_epoch); // one message per period, none merged
+	}
+	if(int_flag & (LETIMER_IF_COMP1 | LETIMER_IF_UF)){
+		timer_expire(); // post expired timers and move COMP1 to the next deadline
+	}
+
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Starts a software timer on LETIMER0
+ *
+ * @details
+ * 	 Any number of one-shot and periodic timers, up to LETIMER_TIMER_MAX, share
+ * 	 LETIMER0. Active timers are kept in a list ordered by deadline, and COMP1
+ * 	 is moved to the nearest deadline whenever it falls within the current
+ * 	 LETIMER period. Later deadlines are re-evaluated at each underflow. Every
+ * 	 expiry posts the timer's scheduler event, so the core can sleep in EM2 or
+ * 	 EM3 between deadlines instead of busy waiting.
+ *
+ * @note
+ * 	 The resolution is one LETIMER tick (1 ms with the ULFRCO) and a timer may
+ * 	 expire up to LETIMER_TIMER_MARGIN ticks early, which covers the time a COMP1
+ * 	 write takes to synchronize into the low frequency domain. Timers only
+ * 	 advance while LETIMER0 is running, and the PWM outputs must be disabled
+ * 	 because COMP1 no longer holds the active period.
+ *
+ * @param[in] ms
+ *   Delay until the first expiry, and the period of a periodic timer.
+ *
+ * @param[in] periodic
+ *   True to restart the timer each time it expires.
+ *
+ * @param[in] event
+ *   The scheduler event posted each time the timer expires.
+ *
+ * @return
+ *   The handle used to cancel the timer.
+ *
+ ******************************************************************************/
+uint32_t letimer_timer_start(uint32_t ms, bool periodic, uint32_t event){
+	return timer_start(ms, periodic, event, 0, 0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Starts a one-shot software timer that calls a function
+ *
+ * @details
+ * 	 Works like letimer_timer_start(), but on expiry the callback is called
+ * 	 directly instead of posting a scheduler event. This lets a driver act at
+ * 	 the deadline, for example to restart a peripheral, without a pass through
+ * 	 the main loop.
+ *
+ * @note
+ * 	 The callback runs in the LETIMER0 IRQ handler, or with interrupts masked
+ * 	 if the timer is already due when started, so it must be short. Delays of
+ * 	 LETIMER_TIMER_MARGIN ticks or less expire before this function returns.
+ *
+ * @param[in] ms
+ *   Delay until the expiry.
+ *
+ * @param[in] callback
+ *   Function called on expiry.
+ *
+ * @param[in] arg
+ *   Passed to the callback.
+ *
+ * @return
+ *   The handle used to cancel the timer.
+ *
+ ******************************************************************************/
+uint32_t letimer_timer_start_cb(uint32_t ms, LETIMER_TIMER_FUNC callback, void *arg){
+	EFM_ASSERT(callback);
+	return timer_start(ms, false, 0, callback, arg);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns whether the software timers are advancing
+ *
+ * @return
+ *   True if LETIMER0 is running with its underflow interrupt enabled, so
+ *   started timers will expire.
+ *
+ ******************************************************************************/
+bool letimer_timer_running(void){
+	return (LETIMER0->STATUS & LETIMER_STATUS_RUNNING) && (LETIMER0->IEN & LETIMER_IF_UF);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Adds a timer to the deadline list
+ *
+ * @details
+ * 	 Shared by the event and callback versions of the timer start. The
+ * 	 generation of the slot is advanced, skipping 0, and returned with the id
+ * 	 as the handle, so a handle only ever names this one start of the slot.
+ *
+ ******************************************************************************/
+static uint32_t timer_start(uint32_t ms, bool periodic, uint32_t event, LETIMER_TIMER_FUNC callback, void *arg){
+	uint32_t ticks = ms * LETIMER_HZ / 1000;
+	uint32_t cnt;
+	uint8_t id;
+
+	EFM_ASSERT(!periodic || ticks > LETIMER_TIMER_MARGIN);
+	EFM_ASSERT(LETIMER0->IEN & LETIMER_IF_UF);	// underflows advance the time base
+	EFM_ASSERT(!LETIMER0->ROUTEPEN);				// COMP1 does not drive a PWM output
+
+	uint32_t primask = critical_enter();
+	for(id = 0; id < LETIMER_TIMER_MAX; id++){
+		if(!timers[id].active) break;
+	}
+	EFM_ASSERT(id < LETIMER_TIMER_MAX); // out of timers
+
+	timers[id].generation = (timers[id].generation + 1) & LETIMER_TIMER_GEN_MASK;
+	if(timers[id].generation == 0) timers[id].generation = 1;
+	uint32_t handle = (timers[id].generation << LETIMER_TIMER_GEN_SHIFT) | id;
+	timers[id].active = true;
+	timers[id].deadline = timer_now(&cnt) + ticks;
+	timers[id].period = periodic ? ticks : 0;
+	timers[id].event = event;
+	timers[id].callback = callback;
+	timers[id].arg = arg;
+	timer_insert(id);
+	timer_expire();
+	critical_exit(primask);
+
+	return handle;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Cancels a software timer
+ *
+ * @details
+ * 	 Removes the timer from the deadline list. If it was the next to expire,
+ * 	 COMP1 is moved to the following deadline. Cancelling a timer that already
+ * 	 expired is allowed and has no effect.
+ *
+ * @note
+ * 	 A one-shot timer frees its slot when it expires, and the next start can
+ * 	 reuse it. The generation in the handle then no longer matches, so a late
+ * 	 cancel with the old handle leaves the new timer running.
+ *
+ * @param[in] handle
+ *   The handle returned by letimer_timer_start() or letimer_timer_start_cb(),
+ *   or LETIMER_TIMER_HANDLE_NONE.
+ *
+ ******************************************************************************/
+void letimer_timer_cancel(uint32_t handle){
+	uint8_t id = handle & ((1u << LETIMER_TIMER_GEN_SHIFT) - 1);
+	uint32_t generation = handle >> LETIMER_TIMER_GEN_SHIFT;
+	EFM_ASSERT(id < LETIMER_TIMER_MAX);
+	uint32_t primask = critical_enter();
+	if(timers[id].active && timers[id].generation == generation){
+		timers[id].active = false;
+		timer_unlink(id);
+		timer_expire();
+	}
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the software timer time base
+ *
+ * @return
+ *   LETIMER ticks counted while LETIMER0 was running. Wraps after 2^32 ticks,
+ *   compare readings with unsigned subtraction.
+ *
+ ******************************************************************************/
+uint32_t letimer_timer_now(void){
+	uint32_t cnt;
+	uint32_t primask = critical_enter();
+	uint32_t now = timer_now(&cnt);
+	critical_exit(primask);
+	return now;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the time until LETIMER0 next wakes the core
+ *
+ * @details
+ * 	 The next wake up is the nearest software timer deadline or the next
+ * 	 underflow, whichever comes first. This is registered with the sleep
+ * 	 routines so they can choose an energy mode that suits the sleep length.
+ *
+ * @return
+ *   Microseconds until the next LETIMER0 interrupt, or SLEEP_NO_DEADLINE if
+ *   LETIMER0 is not running.
+ *
+ ******************************************************************************/
+uint32_t letimer_timer_next_us(void){
+	uint32_t cnt, ticks;
+	if(!(LETIMER0->STATUS & LETIMER_STATUS_RUNNING)) return SLEEP_NO_DEADLINE;
+
+	uint32_t primask = critical_enter();
+	uint32_t now = timer_now(&cnt);
+	ticks = cnt + 1; // ticks to the underflow
+	if(timer_head != LETIMER_TIMER_NONE){
+		int32_t remaining = timers[timer_head].deadline - now;
+		if(remaining < 0) remaining = 0;
+		if((uint32_t)remaining < ticks) ticks = remaining;
+	}
+	critical_exit(primask);
+
+	return ticks * (1000000 / LETIMER_HZ);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Computes the time base from the LETIMER counter
+ *
+ * @details
+ * 	 The counter counts down from COMP0, so the time is the time at the start
+ * 	 of the period plus the ticks counted down since. If an underflow is pending
+ * 	 but not yet serviced, the counter has already reloaded and the period it
+ * 	 completed is added here.
+ *
+ * @note
+ * 	 Must be called with interrupts masked.
+ *
+ * @param[out] cnt
+ *   The counter value the time was computed from.
+ *
+ ******************************************************************************/
+static uint32_t timer_now(uint32_t *cnt){
+	uint32_t epoch = timer_epoch;
+	*cnt = LETIMER0->CNT;
+	if(LETIMER0->IF & LETIMER_IF_UF){
+		*cnt = LETIMER0->CNT;
+		epoch += timer_top + 1;
+	}
+	return epoch + (timer_top - *cnt);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Inserts a timer into the deadline ordered list
+ *
+ * @details
+ * 	 Timers with equal deadlines expire in the order they were inserted.
+ *
+ ******************************************************************************/
+static void timer_insert(uint8_t id){
+	uint8_t prev = LETIMER_TIMER_NONE;
+	uint8_t cur = timer_head;
+	while(cur != LETIMER_TIMER_NONE && (int32_t)(timers[cur].deadline - timers[id].deadline) <= 0){
+		prev = cur;
+		cur = timers[cur].next;
+	}
+	timers[id].prev = prev;
+	timers[id].next = cur;
+	if(cur != LETIMER_TIMER_NONE) timers[cur].prev = id;
+	if(prev != LETIMER_TIMER_NONE) timers[prev].next = id;
+	else timer_head = id;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Removes a timer from the deadline ordered list
+ *
+ ******************************************************************************/
+static void timer_unlink(uint8_t id){
+	if(timers[id].prev != LETIMER_TIMER_NONE) timers[timers[id].prev].next = timers[id].next;
+	else timer_head = timers[id].next;
+	if(timers[id].next != LETIMER_TIMER_NONE) timers[timers[id].next].prev = timers[id].prev;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Posts the events, or calls the callbacks, of every expired timer and arms
+ *   COMP1 for the next one
+ *
+ * @details
+ * 	 Periodic timers are re-inserted one period after their previous deadline
+ * 	 so that they do not drift.
+ *
+ * @note
+ * 	 Must be called with interrupts masked or from the LETIMER0 IRQ handler.
+ *
+ ******************************************************************************/
+static void timer_expire(void){
+	uint32_t cnt;
+	uint32_t now = timer_now(&cnt);
+	while(timer_head != LETIMER_TIMER_NONE
+			&& (int32_t)(timers[timer_head].deadline - now) <= LETIMER_TIMER_MARGIN){
+		uint8_t id = timer_head;
+		timer_unlink(id);
+		if(timers[id].period){
+			timers[id].deadline += timers[id].period;
+			timer_insert(id);
+		} else {
+			timers[id].active = false; // free before the callback, which may start a timer
+		}
+		if(timers[id].callback){
+			timers[id].callback(timers[id].arg);
+		} else {
+			add_scheduled_event(timers[id].event);
+		}
+	}
+	timer_arm(now, cnt);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Moves COMP1 to the nearest deadline
+ *
+ * @details
+ * 	 If the nearest deadline is reached before the counter underflows, COMP1
+ * 	 is set to the counter value at that deadline and its interrupt enabled.
+ * 	 Otherwise the COMP1 interrupt is disabled and the next underflow arms it.
+ *
+ * @param[in] now
+ *   Time base computed from cnt.
+ *
+ * @param[in] cnt
+ *   Counter value at now.
+ *
+ ******************************************************************************/
+static void timer_arm(uint32_t now, uint32_t cnt){
+	if(timer_head != LETIMER_TIMER_NONE){
+		uint32_t remaining = timers[timer_head].deadline - now;
+		if(remaining <= cnt){
+			LETIMER_CompareSet(LETIMER0, 1, cnt - remaining);
+			LETIMER_IntClear(LETIMER0, LETIMER_IF_COMP1);
+			LETIMER_IntEnable(LETIMER0, LETIMER_IF_COMP1);
+			return;
+		}
+	}
+	LETIMER_IntDisable(LETIMER0, LETIMER_IF_COMP1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Software timer benchmark. Measures the cost of inserting, cancelling and
+ *   expiring a timer with 4, 16 and 64 active timers.
+ *
+ * @details
+ * 	 For each case the list is filled with timers at pseudo random deadlines.
+ * 	 Each iteration then counts the cycles to insert one more timer, to cancel a
+ * 	 timer from the middle of the list and to expire the nearest timer, which
+ * 	 includes posting its event. The averages are kept in the private
+ * 	 timer_bench_results array so they can be read from the debugger.
+ *
+ * @note
+ * 	 Must be called while no application timer is active, and requires
+ * 	 cycle_count_open(). The list operations are measured directly so the
+ * 	 LETIMER hardware is not touched and no application event is posted.
+ *
+ ******************************************************************************/
+void letimer_timer_bench(void){
+	static const uint32_t active[LETIMER_TIMER_BENCH_CASES] = {4, 16, LETIMER_TIMER_MAX};
+	uint32_t seed = 1;
+	uint32_t start, insert_total, cancel_total, expire_total;
+
+	EFM_ASSERT(timer_head == LETIMER_TIMER_NONE);
+	uint32_t primask = critical_enter();
+
+	for(int n = 0; n < LETIMER_TIMER_BENCH_CASES; n++){
+		uint8_t count = active[n];
+		insert_total = 0;
+		cancel_total = 0;
+		expire_total = 0;
+
+		for(uint8_t id = 0; id < count - 1; id++){
+			seed = seed * 1664525 + 1013904223;
+			timers[id].deadline = seed >> 20;
+			timers[id].period = 0;
+			timers[id].event = 0; // posting no event leaves the schedule untouched
+			timer_insert(id);
+		}
+
+		for(int iter = 0; iter < LETIMER_TIMER_BENCH_ITERATIONS; iter++){
+			uint8_t id = count - 1;
+			seed = seed * 1664525 + 1013904223;
+			timers[id].deadline = seed >> 20;
+			timers[id].period = 0;
+			timers[id].event = 0;
+
+			start = CYCLE_COUNT_GET();
+			timer_insert(id);
+			insert_total += CYCLE_COUNT_GET() - start;
+
+			uint8_t victim = (seed >> 8) % count;
+			start = CYCLE_COUNT_GET();
+			timer_unlink(victim);
+			cancel_total += CYCLE_COUNT_GET() - start;
+			timer_insert(victim);
+
+			start = CYCLE_COUNT_GET();
+			uint8_t head = timer_head;
+			timer_unlink(head);
+			add_scheduled_event(timers[head].event);
+			expire_total += CYCLE_COUNT_GET() - start;
+
+			// keep count - 1 timers active for the next iteration
+			if(head != id){
+				timer_unlink(id);
+				timers[head].deadline = timers[id].deadline;
+				timer_insert(head);
+			}
+		}
+
+		while(timer_head != LETIMER_TIMER_NONE){
+			timer_unlink(timer_head);
+		}
+
+		timer_bench_results[n].timers = count;
+		timer_bench_results[n].insert_cycles = insert_total / LETIMER_TIMER_BENCH_ITERATIONS;
+		timer_bench_results[n].cancel_cycles = cancel_total / LETIMER_TIMER_BENCH_ITERATIONS;
+		timer_bench_results[n].expire_cycles = expire_total / LETIMER_TIMER_BENCH_ITERATIONS;
 	}
 
+	critical_exit(primask);
 }
@@ -38,6 +38,7 @@ typedef struct {
 	char*				string;
 	uint8_t				string_length;
 	uint8_t				char_index;
+	uint8_t				sleep_token;	// EM3 block held while transmitting
 } LEUART_PAYLOAD_STRUCT;
 //***********************************************************************************
 // private variables
@@ -200,7 +201,7 @@ void leuart_start(LEUART_TypeDef *leuart, char *string, uint32_t string_len){
 	EFM_ASSERT(leuart_payload.state == LEUART_IDLE); // state must be idle
 
 	leuart_payload.state = LEUART_START;
-	sleep_block_mode(LEUART_TX_EM_BLOCK);
+	leuart_payload.sleep_token = sleep_block_acquire(LEUART_TX_EM_BLOCK, SLEEP_OWNER_LEUART);
 
 	EFM_ASSERT(string_len > 0);
 	leuart_payload.leuart = leuart;
@@ -277,7 +278,7 @@ static void leuart_txc(void){
 		break;
 	case LEUART_END_OF_DATA:
 		LEUART_IntDisable(leuart_payload.leuart, LEUART_IEN_TXC);
-		sleep_unblock_mode(LEUART_TX_EM_BLOCK);
+		sleep_block_release(leuart_payload.sleep_token);
 		leuart_payload.state = LEUART_IDLE;
 		add_scheduled_event(tx_done_evt);
 		// Disable TXC
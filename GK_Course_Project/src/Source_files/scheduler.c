@@ -13,14 +13,18 @@
 //** Silicon Lab include files
 #include "em_emu.h"
 #include "em_assert.h"
+#include <stdbool.h>
 
 //** User/developer include files
 #include "scheduler.h"
+#include "cycle_count.h"
 
 //***********************************************************************************
 // defined files
 //***********************************************************************************
 #define CLEAR_SCHEDULER 0
+#define EVENT_BIT(event)	(31 - __CLZ(event))	// index of the highest set bit
+#define QUEUE_MASK			(SCHEDULER_QUEUE_SIZE - 1)
 
 //***********************************************************************************
 // global variables
@@ -30,7 +34,44 @@
 //***********************************************************************************
 // private variables
 //***********************************************************************************
-static unsigned int event_scheduled;
+static volatile uint32_t event_scheduled;
+static uint32_t registered_events;
+static SCHEDULER_HANDLER event_handler[SCHEDULER_MAX_EVENTS];
+static uint32_t priority_events[SCHEDULER_PRIORITIES];	// events registered at each priority
+static uint32_t higher_events[SCHEDULER_PRIORITIES];	// events registered above each priority
+static uint32_t preempt_events;
+static volatile uint32_t post_time[SCHEDULER_MAX_EVENTS];
+static SCHEDULER_LATENCY_STRUCT latency[SCHEDULER_PRIORITIES + 1];	// and the message queue
+static SCHEDULER_HISTOGRAM_STRUCT latency_histogram;
+
+// Message queue. A slot can be written by the producer that reserved index
+// pos when its sequence equals pos, and read by the consumer when its sequence
+// equals pos + 1. Consuming it hands it to index pos + SCHEDULER_QUEUE_SIZE.
+typedef struct {
+	volatile uint32_t		sequence;
+	SCHEDULER_MSG_STRUCT	msg;
+} SCHEDULER_QUEUE_SLOT;
+
+static SCHEDULER_QUEUE_SLOT queue[SCHEDULER_QUEUE_SIZE];
+static volatile uint32_t queue_tail;	// next index to reserve, producers
+static uint32_t queue_head;				// next index to read, main loop only
+static volatile uint32_t queue_overflows;
+static uint32_t msg_events;
+static SCHEDULER_MSG_HANDLER msg_handler[SCHEDULER_MAX_EVENTS];
+
+static volatile uint32_t bench_events;
+static volatile uint32_t bench_handled;
+static SCHEDULER_HANDLER bench_handler_table[SCHEDULER_MAX_EVENTS];
+static SCHEDULER_BENCH_STRUCT bench_results[SCHEDULER_BENCH_CASES];
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static bool dispatch_events(uint32_t pending, SCHEDULER_HANDLER *handler_table,
+		uint32_t preempt_mask, SCHEDULER_LATENCY_STRUCT *stats);
+static void dispatch_msgs(void);
+static void latency_record(SCHEDULER_LATENCY_STRUCT *stats, uint32_t wait);
+static void bench_handler(void);
 
 //***********************************************************************************
 // functions
@@ -41,13 +82,35 @@ static unsigned int event_scheduled;
  *   Initialize the scheduler
  *
  * @details
- * 	 This routine resets the #event_scheduled variable to empty.
+ * 	 This routine resets the #event_scheduled variable to empty and removes
+ * 	 all registered event handlers.
  *
  *
  ******************************************************************************/
 
 void scheduler_open(void){
 	event_scheduled = CLEAR_SCHEDULER;
+	registered_events = CLEAR_SCHEDULER;
+	preempt_events = CLEAR_SCHEDULER;
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++){
+		event_handler[i] = 0;
+	}
+	for(int i = 0; i < SCHEDULER_PRIORITIES; i++){
+		priority_events[i] = CLEAR_SCHEDULER;
+		higher_events[i] = CLEAR_SCHEDULER;
+	}
+	scheduler_latency_reset();
+
+	msg_events = CLEAR_SCHEDULER;
+	queue_tail = 0;
+	queue_head = 0;
+	queue_overflows = 0;
+	for(uint32_t i = 0; i < SCHEDULER_QUEUE_SIZE; i++){
+		queue[i].sequence = i;
+	}
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++){
+		msg_handler[i] = 0;
+	}
 }
 
 /***************************************************************************//**
@@ -55,10 +118,17 @@ void scheduler_open(void){
  *   Adds an event to the schedule
  *
  * @details
- * 	 This routine adds an event to the #event_scheduled variable
+ * 	 This routine adds an event to the #event_scheduled variable using an
+ * 	 exclusive load/store pair. If an interrupt posts an event between the
+ * 	 LDREX and the STREX, the exception clears the exclusive monitor, the
+ * 	 store fails and the read-modify-write is retried, so no event is lost.
+ *
+ * 	 The cycle count of every event that was not already pending is recorded
+ * 	 so that scheduler_dispatch() can measure how long it waited.
  *
  * @note
- * 	This function is atomic.
+ * 	This function is atomic and never masks interrupts, so it is safe to call
+ * 	from any ISR or from a critical section without changing its state.
  *
  * @param[in] event
  * 	A 32 bit integer that contains events that you want to add.
@@ -66,9 +136,18 @@ void scheduler_open(void){
  ******************************************************************************/
 
 void add_scheduled_event(uint32_t event){
-	__disable_irq();
-	event_scheduled |= event;
-	__enable_irq();
+	uint32_t events, added;
+	do {
+		events = __LDREXW(&event_scheduled);
+		added = event & ~events;
+	} while(__STREXW(events | event, &event_scheduled));
+
+	uint32_t now = CYCLE_COUNT_GET();
+	while(added){
+		uint32_t bit = EVENT_BIT(added);
+		added &= ~(1u << bit);
+		post_time[bit] = now;
+	}
 }
 
 /***************************************************************************//**
@@ -76,10 +155,11 @@ void add_scheduled_event(uint32_t event){
  *   Removes an event to the schedule
  *
  * @details
- * 	 This routine removes an event to the #event_scheduled variable
+ * 	 This routine removes an event to the #event_scheduled variable using the
+ * 	 same exclusive load/store retry loop as add_scheduled_event().
  *
  * @note
- * 	This function is atomic.
+ * 	This function is atomic and never masks interrupts.
  *
  * @param[in] event
  * 	A 32 bit integer that contains events that you want to remove.
@@ -87,9 +167,48 @@ void add_scheduled_event(uint32_t event){
  ******************************************************************************/
 
 void remove_scheduled_event(uint32_t event){
+	uint32_t events;
+	do {
+		events = __LDREXW(&event_scheduled) & ~event;
+	} while(__STREXW(events, &event_scheduled));
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Enters a critical section
+ *
+ * @details
+ * 	 This routine saves the current PRIMASK and then masks interrupts. Unlike a
+ * 	 bare __disable_irq()/__enable_irq() pair, critical sections entered with
+ * 	 this routine can be nested: an inner critical_exit() restores the masked
+ * 	 state that the outer critical section set up instead of unmasking.
+ *
+ * @return
+ * 	The PRIMASK value before entry, which must be passed to critical_exit().
+ *
+ ******************************************************************************/
+
+uint32_t critical_enter(void){
+	uint32_t primask = __get_PRIMASK();
 	__disable_irq();
-	event_scheduled &= ~event;
-	__enable_irq();
+	return primask;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Exits a critical section
+ *
+ * @details
+ * 	 This routine restores the PRIMASK saved by the matching critical_enter().
+ * 	 Interrupts are only re-enabled if they were enabled at entry.
+ *
+ * @param[in] primask
+ * 	The value returned by the matching critical_enter().
+ *
+ ******************************************************************************/
+
+void critical_exit(uint32_t primask){
+	__set_PRIMASK(primask);
 }
 
 
@@ -108,3 +227,465 @@ void remove_scheduled_event(uint32_t event){
 uint32_t get_scheduled_events(void){
 	return event_scheduled;
 }
+
+/***************************************************************************//**
+ * @brief
+ *   Registers the function that services an event.
+ *
+ * @details
+ * 	 This routine stores the handler in the handler table at the index of the
+ * 	 event's bit, so that scheduler_dispatch() can find it without searching.
+ * 	 Adding a new event to the application only requires defining its bit and
+ * 	 registering its handler.
+ *
+ * 	 Events posted with scheduler_post() are dispatched first, in the order
+ * 	 they were posted. Scheduled events follow, highest priority first. An
+ * 	 event registered with preempt set also interrupts a dispatch pass that
+ * 	 is servicing lower priority events: once the running handler returns,
+ * 	 dispatch starts over from the highest priority.
+ *
+ * @note
+ * 	 Must be called after scheduler_open(). The handler is responsible for
+ * 	 removing its event from the schedule.
+ *
+ * @param[in] event
+ * 	A 32 bit integer with exactly one bit set identifying the event.
+ *
+ * @param[in] handler
+ * 	The function that will be called when the event is scheduled.
+ *
+ * @param[in] priority
+ * 	SCHEDULER_PRIORITY_LOW, SCHEDULER_PRIORITY_MEDIUM or SCHEDULER_PRIORITY_HIGH.
+ *
+ * @param[in] preempt
+ * 	True if this event may cut short the servicing of lower priority events.
+ *
+ ******************************************************************************/
+
+void scheduler_register(uint32_t event, SCHEDULER_HANDLER handler, uint32_t priority, bool preempt){
+	EFM_ASSERT(event && !(event & (event - 1))); // must be exactly one event bit
+	EFM_ASSERT(handler);
+	EFM_ASSERT(priority < SCHEDULER_PRIORITIES);
+	EFM_ASSERT(!((registered_events | msg_events) & event)); // each event has one handler
+
+	event_handler[EVENT_BIT(event)] = handler;
+	registered_events |= event;
+	priority_events[priority] |= event;
+	for(uint32_t i = 0; i < priority; i++){
+		higher_events[i] |= event;
+	}
+	if(preempt){
+		preempt_events |= event;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Services every scheduled event that has a registered handler.
+ *
+ * @details
+ * 	 This routine first drains the message queue, calling the handler of each
+ * 	 message in the order they were posted. It then services the scheduled
+ * 	 events one priority level at a time,
+ * 	 starting from SCHEDULER_PRIORITY_HIGH. Each level takes its own snapshot of
+ * 	 #event_scheduled, so events posted by a higher level's handlers are seen by
+ * 	 the lower levels in the same pass. If a preempting event of a higher
+ * 	 priority than the level being serviced is posted, the pass starts over
+ * 	 from the highest priority.
+ *
+ * @note
+ * 	 Events without a registered handler are left in the schedule.
+ *
+ ******************************************************************************/
+
+void scheduler_dispatch(void){
+	dispatch_msgs();
+
+	int priority = SCHEDULER_PRIORITIES - 1;
+	while(priority >= 0){
+		bool preempted = dispatch_events(event_scheduled & priority_events[priority],
+				event_handler, preempt_events & higher_events[priority], &latency[priority]);
+		priority = preempted ? (SCHEDULER_PRIORITIES - 1) : (priority - 1);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Calls the handler of every bit set in pending.
+ *
+ * @details
+ * 	 Each pass finds the highest pending bit with a single count leading zeros
+ * 	 instruction and clears it, so the cost of a dispatch is proportional to the
+ * 	 number of pending events rather than the number of registered events.
+ *
+ * @param[in] pending
+ * 	The events to service. Every bit must have a handler in handler_table.
+ *
+ * @param[in] handler_table
+ * 	The table of handlers indexed by event bit.
+ *
+ * @param[in] preempt_mask
+ * 	Scheduled events that stop the walk after the running handler returns.
+ *
+ * @param[in] stats
+ * 	Latency statistics to update, or 0 to skip the measurement.
+ *
+ * @return
+ * 	True if the walk was stopped by an event in preempt_mask.
+ *
+ ******************************************************************************/
+
+static bool dispatch_events(uint32_t pending, SCHEDULER_HANDLER *handler_table,
+		uint32_t preempt_mask, SCHEDULER_LATENCY_STRUCT *stats){
+	while(pending){
+		uint32_t bit = EVENT_BIT(pending);
+		pending &= ~(1u << bit);
+		if(stats){
+			latency_record(stats, CYCLE_COUNT_GET() - post_time[bit]);
+		}
+		handler_table[bit]();
+		if(event_scheduled & preempt_mask) return true;
+	}
+	return false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Adds one dispatch to the latency statistics
+ *
+ * @details
+ * 	 Updates the statistics of the priority level or queue, and the histogram
+ * 	 of every dispatch. Bin n of the histogram counts the waits of n
+ * 	 significant bits, from 2^(n-1) up to 2^n - 1 cycles, and bin 0 a wait of
+ * 	 0. The last bin also takes every longer wait. Finding the bin is a single
+ * 	 count leading zeros instruction.
+ *
+ * @param[in] stats
+ * 	The statistics of the priority level or of the message queue.
+ *
+ * @param[in] wait
+ * 	Core cycles from the post to the call of the handler.
+ *
+ ******************************************************************************/
+
+static void latency_record(SCHEDULER_LATENCY_STRUCT *stats, uint32_t wait){
+	stats->count++;
+	stats->total_cycles += wait;
+	if(wait > stats->max_cycles) stats->max_cycles = wait;
+
+	uint32_t bin = 32 - __CLZ(wait);
+	if(bin >= SCHEDULER_LATENCY_BINS) bin = SCHEDULER_LATENCY_BINS - 1;
+	latency_histogram.bins[bin]++;
+	latency_histogram.count++;
+	if(wait > latency_histogram.max_cycles) latency_histogram.max_cycles = wait;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the dispatch latency statistics of one priority level
+ *
+ * @details
+ * 	 The latency of an event is the number of core cycles between it being
+ * 	 added to the schedule, from the CYCLE_COUNT_GET() of the posting ISR, and
+ * 	 its handler being called. SCHEDULER_LATENCY_QUEUE reports the messages
+ * 	 of the queue, timed from their timestamp.
+ *
+ * @note
+ * 	 The cycle counter stops in EM2 and EM3, so the time spent asleep before
+ * 	 the posting interrupt is not included. What is measured is the time an
+ * 	 event waits behind other handlers, and the time from the post to the
+ * 	 dispatch of an event posted just as the main loop went to sleep.
+ * 	 sleep_if_idle() does not sleep over an event, so that wait never stops
+ * 	 the counter.
+ *
+ * @param[in] priority
+ * 	The priority level to report, or SCHEDULER_LATENCY_QUEUE.
+ *
+ * @param[out] stats
+ * 	Copy of the statistics of that priority level.
+ *
+ ******************************************************************************/
+
+void scheduler_latency_get(uint32_t priority, SCHEDULER_LATENCY_STRUCT *stats){
+	EFM_ASSERT(priority <= SCHEDULER_LATENCY_QUEUE);
+	*stats = latency[priority];
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the dispatch latency histogram
+ *
+ * @details
+ * 	 Covers every event and message dispatched since the last reset, with the
+ * 	 worst case of them all. See latency_record() for the bins.
+ *
+ * @note
+ * 	 Must be called from the main loop, which is the only place the
+ * 	 histogram is updated.
+ *
+ * @param[out] histogram
+ * 	Where the histogram is copied.
+ *
+ ******************************************************************************/
+
+void scheduler_latency_histogram(SCHEDULER_HISTOGRAM_STRUCT *histogram){
+	*histogram = latency_histogram;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Clears the dispatch latency statistics of every priority level, of the
+ *   message queue and the histogram
+ *
+ ******************************************************************************/
+
+void scheduler_latency_reset(void){
+	for(int i = 0; i <= SCHEDULER_LATENCY_QUEUE; i++){
+		latency[i].count = 0;
+		latency[i].total_cycles = 0;
+		latency[i].max_cycles = 0;
+	}
+	latency_histogram.count = 0;
+	latency_histogram.max_cycles = 0;
+	for(int i = 0; i < SCHEDULER_LATENCY_BINS; i++){
+		latency_histogram.bins[i] = 0;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Registers the function that services a queued event.
+ *
+ * @details
+ * 	 Events delivered through the message queue carry a payload and are not
+ * 	 merged with earlier occurrences, so every scheduler_post() results in one
+ * 	 call of the handler. They use the same event bit numbering as the bitmask
+ * 	 events but an event can only be registered one way.
+ *
+ * @param[in] event
+ * 	A 32 bit integer with exactly one bit set identifying the event.
+ *
+ * @param[in] handler
+ * 	The function called with each message posted for this event.
+ *
+ ******************************************************************************/
+
+void scheduler_register_msg(uint32_t event, SCHEDULER_MSG_HANDLER handler){
+	EFM_ASSERT(event && !(event & (event - 1))); // must be exactly one event bit
+	EFM_ASSERT(handler);
+	EFM_ASSERT(!((registered_events | msg_events) & event)); // each event has one handler
+
+	msg_handler[EVENT_BIT(event)] = handler;
+	msg_events |= event;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Posts an event with a payload to the message queue
+ *
+ * @details
+ * 	 The queue is a fixed size ring that any number of ISRs can post to while
+ * 	 the main loop reads from it. A producer reserves a slot by advancing
+ * 	 #queue_tail with an exclusive load/store, fills it in and then publishes it
+ * 	 by updating the slot's sequence number. A producer that is preempted after
+ * 	 reserving its slot does not block the ISR that preempted it.
+ *
+ * 	 A producer preempted between loading #queue_tail and reading the slot can
+ * 	 find the slot already reserved, or even published, by the ISR. Its
+ * 	 sequence is then ahead of the loaded index and the producer tries again
+ * 	 with the new tail. Only a sequence behind the index means the queue is
+ * 	 full. The difference is taken as signed so it holds across the wrap.
+ *
+ * @note
+ * 	 This function never masks interrupts. Use add_scheduled_event() for events
+ * 	 that are simple flags.
+ *
+ * @param[in] event
+ * 	An event registered with scheduler_register_msg().
+ *
+ * @param[in] payload
+ * 	32 bits of data delivered to the handler along with the event.
+ *
+ * @return
+ * 	True if the message was queued, false if the queue was full. Full queues
+ * 	are counted in scheduler_queue_overflows().
+ *
+ ******************************************************************************/
+
+bool scheduler_post(uint32_t event, uint32_t payload){
+	uint32_t pos, count;
+	SCHEDULER_QUEUE_SLOT *slot;
+
+	for(;;){
+		pos = __LDREXW(&queue_tail);
+		slot = &queue[pos & QUEUE_MASK];
+		int32_t lag = (int32_t)(slot->sequence - pos);
+		if(lag < 0){ // the consumer has not freed this slot yet
+			__CLREX();
+			do {
+				count = __LDREXW(&queue_overflows) + 1;
+			} while(__STREXW(count, &queue_overflows));
+			return false;
+		}
+		if(lag > 0){ // an interrupt took pos after the load, try the next index
+			__CLREX();
+			continue;
+		}
+		if(!__STREXW(pos + 1, &queue_tail)) break;
+	}
+
+	slot->msg.event = event;
+	slot->msg.payload = payload;
+	slot->msg.timestamp = CYCLE_COUNT_GET();
+	__DMB();
+	slot->sequence = pos + 1; // publish to the consumer
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Reads the oldest message from the queue
+ *
+ * @note
+ * 	 Must only be called from the main loop. There is one consumer.
+ *
+ * @param[out] msg
+ * 	Where the message is copied.
+ *
+ * @return
+ * 	True if a message was read, false if the queue is empty or the oldest
+ * 	message is still being written by an interrupted producer.
+ *
+ ******************************************************************************/
+
+bool scheduler_get_msg(SCHEDULER_MSG_STRUCT *msg){
+	SCHEDULER_QUEUE_SLOT *slot = &queue[queue_head & QUEUE_MASK];
+	if(slot->sequence != queue_head + 1) return false;
+
+	*msg = slot->msg;
+	__DMB();
+	slot->sequence = queue_head + SCHEDULER_QUEUE_SIZE; // free the slot
+	queue_head++;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Calls the handler of every queued message
+ *
+ * @details
+ * 	 The wait of each message, from its timestamp, is added to the latency
+ * 	 of SCHEDULER_LATENCY_QUEUE and to the histogram.
+ *
+ ******************************************************************************/
+
+static void dispatch_msgs(void){
+	SCHEDULER_MSG_STRUCT msg;
+	while(scheduler_get_msg(&msg)){
+		EFM_ASSERT(msg_events & msg.event);
+		latency_record(&latency[SCHEDULER_LATENCY_QUEUE], CYCLE_COUNT_GET() - msg.timestamp);
+		msg_handler[EVENT_BIT(msg.event)](&msg);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns whether there is nothing left to dispatch
+ *
+ * @return
+ * 	True if no bitmask event is scheduled and the message queue is empty.
+ *
+ ******************************************************************************/
+
+bool scheduler_idle(void){
+	return (event_scheduled == 0) && (queue_head == queue_tail);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the number of messages dropped because the queue was full
+ *
+ ******************************************************************************/
+
+uint32_t scheduler_queue_overflows(void){
+	return queue_overflows;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Handler used by the benchmark.
+ *
+ * @details
+ * 	 Behaves like an application handler by removing its event from the
+ * 	 benchmark schedule.
+ *
+ ******************************************************************************/
+
+static void bench_handler(void){
+	bench_events = 0;
+	bench_handled++;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Scheduler dispatch benchmark. Compares the cost of the if-chain that
+ *   main.c used to service events with scheduler_dispatch().
+ *
+ * @details
+ * 	 For 1, 8 and 32 registered events, this routine schedules only the last
+ * 	 event in the chain (the typical wake up has one event pending) and counts
+ * 	 the cycles needed to service it, averaged over SCHEDULER_BENCH_ITERATIONS.
+ * 	 The if-chain re-reads the schedule and tests every registered bit, the way
+ * 	 the original while loop in main.c did. The dispatcher uses the same table
+ * 	 walk as scheduler_dispatch().
+ *
+ * 	 The results are kept in the private bench_results array so they can be
+ * 	 read from the debugger.
+ *
+ * @note
+ * 	 Requires cycle_count_open() to have been called. The application's
+ * 	 schedule and handler table are not touched.
+ *
+ ******************************************************************************/
+
+void scheduler_bench(void){
+	static const uint32_t registered[SCHEDULER_BENCH_CASES] = {1, 8, SCHEDULER_MAX_EVENTS};
+	uint32_t start, chain_total, dispatch_total;
+
+	for(int i = 0; i < SCHEDULER_MAX_EVENTS; i++){
+		bench_handler_table[i] = bench_handler;
+	}
+
+	for(int n = 0; n < SCHEDULER_BENCH_CASES; n++){
+		uint32_t last_event = 1u << (registered[n] - 1);
+		chain_total = 0;
+		dispatch_total = 0;
+
+		for(int iter = 0; iter < SCHEDULER_BENCH_ITERATIONS; iter++){
+			// if-chain: every registered bit is tested against a fresh read
+			bench_events = last_event;
+			start = CYCLE_COUNT_GET();
+			for(uint32_t bit = 0; bit < registered[n]; bit++){
+				if(bench_events & (1u << bit)){
+					bench_handler_table[bit]();
+				}
+			}
+			chain_total += CYCLE_COUNT_GET() - start;
+
+			// dispatcher: only the pending bit is visited
+			bench_events = last_event;
+			start = CYCLE_COUNT_GET();
+			dispatch_events(bench_events, bench_handler_table, 0, 0);
+			dispatch_total += CYCLE_COUNT_GET() - start;
+		}
+
+		bench_results[n].registered = registered[n];
+		bench_results[n].chain_cycles = chain_total / SCHEDULER_BENCH_ITERATIONS;
+		bench_results[n].dispatch_cycles = dispatch_total / SCHEDULER_BENCH_ITERATIONS;
+	}
+
+	EFM_ASSERT(bench_handled == 2 * SCHEDULER_BENCH_CASES * SCHEDULER_BENCH_ITERATIONS);
+	// with 32 registered events the dispatcher must beat the chain
+	EFM_ASSERT(bench_results[SCHEDULER_BENCH_CASES - 1].dispatch_cycles
+			< bench_results[SCHEDULER_BENCH_CASES - 1].chain_cycles);
+}
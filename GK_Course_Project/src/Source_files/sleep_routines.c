@@ -36,13 +36,18 @@
 //***********************************************************************************
 
 //** Standard Libraries
+#include <string.h>
 
 //** Silicon Lab include files
 #include "em_cmu.h"
+#include "em_cryotimer.h"
 #include "em_assert.h"
 
 //** User/developer include files
 #include "sleep_routines.h"
+#include "scheduler.h"
+#include "cycle_count.h"
+#include "format.h"
 
 //***********************************************************************************
 // defined files
@@ -53,11 +58,51 @@
 // global variables
 //***********************************************************************************
 #define UNBLOCKED 0
+#define EM_BIT(em)	(0x80000000u >> (em))	// so __CLZ gives the lowest blocked mode
+
+// Approximate EFM32PG12 costs at 26 MHz with the DCDC and EM23 voltage scaling.
+// EM0 is never chosen by the policy. Replace with sleep_cost_table_set() once
+// measured on the board with Energy Profiler.
+static const SLEEP_EM_COST_STRUCT default_cost_table[EM4] = {
+	[EM0] = {0,		0,		0},
+	[EM1] = {0,		0,		1700},
+	[EM2] = {10,	60,		8},
+	[EM3] = {30,	100,	7},
+};
+
+// Interrupts counted as wake up sources, in SLEEP_WAKE_SOURCE order
+static const IRQn_Type wake_irq[SLEEP_WAKE_OTHER] = {
+	[SLEEP_WAKE_LETIMER0]	= LETIMER0_IRQn,
+	[SLEEP_WAKE_I2C0]		= I2C0_IRQn,
+	[SLEEP_WAKE_I2C1]		= I2C1_IRQn,
+	[SLEEP_WAKE_LEUART0]	= LEUART0_IRQn,
+};
 
 //***********************************************************************************
 // private variables
 //***********************************************************************************
 static int lowest_energy_mode[MAX_ENERGY_MODES];
+static uint32_t blocked_mask;		// EM_BIT(em) set while lowest_energy_mode[em] > 0
+static uint32_t sleep_race_hits;
+static SLEEP_DEADLINE_FUNC deadline_func;
+static const SLEEP_EM_COST_STRUCT *cost_table;
+static SLEEP_POLICY_STATS_STRUCT policy_stats;
+static uint32_t residency_start;
+static uint32_t residency_ticks[MAX_ENERGY_MODES];
+static uint32_t wake_count[SLEEP_WAKE_SOURCES];
+static SLEEP_TOKEN_STRUCT tokens[SLEEP_TOKEN_MAX];
+static uint32_t watchdog_bound_ms[MAX_ENERGY_MODES];
+static SLEEP_LEAK_FUNC leak_func;
+static SLEEP_BENCH_STRUCT bench_results[SLEEP_BENCH_CASES];
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static uint32_t sleep_policy_select(uint32_t deepest);
+static void sleep_residency_open(void);
+static SLEEP_WAKE_SOURCE sleep_wake_source(void);
+static uint32_t sleep_deepest_allowed(void);
+static uint32_t sleep_deepest_ladder(void);
 
 //***********************************************************************************
 // functions
@@ -69,6 +114,7 @@ static int lowest_energy_mode[MAX_ENERGY_MODES];
  *
  * @details
  * 	 Initialize private variable for sleep_routines so all energy modes are unblocked
+ * 	 and start the CRYOTIMER used for residency accounting.
  *
  ******************************************************************************/
 void sleep_open(void){
@@ -77,6 +123,38 @@ void sleep_open(void){
 	lowest_energy_mode[EM2] = UNBLOCKED;
 	lowest_energy_mode[EM3] = UNBLOCKED;
 	lowest_energy_mode[EM4] = UNBLOCKED;
+	blocked_mask = 0;
+	sleep_race_hits = 0;
+	deadline_func = 0;
+	cost_table = default_cost_table;
+	memset(&policy_stats, 0, sizeof(policy_stats));
+	memset(tokens, 0, sizeof(tokens));
+	memset(watchdog_bound_ms, 0, sizeof(watchdog_bound_ms));
+	leak_func = 0;
+	sleep_residency_open();
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Residency Open
+ *
+ * @details
+ *	Starts the CRYOTIMER as a free running counter on the ULFRCO. It keeps
+ *	counting in EM0 - EM3, so reading it before and after a sleep gives the time
+ *	spent asleep at 1 ms resolution. No CRYOTIMER interrupt is used.
+ *
+ ******************************************************************************/
+static void sleep_residency_open(void){
+	CRYOTIMER_Init_TypeDef cryotimer_init = CRYOTIMER_INIT_DEFAULT;
+
+	CMU_ClockEnable(cmuClock_CRYOTIMER, true);
+	cryotimer_init.osc = cryotimerOscULFRCO;
+	cryotimer_init.presc = cryotimerPresc_1;
+	cryotimer_init.em4Wakeup = false;
+	cryotimer_init.enable = true;
+	CRYOTIMER_Init(&cryotimer_init);
+
+	sleep_residency_reset();
 }
 
 /***************************************************************************//**
@@ -92,10 +170,11 @@ void sleep_open(void){
  *
  ******************************************************************************/
 void sleep_block_mode(uint32_t EM){
-	__disable_irq();
+	uint32_t primask = critical_enter();
 	lowest_energy_mode[EM]++;
+	blocked_mask |= EM_BIT(EM);
 	EFM_ASSERT(lowest_energy_mode[EM] < 10);
-	__enable_irq();
+	critical_exit(primask);
 }
 
 /***************************************************************************//**
@@ -111,10 +190,171 @@ void sleep_block_mode(uint32_t EM){
  *
  ******************************************************************************/
 void sleep_unblock_mode(uint32_t EM){
-	__disable_irq();
+	uint32_t primask = critical_enter();
 	lowest_energy_mode[EM]--;
+	if(lowest_energy_mode[EM] == UNBLOCKED) blocked_mask &= ~EM_BIT(EM);
 	EFM_ASSERT(lowest_energy_mode[EM] >= 0);
-	__enable_irq();
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Block Acquire
+ *
+ * @details
+ *	Blocks an energy mode like sleep_block_mode(), and records which module
+ *	holds the block and when it was taken so leaked blocks can be found with
+ *	sleep_block_owners() and sleep_watchdog_check().
+ *
+ * @param[in] EM
+ *   Unsigned 32 bit integer representing the Energy Mode (EM0 - EM4)
+ *
+ * @param[in] owner
+ *   The module taking the block.
+ *
+ * @return
+ * 	Token to pass to sleep_block_release().
+ *
+ ******************************************************************************/
+uint8_t sleep_block_acquire(uint32_t EM, SLEEP_OWNER owner){
+	EFM_ASSERT(EM < MAX_ENERGY_MODES && owner < SLEEP_OWNERS);
+	uint32_t primask = critical_enter();
+	uint8_t token;
+	for(token = 0; token < SLEEP_TOKEN_MAX; token++){
+		if(!tokens[token].in_use) break;
+	}
+	EFM_ASSERT(token < SLEEP_TOKEN_MAX); // more blocks held than SLEEP_TOKEN_MAX
+	tokens[token].in_use = true;
+	tokens[token].flagged = false;
+	tokens[token].em = EM;
+	tokens[token].owner = owner;
+	tokens[token].acquired = CRYOTIMER_CounterGet();
+	sleep_block_mode(EM);
+	critical_exit(primask);
+	return token;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Block Release
+ *
+ * @details
+ *	Releases a block taken with sleep_block_acquire().
+ *
+ * @param[in] token
+ *   Token returned by sleep_block_acquire().
+ *
+ ******************************************************************************/
+void sleep_block_release(uint8_t token){
+	EFM_ASSERT(token < SLEEP_TOKEN_MAX);
+	uint32_t primask = critical_enter();
+	EFM_ASSERT(tokens[token].in_use);
+	tokens[token].in_use = false;
+	sleep_unblock_mode(tokens[token].em);
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Block Owners
+ *
+ * @details
+ *	Returns which modules currently hold a block on an energy mode. Blocks
+ *	taken with sleep_block_mode() have no owner and are not included.
+ *
+ * @param[in] EM
+ *   Unsigned 32 bit integer representing the Energy Mode (EM0 - EM4)
+ *
+ * @return
+ * 	Bit mask with bit (1 << SLEEP_OWNER) set for each owner holding EM.
+ *
+ ******************************************************************************/
+uint32_t sleep_block_owners(uint32_t EM){
+	uint32_t owners = 0;
+	uint32_t primask = critical_enter();
+	for(uint32_t i = 0; i < SLEEP_TOKEN_MAX; i++){
+		if(tokens[i].in_use && tokens[i].em == EM) owners |= 1 << tokens[i].owner;
+	}
+	critical_exit(primask);
+	return owners;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Watchdog Register
+ *
+ * @details
+ *	Registers the function sleep_watchdog_check() calls for each block held
+ *	longer than the bound of its energy mode.
+ *
+ * @param[in] leak
+ *   Function called with the owner, energy mode and time held, outside of
+ *   any critical section. Pass 0 to only count leaks.
+ *
+ ******************************************************************************/
+void sleep_watchdog_register(SLEEP_LEAK_FUNC leak){
+	leak_func = leak;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Watchdog Bound
+ *
+ * @details
+ *	Sets how long a block on an energy mode may be held before it is
+ *	reported as leaked.
+ *
+ * @param[in] EM
+ *   Unsigned 32 bit integer representing the Energy Mode (EM0 - EM4)
+ *
+ * @param[in] max_ms
+ *   Longest expected hold time in milliseconds, or 0 to not watch EM. Blocks
+ *   held for the life of a peripheral, such as the LETIMER's EM4 block, should
+ *   not be watched.
+ *
+ ******************************************************************************/
+void sleep_watchdog_bound(uint32_t EM, uint32_t max_ms){
+	EFM_ASSERT(EM < MAX_ENERGY_MODES);
+	watchdog_bound_ms[EM] = max_ms;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Watchdog Check
+ *
+ * @details
+ *	Looks for blocks held longer than the bound of their energy mode. Each one
+ *	is reported once to the registered leak function. It is meant to be called
+ *	periodically from a scheduled event, not from an interrupt.
+ *
+ * @return
+ * 	Number of newly found leaked blocks.
+ *
+ ******************************************************************************/
+uint32_t sleep_watchdog_check(void){
+	SLEEP_TOKEN_STRUCT leaked[SLEEP_TOKEN_MAX];
+	uint32_t held_ms[SLEEP_TOKEN_MAX];
+	uint32_t count = 0;
+
+	uint32_t primask = critical_enter();
+	uint32_t now = CRYOTIMER_CounterGet();
+	for(uint32_t i = 0; i < SLEEP_TOKEN_MAX; i++){
+		uint32_t bound = watchdog_bound_ms[tokens[i].em];
+		if(!tokens[i].in_use || tokens[i].flagged || bound == 0) continue;
+		uint32_t held = (now - tokens[i].acquired) * SLEEP_TICK_MS;
+		if(held > bound){
+			tokens[i].flagged = true;
+			leaked[count] = tokens[i];
+			held_ms[count] = held;
+			count++;
+		}
+	}
+	critical_exit(primask);
+
+	for(uint32_t i = 0; i < count && leak_func; i++){
+		leak_func(leaked[i].owner, leaked[i].em, held_ms[i]);
+	}
+	return count;
 }
 
 /***************************************************************************//**
@@ -122,23 +362,318 @@ void sleep_unblock_mode(uint32_t EM){
  *   Enter Sleep
  *
  * @details
- *  Function to enter sleep mode
+ *  Function to enter sleep mode. The blocks set the deepest mode that may be
+ *  entered, and the sleep policy picks the mode to use within that limit.
  *
  ******************************************************************************/
 void enter_sleep(void){
-	if(lowest_energy_mode[EM0] > 0) return;
-	else if(lowest_energy_mode[EM1] > 0) return;
-	else if (lowest_energy_mode[EM2] > 0) {
-		EMU_EnterEM1();
-		return;
-	} else if (lowest_energy_mode[EM3] > 0){
-		EMU_EnterEM2(true);
-		return;
+	uint32_t deepest = sleep_deepest_allowed();
+	if(deepest == EM0) return;
+
+	uint32_t mode = sleep_policy_select(deepest);
+	uint32_t start = CRYOTIMER_CounterGet();
+	switch(mode){
+		case EM1:
+			EMU_EnterEM1();
+			break;
+		case EM2:
+			EMU_EnterEM2(true);
+			break;
+		default:
+			EMU_EnterEM3(true);
+			break;
+	}
+	residency_ticks[mode] += CRYOTIMER_CounterGet() - start;
+	wake_count[sleep_wake_source()]++;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Deepest Allowed
+ *
+ * @details
+ *	Finds the deepest energy mode the blocks allow with a single count leading
+ *	zeros on the blocked mask, which holds the lowest blocked mode in its
+ *	highest set bit. EM4 is never entered, so EM3 is the deepest returned.
+ *
+ * @return
+ * 	The deepest energy mode allowed (EM1 - EM3), or EM0 if sleep is blocked.
+ *
+ ******************************************************************************/
+static uint32_t sleep_deepest_allowed(void){
+	uint32_t blocked = __CLZ(blocked_mask); // 32 when nothing is blocked
+	if(blocked <= EM1) return EM0;
+	return blocked > EM4 ? EM3 : blocked - 1;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Deepest Ladder
+ *
+ * @details
+ *	The if/else ladder enter_sleep() used before the blocked mask. Only kept as the baseline for sleep_bench().
+ *
+ * @return
+ * 	The deepest energy mode allowed (EM1 - EM3), or EM0 if sleep is blocked.
+ *
+ ******************************************************************************/
+static uint32_t sleep_deepest_ladder(void){
+	if(lowest_energy_mode[EM0] > 0) return EM0;
+	else if(lowest_energy_mode[EM1] > 0) return EM0;
+	else if (lowest_energy_mode[EM2] > 0) return EM1;
+	else if (lowest_energy_mode[EM3] > 0) return EM2;
+	else return EM3;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Wake Source
+ *
+ * @details
+ *	Finds the interrupt that ended the sleep. When called from sleep_if_idle()
+ *	interrupts are masked, so the wake up interrupt is still pending in the
+ *	NVIC. If enter_sleep() is called with interrupts enabled the handler has
+ *	already run and the wake up is counted as SLEEP_WAKE_OTHER.
+ *
+ * @return
+ * 	The first tracked source with a pending interrupt, or SLEEP_WAKE_OTHER.
+ *
+ ******************************************************************************/
+static SLEEP_WAKE_SOURCE sleep_wake_source(void){
+	for(uint32_t i = 0; i < SLEEP_WAKE_OTHER; i++){
+		if(NVIC_GetPendingIRQ(wake_irq[i])) return (SLEEP_WAKE_SOURCE)i;
+	}
+	return SLEEP_WAKE_OTHER;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Policy Select
+ *
+ * @details
+ *	Picks the cheapest energy mode for the time until the next known wake up.
+ *	The energy of sleeping in a mode is its wake up energy plus its power times
+ *	the time asleep, so a deep mode only pays off once the sleep is long enough
+ *	to recover its wake up cost. A mode whose wake up latency is longer than the
+ *	time to the deadline is not considered, since it would make the wake up late.
+ *
+ *	Without a deadline source, or when none is known, the deepest mode is used.
+ *
+ * @param[in] deepest
+ *   The deepest energy mode allowed by the current blocks (EM1 - EM3).
+ *
+ * @return
+ * 	The energy mode to enter.
+ *
+ ******************************************************************************/
+static uint32_t sleep_policy_select(uint32_t deepest){
+	uint32_t deadline_us = deadline_func ? deadline_func() : SLEEP_NO_DEADLINE;
+	uint32_t mode = deepest;
+
+	if(deadline_us == SLEEP_NO_DEADLINE){
+		policy_stats.no_deadline++;
 	} else {
-		EMU_EnterEM3(true);
-		return;
+		uint64_t best_nj = UINT64_MAX;
+		mode = EM1; // the shallowest sleep if even EM1 cannot wake up in time
+		for(uint32_t em = EM1; em <= deepest; em++){
+			if(cost_table[em].wake_latency_us > deadline_us) break; // deeper modes wake up even slower
+			uint64_t nj = cost_table[em].wake_energy_nj
+						+ (uint64_t)cost_table[em].sleep_power_uw * deadline_us / 1000;
+			if(nj <= best_nj){
+				best_nj = nj;
+				mode = em;
+			}
+		}
 	}
+
+	if(mode < deepest) policy_stats.shallower++;
+	policy_stats.entered[mode]++;
+	return mode;
 }
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Deadline Register
+ *
+ * @details
+ *	Registers the function that reports the time until the next known wake up,
+ *	such as the next LETIMER deadline. It is called from enter_sleep() with
+ *	interrupts masked.
+ *
+ * @param[in] next_deadline
+ *   Function returning microseconds until the next wake up, or
+ *   SLEEP_NO_DEADLINE. Pass 0 to always use the deepest allowed mode.
+ *
+ ******************************************************************************/
+void sleep_deadline_register(SLEEP_DEADLINE_FUNC next_deadline){
+	deadline_func = next_deadline;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Cost Table Set
+ *
+ * @details
+ *	Replaces the wake up latency, wake up energy and sleep power used by the
+ *	sleep policy.
+ *
+ * @param[in] table
+ *   Array of costs indexed by energy mode, with entries for EM0 to EM3. It
+ *   must stay valid while the policy is in use.
+ *
+ ******************************************************************************/
+void sleep_cost_table_set(const SLEEP_EM_COST_STRUCT *table){
+	EFM_ASSERT(table);
+	cost_table = table;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Policy Stats
+ *
+ * @details
+ *	Copies the number of times each energy mode was chosen, how many of those
+ *	were shallower than the blocks allowed, and how many sleeps had no deadline.
+ *
+ * @param[out] stats
+ *   Where the statistics are copied.
+ *
+ ******************************************************************************/
+void sleep_policy_stats(SLEEP_POLICY_STATS_STRUCT *stats){
+	uint32_t primask = critical_enter();
+	*stats = policy_stats;
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep If Idle
+ *
+ * @details
+ *	Enters sleep only if no scheduled event is pending. The scheduler is checked
+ *	once with interrupts enabled as a fast path, then checked again with
+ *	interrupts masked. Masking closes the window in which an ISR could post an
+ *	event after the check but before the WFI inside enter_sleep(), which would
+ *	leave the event unserviced until the next unrelated wake up (up to a full
+ *	LETIMER period).
+ *
+ * @note
+ *	An interrupt that becomes pending while PRIMASK is set still wakes the core
+ *	from WFI. Its handler runs as soon as critical_exit() restores PRIMASK, after
+ *	the clocks have been restored by enter_sleep().
+ *
+ *	Each time the masked recheck finds an event that the first check missed, the
+ *	race counter is incremented. Every one of these would have been delayed by
+ *	a full sleep period with the old check-then-sleep sequence. The latency the
+ *	events do see, from the CYCLE_COUNT_GET() of the posting ISR to their
+ *	dispatch, is kept by the scheduler, see scheduler_latency_histogram().
+ *
+ ******************************************************************************/
+void sleep_if_idle(void){
+	if(!scheduler_idle()) return;
+
+	uint32_t primask = critical_enter();
+	if(!scheduler_idle()){
+		sleep_race_hits++;
+	} else {
+		enter_sleep();
+	}
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Returns the number of times sleep_if_idle() closed the sleep race window
+ *
+ * @details
+ *	Counts how often an event was posted between the unmasked and masked checks
+ *	of the scheduler in sleep_if_idle(). This is how often the window is hit,
+ *	not how long events wait. The worst post to dispatch latency and its
+ *	histogram are in scheduler_latency_histogram().
+ *
+ * @return
+ * 	Number of race window hits since sleep_open().
+ *
+ ******************************************************************************/
+uint32_t sleep_race_count(void){
+	return sleep_race_hits;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Residency Get
+ *
+ * @details
+ *	Copies the time spent in each energy mode and the wake ups per source since
+ *	the last reset. EM0 is the elapsed time not spent asleep, so it includes the
+ *	time spent waiting in sleep_if_idle() with sleep blocked.
+ *
+ * @param[out] residency
+ *   Where the snapshot is copied.
+ *
+ ******************************************************************************/
+void sleep_residency_get(SLEEP_RESIDENCY_STRUCT *residency){
+	uint32_t primask = critical_enter();
+	uint32_t asleep = 0;
+
+	residency->elapsed_ms = (CRYOTIMER_CounterGet() - residency_start) * SLEEP_TICK_MS;
+	for(uint32_t em = EM1; em < MAX_ENERGY_MODES; em++){
+		residency->residency_ms[em] = residency_ticks[em] * SLEEP_TICK_MS;
+		asleep += residency->residency_ms[em];
+	}
+	residency->residency_ms[EM0] = residency->elapsed_ms - asleep;
+	memcpy(residency->wakes, wake_count, sizeof(wake_count));
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Residency Reset
+ *
+ * @details
+ *	Clears the residency and wake up counters and starts a new interval.
+ *
+ ******************************************************************************/
+void sleep_residency_reset(void){
+	uint32_t primask = critical_enter();
+	residency_start = CRYOTIMER_CounterGet();
+	memset(residency_ticks, 0, sizeof(residency_ticks));
+	memset(wake_count, 0, sizeof(wake_count));
+	critical_exit(primask);
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep Residency Report
+ *
+ * @details
+ *	Formats a one line report for ble_write(), with the milliseconds spent in
+ *	EM0 - EM3 followed by the wake ups from LETIMER0, I2C0, I2C1, LEUART0 and
+ *	any other source, for example "ms 52/3/3045/0 wk 1/4/0/2/0".
+ *
+ * @param[out] str
+ *   Where the report is written.
+ *
+ * @param[in] size
+ *   Size of str. The report fits in 64 bytes for intervals under 10^5 seconds.
+ *
+ ******************************************************************************/
+void sleep_residency_report(char *str, uint32_t size){
+	SLEEP_RESIDENCY_STRUCT residency;
+
+	sleep_residency_get(&residency);
+	const char *end = str + size;
+	char *p = format_str(str, end, "ms ");
+	for(int EM = EM0; EM <= EM3; EM++){
+		p = format_uint(p, end, residency.residency_ms[EM]);
+		p = format_str(p, end, EM < EM3 ? "/" : " wk ");
+	}
+	for(int wake = 0; wake < SLEEP_WAKE_SOURCES; wake++){
+		p = format_uint(p, end, residency.wakes[wake]);
+		p = format_str(p, end, wake < SLEEP_WAKE_SOURCES - 1 ? "/" : "\n");
+	}
+}
+
 /***************************************************************************//**
  * @brief
  *   Returns current block energy mode
@@ -151,9 +686,65 @@ void enter_sleep(void){
  *
  ******************************************************************************/
 uint32_t current_block_energy_mode(void){
-	int i;
-	for(i = 0; i < MAX_ENERGY_MODES; i++ ){
-		if(lowest_energy_mode[i] != 0) return i;
+	uint32_t blocked = __CLZ(blocked_mask);
+	return blocked < MAX_ENERGY_MODES ? blocked : MAX_ENERGY_MODES-1;
+}
+
+/***************************************************************************//**
+ * @brief
+ *   Sleep idle path benchmark. Compares the if/else ladder enter_sleep() used
+ *   with the blocked mask.
+ *
+ * @details
+ * 	 With nothing blocked, EM2 blocked (an I2C transfer) and EM4 blocked (the
+ * 	 LETIMER running), this routine counts the cycles each version needs to
+ * 	 find the deepest allowed energy mode, averaged over SLEEP_BENCH_ITERATIONS.
+ *
+ * 	 The results are kept in the private bench_results array so they can be
+ * 	 read from the debugger.
+ *
+ * @note
+ * 	 Requires cycle_count_open() to have been called. The blocks are swapped
+ * 	 out with interrupts masked and restored before returning.
+ *
+ ******************************************************************************/
+void sleep_bench(void){
+	static const uint32_t blocked[SLEEP_BENCH_CASES] = {MAX_ENERGY_MODES, EM2, EM4};
+	int saved_modes[MAX_ENERGY_MODES];
+	uint32_t start, ladder_total, mask_total;
+
+	uint32_t primask = critical_enter();
+	uint32_t saved_mask = blocked_mask;
+	memcpy(saved_modes, lowest_energy_mode, sizeof(saved_modes));
+
+	for(int n = 0; n < SLEEP_BENCH_CASES; n++){
+		memset(lowest_energy_mode, 0, sizeof(lowest_energy_mode));
+		blocked_mask = 0;
+		if(blocked[n] < MAX_ENERGY_MODES){
+			lowest_energy_mode[blocked[n]] = 1;
+			blocked_mask = EM_BIT(blocked[n]);
+		}
+		ladder_total = 0;
+		mask_total = 0;
+
+		for(int iter = 0; iter < SLEEP_BENCH_ITERATIONS; iter++){
+			start = CYCLE_COUNT_GET();
+			volatile uint32_t ladder = sleep_deepest_ladder();
+			ladder_total += CYCLE_COUNT_GET() - start;
+
+			start = CYCLE_COUNT_GET();
+			volatile uint32_t mask = sleep_deepest_allowed();
+			mask_total += CYCLE_COUNT_GET() - start;
+
+			EFM_ASSERT(ladder == mask);
+		}
+
+		bench_results[n].blocked = blocked[n];
+		bench_results[n].ladder_cycles = ladder_total / SLEEP_BENCH_ITERATIONS;
+		bench_results[n].mask_cycles = mask_total / SLEEP_BENCH_ITERATIONS;
 	}
-	return MAX_ENERGY_MODES-1;
+
+	memcpy(lowest_energy_mode, saved_modes, sizeof(saved_modes));
+	blocked_mask = saved_mask;
+	critical_exit(primask);
 }
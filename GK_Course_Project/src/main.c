@@ -69,33 +69,8 @@ int main(void)
 
   while (1) {
 	  //EMU_EnterEM2(true);
-	  if(!get_scheduled_events()) enter_sleep();
-
-
-	  if(get_scheduled_events()&LETIMER0_UF_EVT){
-		  scheduled_letimer0_uf_evt();
-	  }
-	  if(get_scheduled_events()&LETIMER0_COMP0_EVT){
-		  scheduled_letimer0_comp0_evt();
-	  }
-	  if(get_scheduled_events()&LETIMER0_COMP1_EVT){
-	  	  scheduled_letimer0_comp1_evt();
-	  }
-	  if(get_scheduled_events()& BOOT_UP_EVT){
-		  scheduled_boot_up_evt();
-	  }
-	  if(get_scheduled_events()& BLE_TX_DONE_EVT){
-		  scheduled_tx_done_evt();
-	  }
-	  if(get_scheduled_events()& SI7021_READ_TEMP_DONE_EVT){
-		  scheduled_si7021_read_temp_done_evt();
-	  }
-	  if(get_scheduled_events() & SI7021_READ_RH_DONE_EVT){
-		  scheduled_si7021_read_rh_done_evt();
-	  }
-	  if(get_scheduled_events() & SI7021_READ_RH_TEMP_DONE_EVT){
-		  scheduled_si7021_read_rh_temp_done_evt();
-	  }
+	  sleep_if_idle(); // rechecks the scheduler with interrupts masked before sleeping
 
+	  scheduler_dispatch(); // handlers are registered in app_peripheral_setup()
   }
 }
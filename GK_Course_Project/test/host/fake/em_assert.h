@@ -0,0 +1,16 @@
+/**
+ * @file em_assert.h
+ * @brief Host stand-in for emlib's em_assert.h, for the host tests
+ *
+ * EFM_ASSERT is always compiled in and counts failures instead of halting,
+ * see assertEFM() in sim_core.c.
+ *
+ */
+#ifndef EM_ASSERT_H
+#define EM_ASSERT_H
+
+void assertEFM(const char *file, int line);
+
+#define EFM_ASSERT(expr)	((expr) ? (void)0 : assertEFM(__FILE__, __LINE__))
+
+#endif /* EM_ASSERT_H */
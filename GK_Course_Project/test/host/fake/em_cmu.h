@@ -0,0 +1,22 @@
+/**
+ * @file em_cmu.h
+ * @brief Host stand-in for emlib's em_cmu.h, for the host tests
+ *
+ */
+#ifndef EM_CMU_H
+#define EM_CMU_H
+
+#include "em_device.h"
+
+typedef enum {
+	cmuClock_HFPER,
+	cmuClock_I2C0,
+	cmuClock_I2C1,
+	cmuClock_LDMA,
+	cmuClock_LETIMER0,
+	cmuClock_TIMER0,
+} CMU_Clock_TypeDef;
+
+void CMU_ClockEnable(CMU_Clock_TypeDef clock, bool enable);
+
+#endif /* EM_CMU_H */
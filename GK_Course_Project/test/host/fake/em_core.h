@@ -0,0 +1,13 @@
+/**
+ * @file em_core.h
+ * @brief Host stand-in for emlib's em_core.h, for the host tests
+ *
+ * Nothing the host tests compile uses it, but the firmware includes it.
+ *
+ */
+#ifndef EM_CORE_H
+#define EM_CORE_H
+
+#include "em_device.h"
+
+#endif /* EM_CORE_H */
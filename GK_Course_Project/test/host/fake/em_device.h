@@ -0,0 +1,172 @@
+/**
+ * @file em_device.h
+ * @brief Host stand-in for the EFM32PG12B device header, for the host tests
+ *
+ * Only what i2c.c, i2c_device.c, SI7021.c and scheduler.c use is here. The
+ * registers with side effects are arrays reached through a macro of the
+ * register name, so every access calls into the simulator, see sim_i2c.c.
+ *
+ */
+#ifndef EM_DEVICE_H
+#define EM_DEVICE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define __IOM	volatile
+#define __IM	volatile
+
+typedef enum {
+	LDMA_IRQn		= 8,
+	I2C0_IRQn		= 17,
+	LETIMER0_IRQn	= 26,
+	I2C1_IRQn		= 42,
+} IRQn_Type;
+
+// I2C register fields of the EFM32PG12
+#define I2C_CTRL_EN					(1u << 0)
+#define I2C_CTRL_AUTOACK			(1u << 2)
+#define _I2C_CTRL_BITO_SHIFT		12
+#define _I2C_CTRL_BITO_MASK			(3u << 12)
+#define I2C_CTRL_BITO_160PCC		(3u << 12)
+#define I2C_CTRL_GIBITO				(1u << 15)
+#define _I2C_CTRL_CLTO_SHIFT		16
+#define _I2C_CTRL_CLTO_MASK			(7u << 16)
+#define I2C_CTRL_CLTO_1024PPC		(5u << 16)
+
+#define I2C_CMD_START				(1u << 0)
+#define I2C_CMD_STOP				(1u << 1)
+#define I2C_CMD_ACK					(1u << 2)
+#define I2C_CMD_NACK				(1u << 3)
+#define I2C_CMD_CONT				(1u << 4)
+#define I2C_CMD_ABORT				(1u << 5)
+#define I2C_CMD_CLEARTX				(1u << 6)
+#define I2C_CMD_CLEARPC				(1u << 7)
+
+#define I2C_STATE_BUSY				(1u << 0)
+#define _I2C_STATE_STATE_MASK		0xE0u
+#define I2C_STATE_STATE_IDLE		(0u << 5)
+#define I2C_STATE_STATE_WAIT		(1u << 5)
+
+#define _I2C_ROUTEPEN_SDAPEN_SHIFT	0
+#define _I2C_ROUTEPEN_SCLPEN_SHIFT	1
+#define _I2C_ROUTELOC0_SDALOC_SHIFT	0
+#define _I2C_ROUTELOC0_SCLLOC_SHIFT	8
+#define _I2C_ROUTELOC0_SDALOC_LOC15	15u
+#define _I2C_ROUTELOC0_SDALOC_LOC19	19u
+#define _I2C_ROUTELOC0_SCLLOC_LOC15	15u
+#define _I2C_ROUTELOC0_SCLLOC_LOC19	19u
+
+#define _I2C_IEN_RXDATAV_SHIFT		5
+#define _I2C_IEN_ACK_SHIFT			6
+#define _I2C_IEN_NACK_SHIFT			7
+#define _I2C_IEN_MSTOP_SHIFT		8
+#define I2C_IEN_START				(1u << 0)
+#define I2C_IEN_RSTART				(1u << 1)
+#define I2C_IEN_ADDR				(1u << 2)
+#define I2C_IEN_TXC					(1u << 3)
+#define I2C_IEN_TXBL				(1u << 4)
+#define I2C_IEN_RXDATAV				(1u << 5)
+#define I2C_IEN_ACK					(1u << 6)
+#define I2C_IEN_NACK				(1u << 7)
+#define I2C_IEN_MSTOP				(1u << 8)
+#define I2C_IEN_ARBLOST				(1u << 9)
+#define I2C_IEN_BUSERR				(1u << 10)
+#define I2C_IEN_BUSHOLD				(1u << 11)
+#define I2C_IEN_TXOF				(1u << 12)
+#define I2C_IEN_RXUF				(1u << 13)
+#define I2C_IEN_BITO				(1u << 14)
+#define I2C_IEN_CLTO				(1u << 15)
+#define I2C_IF_START				I2C_IEN_START
+#define I2C_IF_TXC					I2C_IEN_TXC
+#define I2C_IF_TXBL					I2C_IEN_TXBL
+#define I2C_IF_RXDATAV				I2C_IEN_RXDATAV
+#define I2C_IF_ACK					I2C_IEN_ACK
+#define I2C_IF_NACK					I2C_IEN_NACK
+#define I2C_IF_MSTOP				I2C_IEN_MSTOP
+#define I2C_IF_ARBLOST				I2C_IEN_ARBLOST
+#define I2C_IF_BUSERR				I2C_IEN_BUSERR
+#define I2C_IF_TXOF					I2C_IEN_TXOF
+#define I2C_IF_RXUF					I2C_IEN_RXUF
+#define I2C_IF_BITO					I2C_IEN_BITO
+#define I2C_IF_CLTO					I2C_IEN_CLTO
+
+// The bit set and bit clear aliases are far above any host address, so the
+// simulated LDMA can tell an alias from a plain address
+#define PER_MEM_BASE				((uintptr_t)0)
+#define PER_BITCLR_MEM_BASE			((uintptr_t)1 << 61)
+#define PER_BITSET_MEM_BASE			((uintptr_t)1 << 62)
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+// CMD, TXDATA, IFS and IFC are written, STATE, IF and RXDATA read, through the
+// one element arrays below, see the macros at the end of this file
+typedef struct {
+	__IOM uint32_t	CTRL;
+	__IOM uint32_t	cmd_reg[1];
+	__IM  uint32_t	state_reg[1];
+	__IM  uint32_t	STATUS;
+	__IOM uint32_t	CLKDIV;
+	__IM  uint32_t	rxdata_reg[1];
+	__IOM uint32_t	txdata_reg[1];
+	__IM  uint32_t	if_reg[1];
+	__IOM uint32_t	ifs_reg[1];
+	__IOM uint32_t	ifc_reg[1];
+	__IOM uint32_t	IEN;
+	__IOM uint32_t	ROUTEPEN;
+	__IOM uint32_t	ROUTELOC0;
+} I2C_TypeDef;
+
+typedef struct {
+	__IOM uint32_t	CTRL;
+	__IM  uint32_t	cyccnt_reg[1];
+} DWT_Type;
+
+extern I2C_TypeDef sim_i2c0, sim_i2c1;
+extern DWT_Type sim_dwt;
+
+#define I2C0	(&sim_i2c0)
+#define I2C1	(&sim_i2c1)
+#define DWT		(&sim_dwt)
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+// simulator side of the register accesses, each returns the array index 0
+uint32_t sim_reg_write(void);
+uint32_t sim_reg_read(void);
+uint32_t sim_rxdata_read(void);
+uint32_t sim_cycle_read(void);
+
+// core intrinsics, see sim_core.c
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __LDREXW(volatile uint32_t *addr);
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr);
+void __CLREX(void);
+uint32_t __CLZ(uint32_t value);
+void __DMB(void);
+void __DSB(void);
+void __ISB(void);
+void __WFI(void);
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+
+// registers with side effects, after the struct that holds them
+#define CMD			cmd_reg[sim_reg_write()]
+#define TXDATA		txdata_reg[sim_reg_write()]
+#define IFS			ifs_reg[sim_reg_write()]
+#define IFC			ifc_reg[sim_reg_write()]
+#define STATE		state_reg[sim_reg_read()]
+#define IF			if_reg[sim_reg_read()]
+#define RXDATA		rxdata_reg[sim_rxdata_read()]
+#define CYCCNT		cyccnt_reg[sim_cycle_read()]
+
+#endif /* EM_DEVICE_H */
@@ -0,0 +1,13 @@
+/**
+ * @file em_emu.h
+ * @brief Host stand-in for emlib's em_emu.h, for the host tests
+ *
+ * Nothing the host tests compile uses it, but the firmware includes it.
+ *
+ */
+#ifndef EM_EMU_H
+#define EM_EMU_H
+
+#include "em_device.h"
+
+#endif /* EM_EMU_H */
@@ -0,0 +1,25 @@
+/**
+ * @file em_gpio.h
+ * @brief Host stand-in for emlib's em_gpio.h, for the host tests
+ *
+ * Only the pins of the I2C bus reset are modelled, see sim_i2c.c.
+ *
+ */
+#ifndef EM_GPIO_H
+#define EM_GPIO_H
+
+#include "em_device.h"
+
+typedef enum {
+	gpioPortA,
+	gpioPortB,
+	gpioPortC,
+	gpioPortD,
+	gpioPortE,
+	gpioPortF,
+} GPIO_Port_TypeDef;
+
+void GPIO_PinOutToggle(GPIO_Port_TypeDef port, unsigned int pin);
+unsigned int GPIO_PinInGet(GPIO_Port_TypeDef port, unsigned int pin);
+
+#endif /* EM_GPIO_H */
@@ -0,0 +1,56 @@
+/**
+ * @file em_i2c.h
+ * @brief Host stand-in for emlib's em_i2c.h, for the host tests
+ *
+ * The interrupt flag helpers are inline like emlib's, so they reach the
+ * simulated registers through em_device.h.
+ *
+ */
+#ifndef EM_I2C_H
+#define EM_I2C_H
+
+#include "em_device.h"
+
+#define I2C_FREQ_STANDARD_MAX	92000
+#define I2C_FREQ_FAST_MAX		392157
+#define I2C_FREQ_FASTPLUS_MAX	987167
+
+typedef enum {
+	i2cClockHLRStandard,
+	i2cClockHLRAsymetric,
+	i2cClockHLRFast
+} I2C_ClockHLR_TypeDef;
+
+typedef struct {
+	bool					enable;
+	bool					master;
+	uint32_t				refFreq;
+	uint32_t				freq;
+	I2C_ClockHLR_TypeDef	clhr;
+} I2C_Init_TypeDef;
+
+void I2C_Init(I2C_TypeDef *i2c, const I2C_Init_TypeDef *init);
+void I2C_BusFreqSet(I2C_TypeDef *i2c, uint32_t freqRef, uint32_t freqScl, I2C_ClockHLR_TypeDef i2cMode);
+
+static inline uint32_t I2C_IntGet(I2C_TypeDef *i2c){
+	return i2c->IF;
+}
+
+static inline uint32_t I2C_IntGetEnabled(I2C_TypeDef *i2c){
+	uint32_t ien = i2c->IEN;
+	return i2c->IF & ien;
+}
+
+static inline void I2C_IntClear(I2C_TypeDef *i2c, uint32_t flags){
+	i2c->IFC = flags;
+}
+
+static inline void I2C_IntEnable(I2C_TypeDef *i2c, uint32_t flags){
+	i2c->IEN |= flags;
+}
+
+static inline void I2C_IntDisable(I2C_TypeDef *i2c, uint32_t flags){
+	i2c->IEN &= ~flags;
+}
+
+#endif /* EM_I2C_H */
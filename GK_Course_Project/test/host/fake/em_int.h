@@ -0,0 +1,13 @@
+/**
+ * @file em_int.h
+ * @brief Host stand-in for emlib's em_int.h, for the host tests
+ *
+ * Nothing the host tests compile uses it, but the firmware includes it.
+ *
+ */
+#ifndef EM_INT_H
+#define EM_INT_H
+
+#include "em_device.h"
+
+#endif /* EM_INT_H */
@@ -0,0 +1,95 @@
+/**
+ * @file em_ldma.h
+ * @brief Host stand-in for emlib's em_ldma.h, for the host tests
+ *
+ * The descriptors keep emlib's field names for what the I2C driver touches.
+ * Addresses are uintptr_t so host pointers survive, and linkAddr counts
+ * descriptors rather than words.
+ *
+ */
+#ifndef EM_LDMA_H
+#define EM_LDMA_H
+
+#include "em_device.h"
+
+#define LDMA_CHANNELS		8
+#define LDMA_IF_ERROR		(1u << 31)
+
+typedef enum {
+	ldmaCtrlStructTypeXfer,
+	ldmaCtrlStructTypeSync,
+	ldmaCtrlStructTypeWrite
+} LDMA_CtrlStructType_t;
+
+typedef enum {
+	ldmaPeripheralSignal_NONE,
+	ldmaPeripheralSignal_I2C0_RXDATAV,
+	ldmaPeripheralSignal_I2C0_TXBL,
+	ldmaPeripheralSignal_I2C1_RXDATAV,
+	ldmaPeripheralSignal_I2C1_TXBL,
+} LDMA_PeripheralSignal_t;
+
+typedef union {
+	struct {
+		uint32_t	structType;
+		uint32_t	xferCnt;	// items less one
+		uint32_t	doneIfs;
+		uint32_t	link;
+		int32_t		linkAddr;	// relative, in descriptors
+		uint32_t	srcInc;
+		uint32_t	dstInc;
+		uintptr_t	srcAddr;
+		uintptr_t	dstAddr;
+	} xfer;
+	struct {
+		uint32_t	structType;
+		uint32_t	xferCnt;
+		uint32_t	doneIfs;
+		uint32_t	link;
+		int32_t		linkAddr;
+		uint32_t	srcInc;
+		uint32_t	dstInc;
+		uint32_t	immVal;
+		uintptr_t	dstAddr;
+	} wri;
+} LDMA_Descriptor_t;
+
+typedef struct {
+	uint32_t	ldmaReqSel;
+} LDMA_TransferCfg_t;
+
+typedef struct {
+	uint8_t		ldmaInitCtrlNumFixed;
+} LDMA_Init_t;
+
+#define LDMA_INIT_DEFAULT		{ .ldmaInitCtrlNumFixed = 0 }
+#define LDMA_TRANSFER_CFG_PERIPHERAL(signal)	{ .ldmaReqSel = (signal) }
+
+#define LDMA_XFER(src, dest, count, src_inc, dst_inc, done, linked, jump)	\
+	{ .xfer = { .structType = ldmaCtrlStructTypeXfer, .xferCnt = (count) - 1,	\
+		.doneIfs = (done), .link = (linked), .linkAddr = (jump),				\
+		.srcInc = (src_inc), .dstInc = (dst_inc),								\
+		.srcAddr = (uintptr_t)(src), .dstAddr = (uintptr_t)(dest) } }
+#define LDMA_WRI(value, address, done, linked, jump)							\
+	{ .wri = { .structType = ldmaCtrlStructTypeWrite, .xferCnt = 0,			\
+		.doneIfs = (done), .link = (linked), .linkAddr = (jump),				\
+		.immVal = (value), .dstAddr = (uintptr_t)(address) } }
+
+#define LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(src, dest, count)			LDMA_XFER(src, dest, count, 1, 0, 1, 0, 0)
+#define LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(src, dest, count, linkjmp)	LDMA_XFER(src, dest, count, 1, 0, 0, 1, linkjmp)
+#define LDMA_DESCRIPTOR_SINGLE_P2M_BYTE(src, dest, count)			LDMA_XFER(src, dest, count, 0, 1, 1, 0, 0)
+#define LDMA_DESCRIPTOR_LINKREL_P2M_BYTE(src, dest, count, linkjmp)	LDMA_XFER(src, dest, count, 0, 1, 0, 1, linkjmp)
+#define LDMA_DESCRIPTOR_SINGLE_WRITE(value, address)				LDMA_WRI(value, address, 1, 0, 0)
+#define LDMA_DESCRIPTOR_LINKREL_WRITE(value, address, linkjmp)		LDMA_WRI(value, address, 0, 1, linkjmp)
+
+void LDMA_Init(const LDMA_Init_t *init);
+void LDMA_StartTransfer(int ch, const LDMA_TransferCfg_t *transfer, const LDMA_Descriptor_t *descriptor);
+void LDMA_StopTransfer(int ch);
+bool LDMA_TransferDone(int ch);
+uint32_t LDMA_IntGet(void);
+uint32_t LDMA_IntGetEnabled(void);
+void LDMA_IntClear(uint32_t flags);
+void LDMA_IntEnable(uint32_t flags);
+void LDMA_IntDisable(uint32_t flags);
+
+#endif /* EM_LDMA_H */
@@ -0,0 +1,19 @@
+/**
+ * @file em_letimer.h
+ * @brief Host stand-in for emlib's em_letimer.h, for the host tests
+ *
+ */
+#ifndef EM_LETIMER_H
+#define EM_LETIMER_H
+
+#include "em_device.h"
+
+typedef struct {
+	uint32_t	running;
+} LETIMER_TypeDef;
+
+extern LETIMER_TypeDef sim_letimer0;
+
+#define LETIMER0	(&sim_letimer0)
+
+#endif /* EM_LETIMER_H */
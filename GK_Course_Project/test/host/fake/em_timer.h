@@ -0,0 +1,13 @@
+/**
+ * @file em_timer.h
+ * @brief Host stand-in for emlib's em_timer.h, for the host tests
+ *
+ * Nothing the host tests compile uses it, but the firmware includes it.
+ *
+ */
+#ifndef EM_TIMER_H
+#define EM_TIMER_H
+
+#include "em_device.h"
+
+#endif /* EM_TIMER_H */
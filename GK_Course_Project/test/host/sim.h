@@ -0,0 +1,116 @@
+/**
+ * @file sim.h
+ * @brief Host simulation of the EFM32PG12 parts the I2C driver and the
+ * scheduler run on
+ *
+ * The firmware is built unchanged against the headers in fake/. Register
+ * accesses with side effects call into sim_i2c.c, the core intrinsics and
+ * the NVIC are in sim_core.c, and the LETIMER software timers, sleep blocks
+ * and timer_delay() are in sim_board.c.
+ *
+ * Simulated time only moves in sim_step() and sim_run_ms(). The firmware's
+ * busy waits on i2c_idle() step it, and timer_delay() runs it, so code that
+ * runs on the board runs here as is. Interrupts are delivered whenever
+ * interrupts are unmasked and the core is not already in a handler.
+ *
+ */
+#ifndef SIM_H
+#define SIM_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include <stdint.h>
+#include <stdbool.h>
+#include "em_device.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_CORE_HZ			19000000	// HFRCO at reset, the rate of DWT->CYCCNT
+#define SIM_NS_PER_MS		1000000ull
+#define SIM_EMPTY			0xFFFFFFFFu	// register slot without a write pending
+#define SIM_IRQS			64
+#define SIM_STORM_LIMIT		100000		// interrupts taken without time moving
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef void (*SIM_HANDLER_FUNC)(void);
+typedef bool (*SIM_PENDING_FUNC)(void);
+
+// where sim_preempt() can raise an interrupt
+typedef enum {
+	SIM_POINT_LDREX,		// after the load, before its STREX
+	SIM_POINT_DMB			// before the barrier
+} SIM_POINT;
+
+// a part of the simulation with its own timed events
+typedef struct {
+	void		(*sync)(void);			// apply register writes and requests, or null
+	uint64_t	(*next_ns)(void);		// time of its next event, UINT64_MAX for none
+	void		(*advance)(uint64_t now);	// complete the events due by now, or null
+} SIM_MODULE_STRUCT;
+
+// a device on a simulated I2C bus, answering at address
+typedef struct SIM_DEVICE_STRUCT SIM_DEVICE_STRUCT;
+struct SIM_DEVICE_STRUCT {
+	uint8_t		address;
+	bool		(*start)(SIM_DEVICE_STRUCT *dev, bool read);	// addressed, true to ACK
+	bool		(*write)(SIM_DEVICE_STRUCT *dev, uint8_t byte);	// true to ACK
+	uint8_t		(*read)(SIM_DEVICE_STRUCT *dev);
+	void		(*stop)(SIM_DEVICE_STRUCT *dev);	// stop or repeated start, or null
+	SIM_DEVICE_STRUCT	*next;		// next device on the same bus
+};
+
+typedef struct {
+	uint32_t	transfers;			// descriptor lists started
+	uint32_t	signals;			// bit per ldmaPeripheralSignal_t served
+	uint32_t	bytes;				// bytes moved to or from a peripheral
+} SIM_LDMA_STATS_STRUCT;
+
+typedef struct {
+	uint32_t	addresses;			// address bytes sent, with their start
+	uint32_t	nacks;				// address or data bytes NACKed
+	uint32_t	bytes;				// data bytes written and read
+	uint32_t	stops;
+	uint32_t	aborts;
+	uint32_t	faults;				// operations ended by an injected fault
+	uint64_t	busy_ns;			// time the bus was held
+} SIM_BUS_STATS_STRUCT;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+// sim_core.c
+void sim_module_register(const SIM_MODULE_STRUCT *module);
+void sim_irq_connect(IRQn_Type irq, SIM_HANDLER_FUNC handler, SIM_PENDING_FUNC pending);
+uint64_t sim_time_ns(void);
+bool sim_step(void);
+void sim_run_ms(uint32_t ms);
+void sim_sync(void);
+void sim_deliver(void);
+IRQn_Type sim_active_irq(void);
+uint32_t sim_irq_count(IRQn_Type irq);
+uint32_t sim_assert_failures(void);
+void sim_check(bool ok, const char *what);
+int sim_report(const char *test);
+void sim_preempt(IRQn_Type irq, SIM_HANDLER_FUNC handler, SIM_POINT point, uint32_t count);
+void sim_exclusive_yield(bool enable);
+uint32_t sim_strex_failures(void);
+
+// sim_i2c.c
+void sim_i2c_attach(I2C_TypeDef *i2c, SIM_DEVICE_STRUCT *dev);
+uint32_t sim_i2c_freq(I2C_TypeDef *i2c);
+void sim_i2c_stats(I2C_TypeDef *i2c, SIM_BUS_STATS_STRUCT *stats);
+void sim_i2c_fault(I2C_TypeDef *i2c, uint32_t flag, uint32_t ops);
+void sim_i2c_stretch(I2C_TypeDef *i2c, uint32_t ops, uint32_t us);
+void sim_ldma_stats(uint32_t ch, SIM_LDMA_STATS_STRUCT *stats);
+uint32_t sim_pin_toggles(uint32_t port, uint32_t pin);
+void sim_pin_hold(uint32_t port, uint32_t pin, bool low);
+
+// sim_board.c
+uint32_t sim_sleep_blocks(uint32_t EM, uint32_t owner);
+uint32_t sim_timers_active(void);
+
+#endif /* SIM_H */
@@ -0,0 +1,255 @@
+/**
+ * @file sim_board.c
+ * @brief Simulated board services the I2C driver calls: the LETIMER0
+ * software timers, the sleep blocks, the clocks and timer_delay()
+ *
+ * These replace letimer.c, sleep_routines.c, cmu.c and HW_delay.c, which
+ * drive hardware the host does not have. They keep the interfaces and the
+ * behaviour the driver relies on: a timer handle names one start of a slot,
+ * an expired timer calls back from the LETIMER0 interrupt, and the timers
+ * only advance once letimer_start() has been called.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Silicon Lab include files
+#include "em_cmu.h"
+#include "em_assert.h"
+
+//** User/developer include files
+#include "letimer.h"
+#include "sleep_routines.h"
+#include "scheduler.h"
+#include "HW_delay.h"
+#include "sim.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_TIMER_ID_MASK	((1u << LETIMER_TIMER_GEN_SHIFT) - 1)
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+typedef struct {
+	bool				active;
+	uint64_t			deadline;	// ns
+	uint64_t			period;		// ns, 0 for a one-shot timer
+	uint32_t			event;
+	LETIMER_TIMER_FUNC	callback;
+	void				*arg;
+	uint32_t			generation;
+} SIM_TIMER_STRUCT;
+
+typedef struct {
+	bool		in_use;
+	uint8_t		em;
+	SLEEP_OWNER	owner;
+} SIM_TOKEN_STRUCT;
+
+LETIMER_TypeDef sim_letimer0;
+
+static SIM_TIMER_STRUCT timers[LETIMER_TIMER_MAX];
+static SIM_TOKEN_STRUCT tokens[SLEEP_TOKEN_MAX];
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static uint64_t sim_board_next_ns(void);
+static bool sim_letimer_pending(void);
+static void sim_letimer_irq(void);
+
+static const SIM_MODULE_STRUCT sim_board_module = {
+	0, sim_board_next_ns, 0
+};
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Connects the LETIMER0 interrupt and the timer deadlines at start up
+ *
+ ******************************************************************************/
+__attribute__((constructor)) static void sim_board_init(void){
+	sim_module_register(&sim_board_module);
+	sim_irq_connect(LETIMER0_IRQn, sim_letimer_irq, sim_letimer_pending);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the nearest timer deadline, if the timers are running
+ *
+ ******************************************************************************/
+static uint64_t sim_board_next_ns(void){
+	uint64_t next = UINT64_MAX;
+	if(!sim_letimer0.running) return next;
+	for(int id = 0; id < LETIMER_TIMER_MAX; id++){
+		if(timers[id].active && timers[id].deadline < next) next = timers[id].deadline;
+	}
+	return next;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Interrupt line of LETIMER0, set while a timer is due
+ *
+ ******************************************************************************/
+static bool sim_letimer_pending(void){
+	return sim_board_next_ns() <= sim_time_ns();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	LETIMER0 interrupt, expires the due timers
+ *
+ * @details
+ *	Like timer_expire() in letimer.c, a one-shot timer is freed before its
+ *	callback so the callback can start a timer in the same slot.
+ *
+ ******************************************************************************/
+static void sim_letimer_irq(void){
+	uint64_t now = sim_time_ns();
+	for(int id = 0; id < LETIMER_TIMER_MAX; id++){
+		SIM_TIMER_STRUCT *t = &timers[id];
+		if(!t->active || t->deadline > now) continue;
+		if(t->period){
+			t->deadline += t->period;
+		} else {
+			t->active = false;
+		}
+		if(t->callback){
+			t->callback(t->arg);
+		} else {
+			add_scheduled_event(t->event);
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	letimer.c interface
+ *
+ ******************************************************************************/
+void letimer_start(LETIMER_TypeDef *letimer, bool enable){
+	letimer->running = enable;
+	NVIC_EnableIRQ(LETIMER0_IRQn);
+}
+
+static uint32_t sim_timer_start(uint32_t ms, bool periodic, uint32_t event, LETIMER_TIMER_FUNC callback, void *arg){
+	uint32_t primask = critical_enter();
+	int id;
+	for(id = 0; id < LETIMER_TIMER_MAX; id++){
+		if(!timers[id].active) break;
+	}
+	EFM_ASSERT(id < LETIMER_TIMER_MAX); // out of timers
+	SIM_TIMER_STRUCT *t = &timers[id];
+	t->generation = (t->generation + 1) & LETIMER_TIMER_GEN_MASK;
+	if(t->generation == 0) t->generation = 1;
+	t->active = true;
+	t->deadline = sim_time_ns() + ms * SIM_NS_PER_MS;
+	t->period = periodic ? ms * SIM_NS_PER_MS : 0;
+	t->event = event;
+	t->callback = callback;
+	t->arg = arg;
+	critical_exit(primask);
+	return (t->generation << LETIMER_TIMER_GEN_SHIFT) | id;
+}
+
+uint32_t letimer_timer_start(uint32_t ms, bool periodic, uint32_t event){
+	return sim_timer_start(ms, periodic, event, 0, 0);
+}
+
+uint32_t letimer_timer_start_cb(uint32_t ms, LETIMER_TIMER_FUNC callback, void *arg){
+	EFM_ASSERT(callback);
+	return sim_timer_start(ms, false, 0, callback, arg);
+}
+
+void letimer_timer_cancel(uint32_t handle){
+	uint32_t id = handle & SIM_TIMER_ID_MASK;
+	EFM_ASSERT(id < LETIMER_TIMER_MAX);
+	if(timers[id].active && timers[id].generation == handle >> LETIMER_TIMER_GEN_SHIFT){
+		timers[id].active = false;
+	}
+}
+
+bool letimer_timer_running(void){
+	return sim_letimer0.running;
+}
+
+uint32_t letimer_timer_now(void){
+	return sim_time_ns() / SIM_NS_PER_MS;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of software timers waiting to expire
+ *
+ ******************************************************************************/
+uint32_t sim_timers_active(void){
+	uint32_t count = 0;
+	for(int id = 0; id < LETIMER_TIMER_MAX; id++){
+		count += timers[id].active;
+	}
+	return count;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	sleep_routines.c interface, the owner tracked blocks only
+ *
+ ******************************************************************************/
+uint8_t sleep_block_acquire(uint32_t EM, SLEEP_OWNER owner){
+	EFM_ASSERT(EM < MAX_ENERGY_MODES && owner < SLEEP_OWNERS);
+	uint32_t primask = critical_enter();
+	uint8_t token;
+	for(token = 0; token < SLEEP_TOKEN_MAX; token++){
+		if(!tokens[token].in_use) break;
+	}
+	EFM_ASSERT(token < SLEEP_TOKEN_MAX); // more blocks held than SLEEP_TOKEN_MAX
+	tokens[token].in_use = true;
+	tokens[token].em = EM;
+	tokens[token].owner = owner;
+	critical_exit(primask);
+	return token;
+}
+
+void sleep_block_release(uint8_t token){
+	EFM_ASSERT(token < SLEEP_TOKEN_MAX);
+	EFM_ASSERT(tokens[token].in_use); // released twice
+	tokens[token].in_use = false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of blocks an owner holds on an energy mode
+ *
+ ******************************************************************************/
+uint32_t sim_sleep_blocks(uint32_t EM, uint32_t owner){
+	uint32_t count = 0;
+	for(int token = 0; token < SLEEP_TOKEN_MAX; token++){
+		count += tokens[token].in_use && tokens[token].em == EM && tokens[token].owner == owner;
+	}
+	return count;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	cmu.c and HW_delay.c interface
+ *
+ * @details
+ *	timer_delay() busy waits on TIMER0 on the board, here it runs the
+ *	simulation for the delay, taking interrupts as they come.
+ *
+ ******************************************************************************/
+void CMU_ClockEnable(CMU_Clock_TypeDef clock, bool enable){
+	(void)clock;
+	(void)enable;
+}
+
+void timer_delay(uint32_t ms_delay){
+	sim_run_ms(ms_delay);
+}
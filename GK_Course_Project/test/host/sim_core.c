@@ -0,0 +1,460 @@
+/**
+ * @file sim_core.c
+ * @brief Simulated Cortex-M4 core: time, NVIC, PRIMASK, exclusive monitor
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+//** Silicon Lab include files
+#include "em_device.h"
+#include "em_assert.h"
+
+//** User/developer include files
+#include "sim.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_MODULES		4
+#define SIM_NO_IRQ		(-1)
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+typedef struct {
+	SIM_HANDLER_FUNC	handler;
+	SIM_PENDING_FUNC	pending;
+	bool				enabled;	// NVIC enable
+	uint32_t			count;		// times taken
+} SIM_VECTOR_STRUCT;
+
+typedef struct {
+	volatile uint32_t	*addr;		// address of the last LDREX, or null
+	uint32_t			value;		// what it loaded
+} SIM_MONITOR_STRUCT;
+
+typedef struct {
+	SIM_HANDLER_FUNC	handler;	// interrupt to take, or null
+	IRQn_Type			irq;		// what sim_active_irq() returns in it
+	SIM_POINT			point;
+	uint32_t			count;		// passes of the point left
+	bool				pending;	// reached with interrupts masked
+} SIM_PREEMPT_STRUCT;
+
+static uint64_t now_ns;
+static const SIM_MODULE_STRUCT *modules[SIM_MODULES];
+static uint32_t module_count;
+static SIM_VECTOR_STRUCT vectors[SIM_IRQS];
+static uint32_t assert_failures;
+static uint32_t check_failures;
+static volatile bool exclusive_yield;
+static volatile uint32_t strex_failures;
+
+// each thread is a core context of its own, see test_scheduler.c
+static __thread uint32_t primask;
+static __thread int active_irq = SIM_NO_IRQ;
+static __thread SIM_MONITOR_STRUCT monitor;
+static __thread SIM_PREEMPT_STRUCT preempt;
+
+DWT_Type sim_dwt;
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static uint64_t sim_next_ns(void);
+static void sim_advance(uint64_t t);
+static void sim_preempt_take(void);
+static void sim_preempt_point(SIM_POINT point);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Adds a part of the simulation that has timed events
+ *
+ * @param[in] module
+ * 	Its sync, next event and advance functions, kept by reference.
+ *
+ ******************************************************************************/
+void sim_module_register(const SIM_MODULE_STRUCT *module){
+	if(module_count >= SIM_MODULES){
+		fprintf(stderr, "sim: too many modules\n");
+		exit(2);
+	}
+	modules[module_count++] = module;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Connects an interrupt handler to its vector
+ *
+ * @details
+ *	The handler is taken while its NVIC enable is set and pending() is true,
+ *	the level of the peripheral's interrupt line.
+ *
+ ******************************************************************************/
+void sim_irq_connect(IRQn_Type irq, SIM_HANDLER_FUNC handler, SIM_PENDING_FUNC pending){
+	vectors[irq].handler = handler;
+	vectors[irq].pending = pending;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the simulated time since reset
+ *
+ ******************************************************************************/
+uint64_t sim_time_ns(void){
+	return now_ns;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the earliest event of any module, UINT64_MAX if there is none
+ *
+ ******************************************************************************/
+static uint64_t sim_next_ns(void){
+	uint64_t next = UINT64_MAX;
+	for(uint32_t i = 0; i < module_count; i++){
+		if(modules[i]->next_ns){
+			uint64_t t = modules[i]->next_ns();
+			if(t < next) next = t;
+		}
+	}
+	return next;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Moves time forward to t and completes the events due by then
+ *
+ ******************************************************************************/
+static void sim_advance(uint64_t t){
+	static uint32_t stalls;
+	if(t > now_ns){
+		now_ns = t;
+		stalls = 0;
+	} else if(++stalls > SIM_STORM_LIMIT){
+		fprintf(stderr, "sim: no progress at %llu ns, an interrupt is pending with interrupts masked\n",
+				(unsigned long long)now_ns);
+		exit(2);
+	}
+	for(uint32_t i = 0; i < module_count; i++){
+		if(modules[i]->advance) modules[i]->advance(now_ns);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Applies the register writes and requests of every module
+ *
+ ******************************************************************************/
+void sim_sync(void){
+	for(uint32_t i = 0; i < module_count; i++){
+		if(modules[i]->sync) modules[i]->sync();
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes every pending interrupt
+ *
+ * @details
+ *	Does nothing with interrupts masked or from a handler, as handlers do not
+ *	nest on the board either, all of them having the same priority. Among
+ *	pending interrupts the lowest IRQ number goes first, like the NVIC.
+ *
+ ******************************************************************************/
+void sim_deliver(void){
+	uint32_t storm = 0;
+	if(primask || active_irq != SIM_NO_IRQ) return;
+	if(preempt.pending) sim_preempt_take();
+	for(;;){
+		int irq = SIM_NO_IRQ;
+		sim_sync();
+		for(int i = 0; i < SIM_IRQS; i++){
+			if(vectors[i].handler && vectors[i].enabled && vectors[i].pending()){
+				irq = i;
+				break;
+			}
+		}
+		if(irq == SIM_NO_IRQ) return;
+		if(++storm > SIM_STORM_LIMIT){
+			fprintf(stderr, "sim: interrupt %d taken %u times without time moving\n", irq, storm);
+			exit(2);
+		}
+		active_irq = irq;
+		monitor.addr = 0; // exception entry clears the exclusive monitor
+		vectors[irq].count++;
+		vectors[irq].handler();
+		monitor.addr = 0; // and so does the return
+		active_irq = SIM_NO_IRQ;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs until the next event of any module
+ *
+ * @return
+ * 	false if there is none, so whatever is being waited for cannot happen.
+ *
+ ******************************************************************************/
+bool sim_step(void){
+	sim_deliver();
+	uint64_t next = sim_next_ns();
+	if(next == UINT64_MAX) return false;
+	sim_advance(next);
+	sim_sync();
+	sim_deliver();
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs the simulation for ms milliseconds
+ *
+ ******************************************************************************/
+void sim_run_ms(uint32_t ms){
+	uint64_t end = now_ns + ms * SIM_NS_PER_MS;
+	for(;;){
+		sim_deliver();
+		uint64_t next = sim_next_ns();
+		if(next > end) break;
+		sim_advance(next);
+	}
+	sim_advance(end);
+	sim_sync();
+	sim_deliver();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the interrupt being handled on this thread, or -1
+ *
+ ******************************************************************************/
+IRQn_Type sim_active_irq(void){
+	return (IRQn_Type)active_irq;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of times an interrupt was taken
+ *
+ ******************************************************************************/
+uint32_t sim_irq_count(IRQn_Type irq){
+	return vectors[irq].count;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Counts a failed EFM_ASSERT of the firmware instead of halting
+ *
+ ******************************************************************************/
+void assertEFM(const char *file, int line){
+	__sync_fetch_and_add(&assert_failures, 1);
+	fprintf(stderr, "EFM_ASSERT failed: %s:%d\n", file, line);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of failed EFM_ASSERTs so far
+ *
+ ******************************************************************************/
+uint32_t sim_assert_failures(void){
+	return assert_failures;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Checks a condition of a test and counts it if it fails
+ *
+ ******************************************************************************/
+void sim_check(bool ok, const char *what){
+	if(!ok){
+		__sync_fetch_and_add(&check_failures, 1);
+		fprintf(stderr, "FAIL: %s\n", what);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Prints the result of a test program
+ *
+ * @return
+ * 	The exit status, 0 if no check or EFM_ASSERT failed.
+ *
+ ******************************************************************************/
+int sim_report(const char *test){
+	uint32_t failures = assert_failures + check_failures;
+	printf("%s: %s, %u EFM_ASSERT and %u check failures, %.3f ms simulated\n", test,
+			failures ? "FAIL" : "PASS", assert_failures, check_failures, now_ns / 1e6);
+	return failures ? 1 : 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Raises an interrupt on this thread at an exact point of the code
+ *
+ * @details
+ *	handler is taken as interrupt irq when this thread passes point for the
+ *	count-th time from now, 1 for the next, right after an LDREX or right
+ *	before a DMB. With interrupts masked there it stays pending until they
+ *	are unmasked, as on the board. It is taken once, a null handler disarms.
+ *
+ ******************************************************************************/
+void sim_preempt(IRQn_Type irq, SIM_HANDLER_FUNC handler, SIM_POINT point, uint32_t count){
+	preempt = (SIM_PREEMPT_STRUCT){ handler, irq, point, count, false };
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes the interrupt raised by sim_preempt()
+ *
+ ******************************************************************************/
+static void sim_preempt_take(void){
+	SIM_HANDLER_FUNC handler = preempt.handler;
+	preempt.handler = 0;
+	preempt.pending = false;
+	active_irq = preempt.irq;
+	monitor.addr = 0;
+	handler();
+	monitor.addr = 0;
+	active_irq = SIM_NO_IRQ;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Counts a pass of a point and raises the interrupt armed on it
+ *
+ ******************************************************************************/
+static void sim_preempt_point(SIM_POINT point){
+	if(!preempt.handler || preempt.pending || preempt.point != point || --preempt.count) return;
+	if(primask || active_irq != SIM_NO_IRQ){
+		preempt.pending = true;
+		return;
+	}
+	sim_preempt_take();
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Has every thread yield the CPU right after an LDREX
+ *
+ * @details
+ *	The gap between an LDREX and its STREX is where an interrupt does harm.
+ *	Yielding there runs the other threads in it, even on a single CPU.
+ *
+ ******************************************************************************/
+void sim_exclusive_yield(bool enable){
+	exclusive_yield = enable;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the number of STREX that failed, on any thread
+ *
+ ******************************************************************************/
+uint32_t sim_strex_failures(void){
+	return strex_failures;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Core intrinsics and NVIC functions the firmware calls
+ *
+ * @details
+ *	Unmasking interrupts takes any that became pending while masked. The
+ *	exclusive pair is a compare and swap of the value the LDREX loaded, so a
+ *	STREX fails if another thread changed the word, or if an interrupt was
+ *	taken on this thread since the LDREX.
+ *
+ ******************************************************************************/
+uint32_t __get_PRIMASK(void){
+	return primask;
+}
+
+void __set_PRIMASK(uint32_t mask){
+	primask = mask & 1;
+	if(!primask) sim_deliver();
+}
+
+void __disable_irq(void){
+	primask = 1;
+}
+
+void __enable_irq(void){
+	__set_PRIMASK(0);
+}
+
+uint32_t __LDREXW(volatile uint32_t *addr){
+	monitor.addr = addr;
+	monitor.value = __atomic_load_n(addr, __ATOMIC_SEQ_CST);
+	sim_preempt_point(SIM_POINT_LDREX);
+	if(exclusive_yield) sched_yield();
+	return monitor.value;
+}
+
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr){
+	bool stored = monitor.addr == addr
+			&& __atomic_compare_exchange_n(addr, &monitor.value, value, false,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	monitor.addr = 0;
+	if(!stored) __atomic_add_fetch(&strex_failures, 1, __ATOMIC_SEQ_CST);
+	return stored ? 0 : 1;
+}
+
+void __CLREX(void){
+	monitor.addr = 0;
+}
+
+uint32_t __CLZ(uint32_t value){
+	return value ? (uint32_t)__builtin_clz(value) : 32;
+}
+
+void __DMB(void){
+	sim_preempt_point(SIM_POINT_DMB);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void __DSB(void){
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void __ISB(void){
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void __WFI(void){
+	sim_step();
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq){
+	vectors[irq].enabled = true;
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq){
+	vectors[irq].enabled = false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Reads DWT->CYCCNT, the simulated time in core clock cycles
+ *
+ * @details
+ *	Time does not move while code runs, so a count only covers bus and timer
+ *	time, not the instructions in between.
+ *
+ ******************************************************************************/
+uint32_t sim_cycle_read(void){
+	sim_dwt.cyccnt_reg[0] = (uint32_t)(now_ns * (SIM_CORE_HZ / 1000000) / 1000);
+	return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file sim_eeprom.c
+ * @brief Behavioural model of a 24C02 style serial EEPROM on a simulated
+ * I2C bus
+ *
+ * The first byte written after the address sets the word address, the
+ * bytes after it are stored from there on, and reads go on from the word
+ * address, each moving it on by one and rolling over at the end. A stop
+ * after data bytes starts the write cycle, during which the part NACKs its
+ * address, so the driver has to poll it like a converting sensor. Page
+ * boundaries are not modelled.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** User/developer include files
+#include "sim_eeprom.h"
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static bool sim_eeprom_start(SIM_DEVICE_STRUCT *dev, bool read);
+static bool sim_eeprom_write(SIM_DEVICE_STRUCT *dev, uint8_t byte);
+static uint8_t sim_eeprom_read(SIM_DEVICE_STRUCT *dev);
+static void sim_eeprom_stop(SIM_DEVICE_STRUCT *dev);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Powers up an erased part, every byte 0xFF
+ *
+ * @details
+ *	write_ms is the length of the write cycle, 0 for a part that stores at
+ *	once. Attach it to a bus with sim_i2c_attach(&ee->dev).
+ *
+ ******************************************************************************/
+void sim_eeprom_init(SIM_EEPROM_STRUCT *ee, uint8_t address, uint32_t write_ms){
+	*ee = (SIM_EEPROM_STRUCT){
+		.dev = { address, sim_eeprom_start, sim_eeprom_write, sim_eeprom_read, sim_eeprom_stop, 0 },
+		.write_ms = write_ms
+	};
+	for(int i = 0; i < SIM_EEPROM_SIZE; i++){
+		ee->memory[i] = 0xFF;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Addressed after a start, nothing is answered during a write cycle
+ *
+ ******************************************************************************/
+static bool sim_eeprom_start(SIM_DEVICE_STRUCT *dev, bool read){
+	SIM_EEPROM_STRUCT *ee = (SIM_EEPROM_STRUCT *)dev;
+	if(sim_time_ns() < ee->ready_ns){
+		ee->busy_nacks++;
+		return false;
+	}
+	ee->addressing = !read;
+	ee->written = 0;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes the word address, then the data
+ *
+ ******************************************************************************/
+static bool sim_eeprom_write(SIM_DEVICE_STRUCT *dev, uint8_t byte){
+	SIM_EEPROM_STRUCT *ee = (SIM_EEPROM_STRUCT *)dev;
+	if(ee->addressing){
+		ee->pointer = byte;
+		ee->addressing = false;
+	} else {
+		ee->memory[ee->pointer++] = byte;
+		ee->written++;
+	}
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sends the byte at the word address and moves it on
+ *
+ ******************************************************************************/
+static uint8_t sim_eeprom_read(SIM_DEVICE_STRUCT *dev){
+	SIM_EEPROM_STRUCT *ee = (SIM_EEPROM_STRUCT *)dev;
+	return ee->memory[ee->pointer++];
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts the write cycle if data was written
+ *
+ * @details
+ *	Called for a repeated start too, which on the part abandons the write.
+ *	Both end the write phase the same way for the driver, so the model
+ *	starts the cycle on either.
+ *
+ ******************************************************************************/
+static void sim_eeprom_stop(SIM_DEVICE_STRUCT *dev){
+	SIM_EEPROM_STRUCT *ee = (SIM_EEPROM_STRUCT *)dev;
+	if(ee->written && ee->write_ms){
+		ee->write_cycles++;
+		ee->ready_ns = sim_time_ns() + ee->write_ms * SIM_NS_PER_MS;
+	}
+	ee->written = 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file sim_eeprom.h
+ * @brief Behavioural model of a 24C02 style serial EEPROM on a simulated
+ * I2C bus
+ *
+ */
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "sim.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_EEPROM_ADDR			0x50	// A2 to A0 tied low
+#define SIM_EEPROM_SIZE			256
+#define SIM_EEPROM_WRITE_MS		5		// write cycle, data sheet maximum
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef struct {
+	SIM_DEVICE_STRUCT	dev;			// first, the bus passes this back
+	uint8_t		memory[SIM_EEPROM_SIZE];
+	uint8_t		pointer;				// word address of the next read or write
+	bool		addressing;				// next byte written is the word address
+	uint32_t	written;				// bytes written since the start
+	uint32_t	write_ms;				// write cycle after a stop, 0 for none
+	uint64_t	ready_ns;				// end of the write cycle
+	uint32_t	write_cycles;			// write cycles started
+	uint32_t	busy_nacks;				// addresses NACKed while busy
+} SIM_EEPROM_STRUCT;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_eeprom_init(SIM_EEPROM_STRUCT *ee, uint8_t address, uint32_t write_ms);
+
+#endif /* SIM_EEPROM_H */
@@ -0,0 +1,837 @@
+/**
+ * @file sim_i2c.c
+ * @brief Simulated I2C0, I2C1 and LDMA of the EFM32PG12
+ *
+ * Each bus runs its master one bus operation at a time: the start and
+ * address, a data byte each way, an ACK or NACK bit and the stop, each
+ * taking its bit times at the frequency set by I2C_Init() or
+ * I2C_BusFreqSet(). The flags are set the way the reference manual gives
+ * them, so the driver sees the same ACK, NACK, RXDATAV, TXC and MSTOP
+ * interrupts it does on the board. RXDATAV and TXBL follow the buffers.
+ *
+ * A register write is applied on the next access to any simulated register,
+ * or when the simulation runs, so at most one write is ever waiting.
+ *
+ * Faults are injected per bus operation, see sim_i2c_fault() and
+ * sim_i2c_stretch(). ARBLOST and BUSERR release the bus like the hardware
+ * does, a CLTO or BITO timeout leaves it held until CMD ABORT.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <stdio.h>
+#include <stdlib.h>
+
+//** Silicon Lab include files
+#include "em_i2c.h"
+#include "em_ldma.h"
+#include "em_gpio.h"
+
+//** User/developer include files
+#include "i2c.h"
+#include "sim.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_BITS_ADDRESS	10	// start, 7 address bits, direction and ACK
+#define SIM_BITS_WRITE		9	// data and ACK
+#define SIM_BITS_READ		8	// data, the master sends the ACK after
+#define SIM_BITS_ACK		1
+#define SIM_BITS_STOP		1
+#define SIM_PORTS			6
+#define SIM_PINS			16
+#define SIM_PCC_PER_SCL		8	// prescaled clocks per SCL period, Nlow + Nhigh of 4:4
+
+#define SIM_REGS_EMPTY		{ SIM_EMPTY }
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+typedef enum {
+	SIM_OP_NONE,
+	SIM_OP_ADDRESS,
+	SIM_OP_WRITE,
+	SIM_OP_READ,
+	SIM_OP_ACK,
+	SIM_OP_NACK,
+	SIM_OP_STOP
+} SIM_OP;
+
+typedef struct {
+	I2C_TypeDef			*i2c;
+	uint32_t			freq;		// SCL frequency
+	SIM_DEVICE_STRUCT	*devices;	// on the bus
+	SIM_DEVICE_STRUCT	*device;	// addressed and answering, or null
+	uint32_t			flags;		// IF, less the RXDATAV and TXBL levels
+	bool				owned;		// start sent, no stop yet
+	bool				start;		// START command waiting
+	bool				stop;		// STOP command waiting
+	bool				ack;		// ACK command waiting
+	bool				nack;		// NACK command waiting
+	bool				tx_full;
+	uint8_t				tx_byte;
+	bool				rx_full;
+	uint8_t				rx_byte;
+	bool				rx_wait;	// byte received, SCL held until ACK or NACK
+	bool				reading;	// master receiver after a read address
+	uint8_t				shift;		// byte on the wire
+	SIM_OP				op;
+	uint64_t			op_end;
+	uint32_t			op_fault;	// flag the running operation ends in, 0 for none
+	uint32_t			ops;		// operations started
+	uint32_t			fault_op;	// operation to fail, 0 for none
+	uint32_t			fault_flag;
+	uint32_t			stretch_op;	// operation a device holds SCL low in, 0 for none
+	uint64_t			stretch_ns;
+	bool				hung;		// timed out, held until CMD ABORT
+	uint64_t			owned_at;
+	SIM_BUS_STATS_STRUCT	stats;
+} SIM_BUS_STRUCT;
+
+typedef struct {
+	bool						active;
+	bool						done;		// last list ran to its end
+	const LDMA_Descriptor_t		*desc;
+	uint32_t					signal;
+	uint32_t					remaining;
+	uintptr_t					src;
+	uintptr_t					dst;
+	SIM_LDMA_STATS_STRUCT		stats;
+} SIM_LDMA_CH_STRUCT;
+
+typedef struct {
+	bool		low;
+	uint32_t	toggles;
+} SIM_PIN_STRUCT;
+
+I2C_TypeDef sim_i2c0 = {
+	.cmd_reg = SIM_REGS_EMPTY, .txdata_reg = SIM_REGS_EMPTY,
+	.ifs_reg = SIM_REGS_EMPTY, .ifc_reg = SIM_REGS_EMPTY
+};
+I2C_TypeDef sim_i2c1 = {
+	.cmd_reg = SIM_REGS_EMPTY, .txdata_reg = SIM_REGS_EMPTY,
+	.ifs_reg = SIM_REGS_EMPTY, .ifc_reg = SIM_REGS_EMPTY
+};
+
+static SIM_BUS_STRUCT buses[I2C_BUSES] = {
+	{ .i2c = &sim_i2c0, .freq = I2C_FREQ_STANDARD_MAX },
+	{ .i2c = &sim_i2c1, .freq = I2C_FREQ_STANDARD_MAX }
+};
+static SIM_LDMA_CH_STRUCT channels[LDMA_CHANNELS];
+static uint32_t ldma_if, ldma_ien;
+static SIM_PIN_STRUCT pins[SIM_PORTS][SIM_PINS];
+static bool syncing;
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static SIM_BUS_STRUCT *sim_bus(I2C_TypeDef *i2c);
+static uint32_t sim_bus_if(SIM_BUS_STRUCT *b);
+static void sim_bus_abort(SIM_BUS_STRUCT *b);
+static uint64_t sim_bus_timeout_ns(SIM_BUS_STRUCT *b, uint32_t pcc);
+static void sim_bus_fail(SIM_BUS_STRUCT *b, uint32_t flag);
+static void sim_bus_cmd(SIM_BUS_STRUCT *b, uint32_t cmd);
+static void sim_bus_op(SIM_BUS_STRUCT *b, SIM_OP op, uint32_t bits);
+static bool sim_bus_kick(SIM_BUS_STRUCT *b);
+static void sim_bus_complete(SIM_BUS_STRUCT *b);
+static void sim_bus_writes(SIM_BUS_STRUCT *b);
+static bool sim_ldma_service(uint32_t ch);
+static void sim_ldma_next(uint32_t ch);
+static void sim_ldma_write(uintptr_t addr, uint32_t value);
+static void sim_i2c_sync(void);
+static uint64_t sim_i2c_next_ns(void);
+static void sim_i2c_advance(uint64_t now);
+static bool sim_i2c0_pending(void);
+static bool sim_i2c1_pending(void);
+static bool sim_ldma_pending(void);
+
+static const uint32_t clto_pcc[8] = { 0, 40, 80, 160, 320, 1024, 0, 0 };
+static const uint32_t bito_pcc[4] = { 0, 40, 80, 160 };
+
+static const SIM_MODULE_STRUCT sim_i2c_module = {
+	sim_i2c_sync, sim_i2c_next_ns, sim_i2c_advance
+};
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Connects the I2C and LDMA interrupts and the bus timing at start up
+ *
+ ******************************************************************************/
+__attribute__((constructor)) static void sim_i2c_init(void){
+	sim_module_register(&sim_i2c_module);
+	sim_irq_connect(LDMA_IRQn, LDMA_IRQHandler, sim_ldma_pending);
+	sim_irq_connect(I2C0_IRQn, I2C0_IRQHandler, sim_i2c0_pending);
+	sim_irq_connect(I2C1_IRQn, I2C1_IRQHandler, sim_i2c1_pending);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the simulation of an I2C peripheral
+ *
+ ******************************************************************************/
+static SIM_BUS_STRUCT *sim_bus(I2C_TypeDef *i2c){
+	if(i2c == I2C0) return &buses[0];
+	if(i2c == I2C1) return &buses[1];
+	fprintf(stderr, "sim: %p is not an I2C peripheral\n", (void *)i2c);
+	exit(2);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Puts a device on a bus
+ *
+ ******************************************************************************/
+void sim_i2c_attach(I2C_TypeDef *i2c, SIM_DEVICE_STRUCT *dev){
+	SIM_BUS_STRUCT *b = sim_bus(i2c);
+	dev->next = b->devices;
+	b->devices = dev;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the SCL frequency a bus is set to
+ *
+ ******************************************************************************/
+uint32_t sim_i2c_freq(I2C_TypeDef *i2c){
+	return sim_bus(i2c)->freq;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Copies what a bus has carried
+ *
+ ******************************************************************************/
+void sim_i2c_stats(I2C_TypeDef *i2c, SIM_BUS_STATS_STRUCT *stats){
+	*stats = sim_bus(i2c)->stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Fails a coming bus operation with a fault
+ *
+ * @details
+ *	ops counts the operations from the next one started, 1 for the next.
+ *	I2C_IF_ARBLOST and I2C_IF_BUSERR end that operation instead of its ACK,
+ *	data or stop, and the master lets go of the bus. I2C_IF_BITO leaves SCL
+ *	idle high in it, so the flag comes after the BITO timeout set in CTRL
+ *	and the bus stays busy until aborted. The device sees nothing of it.
+ *
+ ******************************************************************************/
+void sim_i2c_fault(I2C_TypeDef *i2c, uint32_t flag, uint32_t ops){
+	SIM_BUS_STRUCT *b = sim_bus(i2c);
+	sim_sync();
+	b->fault_op = b->ops + ops;
+	b->fault_flag = flag;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Has the addressed device hold SCL low in a coming bus operation
+ *
+ * @details
+ *	The operation takes us longer. Past the CLTO timeout set in CTRL it ends
+ *	in I2C_IF_CLTO instead, with the bus held until aborted.
+ *
+ ******************************************************************************/
+void sim_i2c_stretch(I2C_TypeDef *i2c, uint32_t ops, uint32_t us){
+	SIM_BUS_STRUCT *b = sim_bus(i2c);
+	sim_sync();
+	b->stretch_op = b->ops + ops;
+	b->stretch_ns = us * 1000ull;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Copies what an LDMA channel has moved
+ *
+ ******************************************************************************/
+void sim_ldma_stats(uint32_t ch, SIM_LDMA_STATS_STRUCT *stats){
+	*stats = channels[ch].stats;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the IF register of a bus, with the buffer levels
+ *
+ ******************************************************************************/
+static uint32_t sim_bus_if(SIM_BUS_STRUCT *b){
+	return b->flags | (b->tx_full ? 0 : I2C_IF_TXBL) | (b->rx_full ? I2C_IF_RXDATAV : 0);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Releases the bus at once, as CMD ABORT does
+ *
+ ******************************************************************************/
+static void sim_bus_abort(SIM_BUS_STRUCT *b){
+	if(b->owned){
+		b->stats.aborts++;
+		b->stats.busy_ns += sim_time_ns() - b->owned_at;
+		if(b->device && b->device->stop) b->device->stop(b->device);
+	}
+	b->device = 0;
+	b->owned = b->start = b->stop = b->ack = b->nack = false;
+	b->tx_full = b->rx_full = b->rx_wait = b->reading = false;
+	b->hung = false;
+	b->op = SIM_OP_NONE;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns a CTRL timeout of pcc prescaled clocks in ns, 0 when it is off
+ *
+ ******************************************************************************/
+static uint64_t sim_bus_timeout_ns(SIM_BUS_STRUCT *b, uint32_t pcc){
+	return (uint64_t)pcc * 1000000000ull / ((uint64_t)b->freq * SIM_PCC_PER_SCL);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Ends the running bus operation in a fault
+ *
+ * @details
+ *	Arbitration lost and a bus error make the master let go of the bus at
+ *	once. A timeout leaves it busy until CMD ABORT.
+ *
+ ******************************************************************************/
+static void sim_bus_fail(SIM_BUS_STRUCT *b, uint32_t flag){
+	b->stats.faults++;
+	b->flags |= flag;
+	if(flag & (I2C_IF_ARBLOST | I2C_IF_BUSERR)){
+		b->stats.busy_ns += sim_time_ns() - b->owned_at;
+		if(b->device && b->device->stop) b->device->stop(b->device);
+		b->device = 0;
+		b->owned = b->start = b->stop = b->ack = b->nack = false;
+		b->tx_full = b->rx_wait = b->reading = false;
+	} else {
+		b->hung = true;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes a write to CMD
+ *
+ ******************************************************************************/
+static void sim_bus_cmd(SIM_BUS_STRUCT *b, uint32_t cmd){
+	if(cmd & I2C_CMD_ABORT){
+		sim_bus_abort(b);
+		return;
+	}
+	if(cmd & I2C_CMD_START) b->start = true;
+	if(cmd & I2C_CMD_STOP) b->stop = true;
+	if(cmd & I2C_CMD_CLEARTX) b->tx_full = false;
+	if((cmd & I2C_CMD_ACK) && b->rx_wait) b->ack = true;
+	if((cmd & I2C_CMD_NACK) && b->rx_wait) b->nack = true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts a bus operation of bits SCL periods
+ *
+ ******************************************************************************/
+static void sim_bus_op(SIM_BUS_STRUCT *b, SIM_OP op, uint32_t bits){
+	uint64_t now = sim_time_ns();
+	b->op = op;
+	b->op_end = now + (uint64_t)bits * 1000000000ull / b->freq;
+	b->op_fault = 0;
+	b->ops++;
+	if(b->ops == b->stretch_op){
+		uint64_t clto = sim_bus_timeout_ns(b, clto_pcc[(b->i2c->CTRL & _I2C_CTRL_CLTO_MASK) >> _I2C_CTRL_CLTO_SHIFT]);
+		if(clto && b->stretch_ns >= clto){
+			b->op_end = now + clto;
+			b->op_fault = I2C_IF_CLTO;
+		} else {
+			b->op_end += b->stretch_ns;
+		}
+	}
+	if(b->ops == b->fault_op){
+		b->op_fault = b->fault_flag;
+		if(b->fault_flag == I2C_IF_BITO){
+			uint64_t bito = sim_bus_timeout_ns(b, bito_pcc[(b->i2c->CTRL & _I2C_CTRL_BITO_MASK) >> _I2C_CTRL_BITO_SHIFT]);
+			b->op_end = bito ? b->op_end + bito : UINT64_MAX;
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Starts the next bus operation if the master has one to do
+ *
+ * @details
+ *	A received byte holds SCL low until it is ACKed or NACKed. Then a stop
+ *	goes first, then a start once its address is in TXDATA, then a data byte
+ *	either way. A read waits for room in the receive buffer.
+ *
+ * @return
+ * 	true if an operation was started.
+ *
+ ******************************************************************************/
+static bool sim_bus_kick(SIM_BUS_STRUCT *b){
+	if(b->op != SIM_OP_NONE || b->hung) return false;
+	if(b->rx_wait){
+		if(!b->ack && !b->nack) return false;
+		sim_bus_op(b, b->nack ? SIM_OP_NACK : SIM_OP_ACK, SIM_BITS_ACK);
+		b->rx_wait = b->ack = b->nack = false;
+		return true;
+	}
+	if(b->stop){
+		b->stop = false;
+		if(!b->owned) return false; // nothing to stop
+		sim_bus_op(b, SIM_OP_STOP, SIM_BITS_STOP);
+		return true;
+	}
+	if(b->start && b->tx_full){
+		if(b->owned && b->device && b->device->stop) b->device->stop(b->device); // repeated start
+		if(!b->owned) b->owned_at = sim_time_ns();
+		b->owned = true;
+		b->start = b->reading = false;
+		b->device = 0;
+		b->shift = b->tx_byte;
+		b->tx_full = false;
+		sim_bus_op(b, SIM_OP_ADDRESS, SIM_BITS_ADDRESS);
+		return true;
+	}
+	if(b->owned && !b->start && !b->reading && b->tx_full){
+		b->shift = b->tx_byte;
+		b->tx_full = false;
+		sim_bus_op(b, SIM_OP_WRITE, SIM_BITS_WRITE);
+		return true;
+	}
+	if(b->owned && b->reading && !b->rx_full){
+		sim_bus_op(b, SIM_OP_READ, SIM_BITS_READ);
+		return true;
+	}
+	return false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Ends the running bus operation and sets its flags
+ *
+ ******************************************************************************/
+static void sim_bus_complete(SIM_BUS_STRUCT *b){
+	SIM_OP op = b->op;
+	bool ack;
+	b->op = SIM_OP_NONE;
+	if(b->op_fault){
+		sim_bus_fail(b, b->op_fault);
+		return;
+	}
+	switch(op){
+		case SIM_OP_ADDRESS:
+			b->stats.addresses++;
+			for(SIM_DEVICE_STRUCT *dev = b->devices; dev; dev = dev->next){
+				if(dev->address == (b->shift >> 1)){
+					b->device = dev;
+					break;
+				}
+			}
+			ack = b->device && b->device->start(b->device, b->shift & 1);
+			if(ack){
+				b->reading = b->shift & 1;
+				b->flags |= I2C_IF_ACK;
+			} else {
+				b->device = 0;
+				b->stats.nacks++;
+				b->flags |= I2C_IF_NACK;
+			}
+			break;
+		case SIM_OP_WRITE:
+			b->stats.bytes++;
+			ack = b->device && b->device->write(b->device, b->shift);
+			if(!ack) b->stats.nacks++;
+			b->flags |= ack ? I2C_IF_ACK : I2C_IF_NACK;
+			if(!b->tx_full) b->flags |= I2C_IF_TXC;
+			break;
+		case SIM_OP_READ:
+			b->stats.bytes++;
+			b->rx_byte = b->device ? b->device->read(b->device) : 0xFF;
+			b->rx_full = true;
+			b->rx_wait = true;
+			if(b->i2c->CTRL & I2C_CTRL_AUTOACK) b->ack = true;
+			break;
+		case SIM_OP_NACK:
+			b->reading = false;
+			break;
+		case SIM_OP_STOP:
+			b->stats.stops++;
+			b->stats.busy_ns += sim_time_ns() - b->owned_at;
+			if(b->device && b->device->stop) b->device->stop(b->device);
+			b->device = 0;
+			b->owned = b->reading = false;
+			b->flags |= I2C_IF_MSTOP;
+			break;
+		default:
+			break;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Applies the register write waiting on a bus, if any
+ *
+ ******************************************************************************/
+static void sim_bus_writes(SIM_BUS_STRUCT *b){
+	I2C_TypeDef *i2c = b->i2c;
+	uint32_t value;
+	if((value = i2c->ifs_reg[0]) != SIM_EMPTY){
+		i2c->ifs_reg[0] = SIM_EMPTY;
+		b->flags |= value;
+	}
+	if((value = i2c->ifc_reg[0]) != SIM_EMPTY){
+		i2c->ifc_reg[0] = SIM_EMPTY;
+		b->flags &= ~value;
+	}
+	if((value = i2c->txdata_reg[0]) != SIM_EMPTY){
+		i2c->txdata_reg[0] = SIM_EMPTY;
+		if(b->tx_full) b->flags |= I2C_IF_TXOF;
+		b->tx_byte = value;
+		b->tx_full = true;
+	}
+	if((value = i2c->cmd_reg[0]) != SIM_EMPTY){
+		i2c->cmd_reg[0] = SIM_EMPTY;
+		sim_bus_cmd(b, value);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Applies register writes, LDMA requests and bus operations until nothing
+ *	more can happen without time passing
+ *
+ ******************************************************************************/
+static void sim_i2c_sync(void){
+	bool changed;
+	if(syncing) return;
+	syncing = true;
+	for(int i = 0; i < I2C_BUSES; i++){
+		sim_bus_writes(&buses[i]);
+	}
+	do {
+		changed = false;
+		for(uint32_t ch = 0; ch < LDMA_CHANNELS; ch++){
+			while(sim_ldma_service(ch)) changed = true;
+		}
+		for(int i = 0; i < I2C_BUSES; i++){
+			changed |= sim_bus_kick(&buses[i]);
+		}
+	} while(changed);
+	syncing = false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns when the next bus operation ends
+ *
+ ******************************************************************************/
+static uint64_t sim_i2c_next_ns(void){
+	uint64_t next = UINT64_MAX;
+	for(int i = 0; i < I2C_BUSES; i++){
+		if(buses[i].op != SIM_OP_NONE && buses[i].op_end < next) next = buses[i].op_end;
+	}
+	return next;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Ends the bus operations due by now
+ *
+ ******************************************************************************/
+static void sim_i2c_advance(uint64_t now){
+	for(int i = 0; i < I2C_BUSES; i++){
+		if(buses[i].op != SIM_OP_NONE && buses[i].op_end <= now) sim_bus_complete(&buses[i]);
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Interrupt lines of the I2C peripherals and the LDMA
+ *
+ ******************************************************************************/
+static bool sim_i2c0_pending(void){
+	return sim_bus_if(&buses[0]) & sim_i2c0.IEN;
+}
+
+static bool sim_i2c1_pending(void){
+	return sim_bus_if(&buses[1]) & sim_i2c1.IEN;
+}
+
+static bool sim_ldma_pending(void){
+	return ldma_if & ldma_ien;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Register accesses with side effects, see em_device.h
+ *
+ * @details
+ *	A write is applied at the next access, so each of these first applies the
+ *	one before it. A read of STATE or IF then refreshes both of them. RXDATA
+ *	belongs to the bus whose handler is running, the only place the driver
+ *	reads it.
+ *
+ ******************************************************************************/
+uint32_t sim_reg_write(void){
+	sim_sync();
+	return 0;
+}
+
+uint32_t sim_reg_read(void){
+	sim_sync();
+	for(int i = 0; i < I2C_BUSES; i++){
+		SIM_BUS_STRUCT *b = &buses[i];
+		bool idle = !b->owned && !b->start && b->op == SIM_OP_NONE;
+		b->i2c->state_reg[0] = idle ? I2C_STATE_STATE_IDLE : (I2C_STATE_STATE_WAIT | I2C_STATE_BUSY);
+		b->i2c->if_reg[0] = sim_bus_if(b);
+	}
+	return 0;
+}
+
+uint32_t sim_rxdata_read(void){
+	SIM_BUS_STRUCT *b;
+	sim_sync();
+	if(sim_active_irq() == I2C0_IRQn){
+		b = &buses[0];
+	} else if(sim_active_irq() == I2C1_IRQn){
+		b = &buses[1];
+	} else {
+		sim_check(false, "RXDATA read outside an I2C interrupt handler");
+		return 0;
+	}
+	b->i2c->rxdata_reg[0] = b->rx_byte;
+	b->rx_full = false;
+	return 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	emlib I2C functions that are not inline
+ *
+ ******************************************************************************/
+void I2C_Init(I2C_TypeDef *i2c, const I2C_Init_TypeDef *init){
+	I2C_BusFreqSet(i2c, init->refFreq, init->freq, init->clhr);
+	if(init->enable) i2c->CTRL |= I2C_CTRL_EN;
+}
+
+void I2C_BusFreqSet(I2C_TypeDef *i2c, uint32_t freqRef, uint32_t freqScl, I2C_ClockHLR_TypeDef i2cMode){
+	SIM_BUS_STRUCT *b = sim_bus(i2c);
+	(void)freqRef; // the simulated bus times from freqScl alone
+	(void)i2cMode;
+	sim_check(b->op == SIM_OP_NONE && !b->owned, "I2C_BusFreqSet with the bus busy");
+	b->freq = freqScl;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Bus reset pins
+ *
+ * @details
+ *	Every pin reads high, released, unless a test holds it low with
+ *	sim_pin_hold().
+ *
+ ******************************************************************************/
+void GPIO_PinOutToggle(GPIO_Port_TypeDef port, unsigned int pin){
+	pins[port][pin].toggles++;
+}
+
+unsigned int GPIO_PinInGet(GPIO_Port_TypeDef port, unsigned int pin){
+	return !pins[port][pin].low;
+}
+
+uint32_t sim_pin_toggles(uint32_t port, uint32_t pin){
+	return pins[port][pin].toggles;
+}
+
+void sim_pin_hold(uint32_t port, uint32_t pin, bool low){
+	pins[port][pin].low = low;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Moves one item of an LDMA channel if its request is active
+ *
+ * @details
+ *	Write descriptors run as soon as they are loaded. A transfer descriptor
+ *	moves a byte to TXDATA while the transmit buffer is empty, or from RXDATA
+ *	while the receive buffer holds one, and checks the peripheral address is
+ *	the register of the requesting bus.
+ *
+ * @return
+ * 	true if anything was done.
+ *
+ ******************************************************************************/
+static bool sim_ldma_service(uint32_t ch){
+	SIM_LDMA_CH_STRUCT *c = &channels[ch];
+	if(!c->active) return false;
+	if(c->desc->xfer.structType == ldmaCtrlStructTypeWrite){
+		sim_ldma_write(c->desc->wri.dstAddr, c->desc->wri.immVal);
+		if(c->active) sim_ldma_next(ch);
+		return true;
+	}
+	bool tx = c->signal == ldmaPeripheralSignal_I2C0_TXBL || c->signal == ldmaPeripheralSignal_I2C1_TXBL;
+	bool bus1 = c->signal == ldmaPeripheralSignal_I2C1_TXBL || c->signal == ldmaPeripheralSignal_I2C1_RXDATAV;
+	SIM_BUS_STRUCT *b = &buses[bus1];
+	if(tx){
+		if(b->tx_full) return false;
+		if(c->dst != (uintptr_t)&b->i2c->txdata_reg[0]){
+			ldma_if |= LDMA_IF_ERROR;
+			c->active = false;
+			return true;
+		}
+		b->tx_byte = *(const uint8_t *)c->src;
+		b->tx_full = true;
+		c->src += c->desc->xfer.srcInc;
+	} else {
+		if(!b->rx_full) return false;
+		if(c->src != (uintptr_t)&b->i2c->rxdata_reg[0]){
+			ldma_if |= LDMA_IF_ERROR;
+			c->active = false;
+			return true;
+		}
+		*(uint8_t *)c->dst = b->rx_byte;
+		b->rx_full = false;
+		c->dst += c->desc->xfer.dstInc;
+	}
+	c->stats.bytes++;
+	if(--c->remaining == 0) sim_ldma_next(ch);
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Ends a descriptor and loads the one it links to
+ *
+ ******************************************************************************/
+static void sim_ldma_next(uint32_t ch){
+	SIM_LDMA_CH_STRUCT *c = &channels[ch];
+	if(c->desc->xfer.doneIfs) ldma_if |= 1u << ch;
+	if(c->desc->xfer.link){
+		c->desc += c->desc->xfer.linkAddr;
+		c->remaining = c->desc->xfer.xferCnt + 1;
+		c->src = c->desc->xfer.srcAddr;
+		c->dst = c->desc->xfer.dstAddr;
+	} else {
+		c->active = false;
+		c->done = true;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs a write descriptor
+ *
+ * @details
+ *	The bit set and bit clear aliases and plain writes may only reach CTRL and
+ *	IEN of an I2C peripheral, anything else is a bus error of the LDMA.
+ *
+ ******************************************************************************/
+static void sim_ldma_write(uintptr_t addr, uint32_t value){
+	int mode = 0;
+	if(addr & PER_BITSET_MEM_BASE){
+		addr -= PER_BITSET_MEM_BASE;
+		mode = 1;
+	} else if(addr & PER_BITCLR_MEM_BASE){
+		addr -= PER_BITCLR_MEM_BASE;
+		mode = -1;
+	}
+	for(int i = 0; i < I2C_BUSES; i++){
+		I2C_TypeDef *i2c = buses[i].i2c;
+		if(addr == (uintptr_t)&i2c->CTRL || addr == (uintptr_t)&i2c->IEN){
+			volatile uint32_t *reg = (volatile uint32_t *)addr;
+			*reg = mode > 0 ? (*reg | value) : mode < 0 ? (*reg & ~value) : value;
+			return;
+		}
+	}
+	ldma_if |= LDMA_IF_ERROR;
+	for(uint32_t ch = 0; ch < LDMA_CHANNELS; ch++){
+		channels[ch].active = false;
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	emlib LDMA functions
+ *
+ ******************************************************************************/
+void LDMA_Init(const LDMA_Init_t *init){
+	(void)init;
+	ldma_ien = LDMA_IF_ERROR;
+	NVIC_EnableIRQ(LDMA_IRQn);
+}
+
+void LDMA_StartTransfer(int ch, const LDMA_TransferCfg_t *transfer, const LDMA_Descriptor_t *descriptor){
+	SIM_LDMA_CH_STRUCT *c = &channels[ch];
+	c->desc = descriptor;
+	c->signal = transfer->ldmaReqSel;
+	c->remaining = descriptor->xfer.xferCnt + 1;
+	c->src = descriptor->xfer.srcAddr;
+	c->dst = descriptor->xfer.dstAddr;
+	c->active = true;
+	c->done = false;
+	c->stats.transfers++;
+	c->stats.signals |= 1u << c->signal;
+	ldma_if &= ~(1u << ch);
+	ldma_ien |= 1u << ch;
+}
+
+void LDMA_StopTransfer(int ch){
+	channels[ch].active = false;
+	ldma_ien &= ~(1u << ch);
+}
+
+bool LDMA_TransferDone(int ch){
+	sim_sync();
+	return !channels[ch].active && channels[ch].done;
+}
+
+uint32_t LDMA_IntGet(void){
+	return ldma_if;
+}
+
+uint32_t LDMA_IntGetEnabled(void){
+	return ldma_if & ldma_ien;
+}
+
+void LDMA_IntClear(uint32_t flags){
+	ldma_if &= ~flags;
+}
+
+void LDMA_IntEnable(uint32_t flags){
+	ldma_ien |= flags;
+}
+
+void LDMA_IntDisable(uint32_t flags){
+	ldma_ien &= ~flags;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs the simulation while the firmware waits for a bus
+ *
+ * @details
+ *	The firmware spins on i2c_idle() until its transactions are done. Linked
+ *	with --wrap=i2c_idle, each call that finds the bus busy moves the
+ *	simulation to its next event. If there is none the transaction can never
+ *	finish, which on the board would hang.
+ *
+ ******************************************************************************/
+bool __real_i2c_idle(I2C_TypeDef *i2c);
+
+bool __wrap_i2c_idle(I2C_TypeDef *i2c){
+	if(__real_i2c_idle(i2c)) return true;
+	if(!sim_step()){
+		fprintf(stderr, "sim: I2C%d hangs, nothing left to happen at %.3f ms\n",
+				i2c == I2C1, sim_time_ns() / 1e6);
+		exit(2);
+	}
+	return false;
+}
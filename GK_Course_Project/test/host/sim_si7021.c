@@ -0,0 +1,258 @@
+/**
+ * @file sim_si7021.c
+ * @brief Behavioural model of the Si7021 humidity and temperature sensor on
+ * a simulated I2C bus
+ *
+ * Follows the Si7021-A20 data sheet for what the driver uses: the no hold
+ * measurements F5 and F3 with their checksum, E0, the user register E6 and
+ * E7, the electronic serial number FA 0F and FC C9, and the reset FE. While
+ * powering up, resetting or converting the sensor NACKs its read address.
+ * Conversions take the data sheet's typical time for the resolution set in
+ * UR1, and the codes are the ones the environment would give at it.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** User/developer include files
+#include "SI7021.h"
+#include "sim_si7021.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_NS_PER_US		1000ull
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+// typical conversion times in us and code masks, by the RES1 and RES0 bits of UR1
+static const uint32_t rh_conv_us[SIM_SI7021_RESOLUTIONS] = { 10000, 2600, 3700, 5800 };
+static const uint32_t temp_conv_us[SIM_SI7021_RESOLUTIONS] = { 7000, 2400, 4000, 1500 };
+static const uint16_t rh_mask[SIM_SI7021_RESOLUTIONS] = { 0xFFF0, 0xFF00, 0xFFC0, 0xFFE0 };
+static const uint16_t temp_mask[SIM_SI7021_RESOLUTIONS] = { 0xFFFC, 0xFFF0, 0xFFF8, 0xFFE0 };
+
+static const uint8_t sna[4] = { 0x5E, 0x11, 0x70, 0x21 };
+static const uint8_t snb[4] = { 0x15, 0xFF, 0xFF, 0xFF };	// SNB_3 is the part, 0x15 for the Si7021
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static uint8_t sim_si7021_resolution(const SIM_SI7021_STRUCT *si);
+static void sim_si7021_respond(SIM_SI7021_STRUCT *si, uint16_t code, bool crc);
+static bool sim_si7021_command(SIM_SI7021_STRUCT *si);
+static bool sim_si7021_start(SIM_DEVICE_STRUCT *dev, bool read);
+static bool sim_si7021_write(SIM_DEVICE_STRUCT *dev, uint8_t byte);
+static uint8_t sim_si7021_read(SIM_DEVICE_STRUCT *dev);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Powers up a sensor at 22.5 C and 45 %RH
+ *
+ * @details
+ *	UR1 takes its reset value and the sensor answers SIM_SI7021_POWERUP_MS
+ *	from now. Attach it to a bus with sim_i2c_attach(&si->dev).
+ *
+ ******************************************************************************/
+void sim_si7021_init(SIM_SI7021_STRUCT *si, uint8_t address){
+	*si = (SIM_SI7021_STRUCT){
+		.dev = { address, sim_si7021_start, sim_si7021_write, sim_si7021_read, 0, 0 },
+		.ur1 = SIM_SI7021_UR1_RESET,
+		.ready_ns = sim_time_ns() + SIM_SI7021_POWERUP_MS * SIM_NS_PER_MS,
+		.temp_mc = 22500,
+		.rh_m = 45000
+	};
+}
+
+/***************************************************************************//**
+ * @brief
+ *	CRC-8 of the data sheet, x^8 + x^5 + x^4 + 1 from 0, bit by bit
+ *
+ * @details
+ *	Kept apart from the firmware's nibble table so a mistake in either shows.
+ *
+ ******************************************************************************/
+uint8_t sim_si7021_crc8(const uint8_t *data, uint32_t length){
+	uint8_t crc = 0;
+	for(uint32_t i = 0; i < length; i++){
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++){
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the resolution in the RES1 and RES0 bits of UR1
+ *
+ ******************************************************************************/
+static uint8_t sim_si7021_resolution(const SIM_SI7021_STRUCT *si){
+	return ((si->ur1 >> 6) & 0x2) | (si->ur1 & 0x1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns the codes the environment gives at the resolution in UR1
+ *
+ * @details
+ *	The data sheet's conversions inverted, code = (T + 46.85) * 65536 / 175.72
+ *	and code = (RH + 6) * 65536 / 125, less the bits below the resolution.
+ *
+ ******************************************************************************/
+uint16_t sim_si7021_temp_code(const SIM_SI7021_STRUCT *si){
+	double code = (si->temp_mc / 1000.0 + 46.85) * 65536.0 / 175.72;
+	return (uint16_t)code & temp_mask[sim_si7021_resolution(si)];
+}
+
+uint16_t sim_si7021_rh_code(const SIM_SI7021_STRUCT *si){
+	double code = (si->rh_m / 1000.0 + 6.0) * 65536.0 / 125.0;
+	return (uint16_t)code & rh_mask[sim_si7021_resolution(si)];
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sets the response to a measurement code, MSB first, and its checksum
+ *
+ ******************************************************************************/
+static void sim_si7021_respond(SIM_SI7021_STRUCT *si, uint16_t code, bool crc){
+	si->response[0] = code >> 8;
+	si->response[1] = code & 0xFF;
+	si->response[2] = sim_si7021_crc8(si->response, 2);
+	si->response_length = crc ? 3 : 2;
+	si->response_pos = 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Acts on the command bytes written so far
+ *
+ * @return
+ * 	false to NACK the last byte, which is not part of any command.
+ *
+ ******************************************************************************/
+static bool sim_si7021_command(SIM_SI7021_STRUCT *si){
+	uint64_t now = sim_time_ns();
+	uint8_t res = sim_si7021_resolution(si);
+	uint8_t *cc = si->command;
+
+	if(si->command_length == 1){
+		switch(cc[0]){
+			case SI7021_RH_NO_HOLD:
+				si->conversions++;
+				si->ready_ns = now + (rh_conv_us[res] + temp_conv_us[res]) * SIM_NS_PER_US;
+				si->rh_temp_code = sim_si7021_temp_code(si);
+				sim_si7021_respond(si, sim_si7021_rh_code(si), true);
+				return true;
+			case SI7021_TEMP_NO_HOLD:
+				si->conversions++;
+				si->ready_ns = now + temp_conv_us[res] * SIM_NS_PER_US;
+				sim_si7021_respond(si, sim_si7021_temp_code(si), true);
+				return true;
+			case SI7021_TEMP_FROM_RH:
+				sim_si7021_respond(si, si->rh_temp_code, false);
+				return true;
+			case SI7021_READ_UR1:
+				si->response[0] = si->ur1;
+				si->response_length = 1;
+				si->response_pos = 0;
+				return true;
+			case 0xFE: // reset
+				si->ur1 = SIM_SI7021_UR1_RESET;
+				si->ready_ns = now + SIM_SI7021_RESET_MS * SIM_NS_PER_MS;
+				si->response_length = 0;
+				return true;
+			case SI7021_WRITE_UR1:
+			case SI7021_SNA_MSB:
+			case SI7021_SNB_MSB:
+				return true; // more to come
+			default:
+				break;
+		}
+	} else if(si->command_length == 2){
+		if(cc[0] == SI7021_WRITE_UR1){
+			si->ur1 = (cc[1] & SIM_SI7021_UR1_WRITABLE) | (si->ur1 & ~SIM_SI7021_UR1_WRITABLE);
+			return true;
+		}
+		if(cc[0] == SI7021_SNA_MSB && cc[1] == SI7021_SNA_LSB){
+			// SNA_3 to SNA_0, each followed by its CRC
+			for(int i = 0; i < 4; i++){
+				si->response[2 * i] = sna[i];
+				si->response[2 * i + 1] = sim_si7021_crc8(&sna[i], 1);
+			}
+			si->response_length = 8;
+			si->response_pos = 0;
+			return true;
+		}
+		if(cc[0] == SI7021_SNB_MSB && cc[1] == SI7021_SNB_LSB){
+			// SNB_3, SNB_2, CRC, SNB_1, SNB_0, CRC
+			si->response[0] = snb[0];
+			si->response[1] = snb[1];
+			si->response[2] = sim_si7021_crc8(&snb[0], 2);
+			si->response[3] = snb[2];
+			si->response[4] = snb[3];
+			si->response[5] = sim_si7021_crc8(&snb[2], 2);
+			si->response_length = 6;
+			si->response_pos = 0;
+			return true;
+		}
+	}
+	si->bad_commands++;
+	si->command_length = 0;
+	return false;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Addressed after a start
+ *
+ * @details
+ *	Nothing is answered while powering up or resetting, and a read address
+ *	is NACKed until the conversion is done.
+ *
+ ******************************************************************************/
+static bool sim_si7021_start(SIM_DEVICE_STRUCT *dev, bool read){
+	SIM_SI7021_STRUCT *si = (SIM_SI7021_STRUCT *)dev;
+	if(sim_time_ns() < si->ready_ns){
+		si->busy_nacks++;
+		return false;
+	}
+	if(read){
+		si->response_pos = 0;
+	} else {
+		si->command_length = 0;
+	}
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes a command byte
+ *
+ ******************************************************************************/
+static bool sim_si7021_write(SIM_DEVICE_STRUCT *dev, uint8_t byte){
+	SIM_SI7021_STRUCT *si = (SIM_SI7021_STRUCT *)dev;
+	if(si->command_length >= SIM_SI7021_MAX_COMMAND){
+		si->bad_commands++;
+		return false;
+	}
+	si->command[si->command_length++] = byte;
+	return sim_si7021_command(si);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Sends the next byte of the response, 0xFF past its end
+ *
+ ******************************************************************************/
+static uint8_t sim_si7021_read(SIM_DEVICE_STRUCT *dev){
+	SIM_SI7021_STRUCT *si = (SIM_SI7021_STRUCT *)dev;
+	if(si->response_pos >= si->response_length) return 0xFF;
+	return si->response[si->response_pos++];
+}
@@ -0,0 +1,54 @@
+/**
+ * @file sim_si7021.h
+ * @brief Behavioural model of the Si7021 humidity and temperature sensor on
+ * a simulated I2C bus
+ *
+ */
+#ifndef SIM_SI7021_H
+#define SIM_SI7021_H
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#include "sim.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SIM_SI7021_POWERUP_MS	80		// powerup time, data sheet maximum
+#define SIM_SI7021_RESET_MS		15		// soft reset time, data sheet maximum
+#define SIM_SI7021_UR1_RESET	0x3A	// 12 bit RH, 14 bit temperature, heater off
+#define SIM_SI7021_UR1_WRITABLE	0x85	// RES1, HTRE and RES0, the rest is kept
+#define SIM_SI7021_RESOLUTIONS	4		// RES1 and RES0
+#define SIM_SI7021_MAX_COMMAND	2
+#define SIM_SI7021_MAX_RESPONSE	8
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef struct {
+	SIM_DEVICE_STRUCT	dev;			// first, the bus passes this back
+	uint8_t		ur1;
+	uint8_t		command[SIM_SI7021_MAX_COMMAND];
+	uint8_t		command_length;
+	uint8_t		response[SIM_SI7021_MAX_RESPONSE];	// read after the command
+	uint8_t		response_length;
+	uint8_t		response_pos;
+	uint64_t	ready_ns;				// end of the powerup, reset or conversion
+	uint16_t	rh_temp_code;			// temperature of the last RH measurement
+	int32_t		temp_mc;				// environment, thousandths of a degree C
+	int32_t		rh_m;					// environment, thousandths of a percent
+	uint32_t	conversions;			// RH and temperature measurements started
+	uint32_t	busy_nacks;				// addresses NACKed while busy
+	uint32_t	bad_commands;			// command bytes NACKed
+} SIM_SI7021_STRUCT;
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sim_si7021_init(SIM_SI7021_STRUCT *si, uint8_t address);
+uint8_t sim_si7021_crc8(const uint8_t *data, uint32_t length);
+uint16_t sim_si7021_temp_code(const SIM_SI7021_STRUCT *si);
+uint16_t sim_si7021_rh_code(const SIM_SI7021_STRUCT *si);
+
+#endif /* SIM_SI7021_H */
@@ -0,0 +1,391 @@
+/**
+ * @file test_i2c_fault.c
+ * @brief Injects ARBLOST, BUSERR, CLTO and BITO into every bus operation of
+ * EEPROM transactions on I2C1 and checks i2c_fault() recovers the bus
+ *
+ * Each fault fails the transaction it hits with its I2C_STATUS, through the
+ * status pointer and the payload of the event, and is counted once. After
+ * it the bus must be released, the interrupts and AUTOACK as i2c_open()
+ * left them, the EM2 block given back, and the next transaction fine.
+ *
+ * A NACK of an address or a written byte is not a fault. It must end the
+ * transaction with I2C_STATUS_NACK through a stop, without a recovery.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <stdio.h>
+#include <string.h>
+
+//** Silicon Lab include files
+#include "em_i2c.h"
+#include "em_gpio.h"
+
+//** User/developer include files
+#include "i2c.h"
+#include "letimer.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+#include "sim.h"
+#include "sim_eeprom.h"
+#include "sim_si7021.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define FAULT_I2C				I2C1
+#define FAULT_SCL_PORT			gpioPortC	// the board's I2C1 pins
+#define FAULT_SCL_PIN			11u
+#define FAULT_SDA_PORT			gpioPortC
+#define FAULT_SDA_PIN			10u
+#define FAULT_PATTERN			0x3C	// EEPROM contents, byte i is i ^ pattern
+#define FAULT_SI7021_ADDR		0x40	// a Si7021 on the bus too, it NACKs unknown commands
+#define FAULT_ABSENT_ADDR		0x51	// no device answers
+#define FAULT_EVENT				(1u << 5)
+#define FAULT_MAX_OPS			32		// more operations than any transaction here
+#define FAULT_STRETCH_SHORT_US	100		// under the CLTO timeout at fast mode
+#define FAULT_STRETCH_LONG_US	2000	// over it
+#define FAULT_IEN				(I2C_IEN_ACK | I2C_IEN_NACK | I2C_IEN_RXDATAV | I2C_IEN_MSTOP \
+								| I2C_FAULT_INTERRUPTS)
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+typedef struct {
+	const char		*name;
+	uint8_t			pointer;		// word address
+	uint8_t			write_length;	// data bytes after the word address
+	uint8_t			read_length;
+	I2C_RETRY_STRUCT	retry;
+} FAULT_TRANSACTION_STRUCT;
+
+static const FAULT_TRANSACTION_STRUCT transactions[] = {
+	{ "byte read", 0x10, 0, 1, { I2C_RETRY_IMMEDIATE, 0, 0 } },
+	{ "block read", 0x20, 0, 6, { I2C_RETRY_IMMEDIATE, 0, 0 } },
+	{ "block write", 0x40, 2, 0, { I2C_RETRY_IMMEDIATE, 0, 0 } },
+};
+
+static SIM_EEPROM_STRUCT ee;
+static SIM_SI7021_STRUCT si;
+static uint8_t data[8];
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void open_bus(void);
+static I2C_STATUS transact(const FAULT_TRANSACTION_STRUCT *t);
+static bool read_ok(const FAULT_TRANSACTION_STRUCT *t, const uint8_t *read);
+static void check_recovered(const char *what);
+static void fault_every_op(const FAULT_TRANSACTION_STRUCT *t, uint32_t flag, I2C_STATUS expect);
+static void nack_case(const char *what, uint8_t address, const uint8_t *bytes, uint8_t length);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Opens I2C1 at fast mode on the board's pins, with the LDMA
+ *
+ ******************************************************************************/
+static void open_bus(void){
+	I2C_IO_STRUCT io = {
+		.sda_port = FAULT_SDA_PORT, .sda_pin = FAULT_SDA_PIN,
+		.scl_port = FAULT_SCL_PORT, .scl_pin = FAULT_SCL_PIN
+	};
+	I2C_OPEN_STRUCT open = {
+		.enable = true,
+		.master = true,
+		.refFreq = 0,
+		.freq = I2C_FREQ_FAST_MAX,
+		.chlr = i2cClockHLRAsymetric,
+		.sda_route0 = _I2C_ROUTELOC0_SDALOC_LOC19,
+		.scl_route0 = _I2C_ROUTELOC0_SCLLOC_LOC19,
+		.sda_en = true,
+		.scl_en = true,
+		.ldma = true
+	};
+	i2c_open(FAULT_I2C, &open, &io);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs a transaction to its end and returns its status
+ *
+ * @details
+ *	A write stores what the EEPROM already holds, so the reads after it
+ *	keep their expected data. The status written through the pointer must
+ *	match the payload posted with the event.
+ *
+ ******************************************************************************/
+static I2C_STATUS transact(const FAULT_TRANSACTION_STRUCT *t){
+	uint8_t command[3] = { t->pointer, t->pointer ^ FAULT_PATTERN, (t->pointer + 1) ^ FAULT_PATTERN };
+	I2C_SEGMENT_STRUCT segments[2] = { { &command[0], 1 }, { &command[1], t->write_length } };
+	I2C_STATUS status = I2C_STATUSES;
+	SCHEDULER_MSG_STRUCT msg;
+	I2C_START_STRUCT start = {
+		.device_address = SIM_EEPROM_ADDR,
+		.read = t->read_length != 0,
+		.segments = segments,
+		.segment_count = t->write_length ? 2 : 1,
+		.read_arr = data,
+		.read_length = t->read_length,
+		.event = FAULT_EVENT,
+		.retry = t->retry,
+		.status = &status
+	};
+
+	memset(data, 0, sizeof(data));
+	sim_check(i2c_start(FAULT_I2C, &start), "transaction queued");
+	while(!i2c_idle(FAULT_I2C));
+	sim_check(scheduler_get_msg(&msg) && msg.event == FAULT_EVENT && msg.payload == status,
+			"event posted with the status as payload");
+	sim_check(!scheduler_get_msg(&msg), "one event per transaction");
+	return status;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns true if a read got what the EEPROM holds after the word address
+ *	and any data bytes written before it
+ *
+ ******************************************************************************/
+static bool read_ok(const FAULT_TRANSACTION_STRUCT *t, const uint8_t *read){
+	for(int i = 0; i < t->read_length; i++){
+		if(read[i] != (uint8_t)((t->pointer + t->write_length + i) ^ FAULT_PATTERN)) return false;
+	}
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Checks the bus is back as i2c_open() left it and still works
+ *
+ ******************************************************************************/
+static void check_recovered(const char *what){
+	char check[128];
+
+	snprintf(check, sizeof(check), "%s: EM2 block released", what);
+	sim_check(sim_sleep_blocks(EM2, SLEEP_OWNER_I2C) == 0, check);
+	snprintf(check, sizeof(check), "%s: interrupts restored", what);
+	sim_check(FAULT_I2C->IEN == FAULT_IEN, check);
+	snprintf(check, sizeof(check), "%s: AUTOACK off", what);
+	sim_check(!(FAULT_I2C->CTRL & I2C_CTRL_AUTOACK), check);
+	snprintf(check, sizeof(check), "%s: next transaction fine", what);
+	sim_check(transact(&transactions[0]) == I2C_STATUS_OK && read_ok(&transactions[0], data), check);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Faults each bus operation of a transaction in turn
+ *
+ * @details
+ *	Goes on until the fault is armed past the last operation, which the
+ *	transaction must then finish without. CLTO comes from a device holding
+ *	SCL past the timeout, the others are set on the operation.
+ *
+ ******************************************************************************/
+static void fault_every_op(const FAULT_TRANSACTION_STRUCT *t, uint32_t flag, I2C_STATUS expect){
+	char what[96];
+	I2C_ERROR_STATS_STRUCT before, after;
+	SIM_BUS_STATS_STRUCT bus_before, bus_after;
+	uint32_t op;
+
+	for(op = 1; op < FAULT_MAX_OPS; op++){
+		uint32_t toggles = sim_pin_toggles(FAULT_SCL_PORT, FAULT_SCL_PIN);
+		i2c_error_stats(FAULT_I2C, &before);
+		sim_i2c_stats(FAULT_I2C, &bus_before);
+		if(flag == I2C_IF_CLTO){
+			sim_i2c_stretch(FAULT_I2C, op, FAULT_STRETCH_LONG_US);
+		} else {
+			sim_i2c_fault(FAULT_I2C, flag, op);
+		}
+		I2C_STATUS status = transact(t);
+		i2c_error_stats(FAULT_I2C, &after);
+		sim_i2c_stats(FAULT_I2C, &bus_after);
+
+		snprintf(what, sizeof(what), "%s, %s at operation %u", t->name,
+				flag == I2C_IF_ARBLOST ? "ARBLOST" : flag == I2C_IF_BUSERR ? "BUSERR"
+				: flag == I2C_IF_CLTO ? "CLTO" : "BITO", op);
+		if(bus_after.faults == bus_before.faults){
+			sim_check(status == I2C_STATUS_OK, what);
+			break; // armed past the end of the transaction
+		}
+		sim_check(status == expect, what);
+		sim_check(after.errors[expect] == before.errors[expect] + 1, "fault counted by type");
+		sim_check(after.recoveries == before.recoveries + 1, "one recovery per fault");
+		sim_check(after.stuck == before.stuck, "bus released by the reset");
+		sim_check(sim_pin_toggles(FAULT_SCL_PORT, FAULT_SCL_PIN) == toggles + RESET_TOGGLE_NUMBER,
+				"SCL clocked by i2c_bus_reset()");
+		check_recovered(what);
+	}
+	sim_i2c_fault(FAULT_I2C, 0, 0);
+	sim_i2c_stretch(FAULT_I2C, 0, 0);
+	sim_check(op > 2 && op < FAULT_MAX_OPS, "every operation of the transaction faulted");
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Writes bytes the device is expected to NACK, the address or a byte
+ *
+ * @details
+ *	The transaction must end with I2C_STATUS_NACK on the stop the driver
+ *	sends, counted as a failed transaction but without an abort or a bus
+ *	reset clocking SCL.
+ *
+ ******************************************************************************/
+static void nack_case(const char *what, uint8_t address, const uint8_t *bytes, uint8_t length){
+	char check[96];
+	I2C_ERROR_STATS_STRUCT before, after;
+	SIM_BUS_STATS_STRUCT bus_before, bus_after;
+	I2C_SEGMENT_STRUCT segment = { bytes, length };
+	I2C_STATUS status = I2C_STATUSES;
+	SCHEDULER_MSG_STRUCT msg;
+	I2C_START_STRUCT start = {
+		.device_address = address,
+		.read = false,
+		.segments = &segment,
+		.segment_count = 1,
+		.event = FAULT_EVENT,
+		.status = &status
+	};
+	uint32_t toggles = sim_pin_toggles(FAULT_SCL_PORT, FAULT_SCL_PIN);
+
+	i2c_error_stats(FAULT_I2C, &before);
+	sim_i2c_stats(FAULT_I2C, &bus_before);
+	sim_check(i2c_start(FAULT_I2C, &start), "transaction queued");
+	while(!i2c_idle(FAULT_I2C));
+	i2c_error_stats(FAULT_I2C, &after);
+	sim_i2c_stats(FAULT_I2C, &bus_after);
+
+	snprintf(check, sizeof(check), "%s: I2C_STATUS_NACK", what);
+	sim_check(status == I2C_STATUS_NACK && scheduler_get_msg(&msg) && msg.payload == I2C_STATUS_NACK, check);
+	snprintf(check, sizeof(check), "%s: counted once", what);
+	sim_check(after.errors[I2C_STATUS_NACK] == before.errors[I2C_STATUS_NACK] + 1, check);
+	snprintf(check, sizeof(check), "%s: ended by a stop", what);
+	sim_check(bus_after.stops == bus_before.stops + 1 && bus_after.faults == bus_before.faults, check);
+	snprintf(check, sizeof(check), "%s: no recovery", what);
+	sim_check(after.recoveries == before.recoveries
+			&& sim_pin_toggles(FAULT_SCL_PORT, FAULT_SCL_PIN) == toggles, check);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Puts an EEPROM on I2C1 and runs the fault cases
+ *
+ ******************************************************************************/
+int main(void){
+	static const uint32_t flags[] = { I2C_IF_ARBLOST, I2C_IF_BUSERR, I2C_IF_CLTO, I2C_IF_BITO };
+	static const I2C_STATUS statuses[] = { I2C_STATUS_ARBLOST, I2C_STATUS_BUSERR, I2C_STATUS_CLTO, I2C_STATUS_BITO };
+	I2C_ERROR_STATS_STRUCT before, after;
+	I2C_STATUS status[3];
+
+	sim_eeprom_init(&ee, SIM_EEPROM_ADDR, 0);
+	for(int i = 0; i < SIM_EEPROM_SIZE; i++){
+		ee.memory[i] = i ^ FAULT_PATTERN;
+	}
+	sim_si7021_init(&si, FAULT_SI7021_ADDR);
+	sim_i2c_attach(FAULT_I2C, &ee.dev);
+	sim_i2c_attach(FAULT_I2C, &si.dev);
+	scheduler_open();
+	open_bus();
+	sim_run_ms(SIM_SI7021_POWERUP_MS);
+
+	// each fault in each operation, with the LDMA and by interrupt
+	for(int ldma = 0; ldma < 2; ldma++){
+		i2c_ldma_enable(FAULT_I2C, ldma);
+		for(uint32_t t = 0; t < sizeof(transactions) / sizeof(transactions[0]); t++){
+			for(int f = 0; f < 4; f++){
+				fault_every_op(&transactions[t], flags[f], statuses[f]);
+			}
+		}
+	}
+	i2c_ldma_enable(FAULT_I2C, true);
+
+	// a device may hold SCL for less than the CLTO timeout
+	i2c_error_stats(FAULT_I2C, &before);
+	sim_i2c_stretch(FAULT_I2C, 2, FAULT_STRETCH_SHORT_US);
+	sim_check(transact(&transactions[1]) == I2C_STATUS_OK && read_ok(&transactions[1], data),
+			"clock stretching under CLTO");
+	i2c_error_stats(FAULT_I2C, &after);
+	sim_check(after.recoveries == before.recoveries, "clock stretching is not a fault");
+
+	// the timeouts of an idle bus are expected and ignored
+	uint32_t irqs = sim_irq_count(I2C1_IRQn);
+	FAULT_I2C->IFS = I2C_IF_BITO | I2C_IF_CLTO;
+	sim_run_ms(1);
+	i2c_error_stats(FAULT_I2C, &after);
+	sim_check(sim_irq_count(I2C1_IRQn) == irqs + 1, "idle timeouts taken once");
+	sim_check(after.recoveries == before.recoveries, "idle timeouts ignored");
+
+	// a reset that cannot free SDA is counted as stuck, the queue goes on
+	sim_pin_hold(FAULT_SDA_PORT, FAULT_SDA_PIN, true);
+	sim_i2c_fault(FAULT_I2C, I2C_IF_BUSERR, 1);
+	sim_check(transact(&transactions[0]) == I2C_STATUS_BUSERR, "fault with SDA held low");
+	i2c_error_stats(FAULT_I2C, &after);
+	sim_check(after.stuck == before.stuck + 1, "stuck bus counted");
+	sim_pin_hold(FAULT_SDA_PORT, FAULT_SDA_PIN, false);
+	check_recovered("after SDA released");
+
+	// a fault fails only the transaction it hits, the queued ones still run
+	sim_i2c_fault(FAULT_I2C, I2C_IF_ARBLOST, 2);	// word address of the first
+	I2C_SEGMENT_STRUCT segment = { &transactions[0].pointer, 1 };
+	for(int i = 0; i < 3; i++){
+		I2C_START_STRUCT start = {
+			.device_address = SIM_EEPROM_ADDR, .read = true, .segments = &segment, .segment_count = 1,
+			.read_arr = &data[i], .read_length = 1, .status = &status[i]
+		};
+		i2c_start(FAULT_I2C, &start);
+	}
+	while(!i2c_idle(FAULT_I2C));
+	sim_check(status[0] == I2C_STATUS_ARBLOST && status[1] == I2C_STATUS_OK && status[2] == I2C_STATUS_OK,
+			"queued transactions run after a fault");
+	sim_check(read_ok(&transactions[0], &data[1]) && read_ok(&transactions[0], &data[2]),
+			"queued transactions read after a fault");
+
+	// a fault in the stop of a backoff still polls the busy device: a byte
+	// is written and the one after it read once the write cycle is over
+	static const FAULT_TRANSACTION_STRUCT write_read = {
+		"write then read", 0x40, 1, 1, { I2C_RETRY_CONVERSION, SIM_EEPROM_WRITE_MS, 0 }
+	};
+	ee.write_ms = SIM_EEPROM_WRITE_MS;
+	letimer_start(LETIMER0, true);
+	i2c_error_stats(FAULT_I2C, &before);
+	uint32_t cycles = ee.write_cycles;
+	sim_i2c_fault(FAULT_I2C, I2C_IF_BUSERR, 4);	// address, word address, data, stop
+	sim_check(transact(&write_read) == I2C_STATUS_OK, "read completes after a fault in its backoff stop");
+	sim_check(ee.write_cycles == cycles + 1 && read_ok(&write_read, data),
+			"read after a backoff fault gets its data");
+	i2c_error_stats(FAULT_I2C, &after);
+	sim_check(after.errors[I2C_STATUS_BUSERR] == before.errors[I2C_STATUS_BUSERR] + 1,
+			"backoff fault counted");
+	sim_check(sim_timers_active() == 0, "no backoff timer left running");
+	ee.write_ms = 0;
+	check_recovered("after the backoff fault");
+
+	// a NACK ends the transaction with a stop, by interrupt and with the LDMA
+	static const uint8_t unknown[] = { 0x12, 0x34, 0x56 };	// not a Si7021 command
+	nack_case("address NACKed, no device", FAULT_ABSENT_ADDR, &transactions[0].pointer, 1);
+	check_recovered("after the address NACK");
+	for(int ldma = 0; ldma < 2; ldma++){
+		i2c_ldma_enable(FAULT_I2C, ldma);
+		nack_case(ldma ? "command NACKed, LDMA" : "command NACKed, by interrupt",
+				FAULT_SI7021_ADDR, unknown, sizeof(unknown));
+		check_recovered("after the command NACK");
+	}
+	ee.write_ms = SIM_EEPROM_WRITE_MS;
+	sim_check(transact(&transactions[2]) == I2C_STATUS_OK, "write starts the write cycle");
+	nack_case("address NACKed, EEPROM writing", SIM_EEPROM_ADDR, &transactions[2].pointer, 1);
+	sim_run_ms(SIM_EEPROM_WRITE_MS);
+	ee.write_ms = 0;
+	check_recovered("after the write cycle");
+
+	i2c_error_stats(FAULT_I2C, &after);
+	printf("test_i2c_fault: %u ARBLOST, %u BUSERR, %u CLTO, %u BITO recovered, %u stuck\n",
+			after.errors[I2C_STATUS_ARBLOST], after.errors[I2C_STATUS_BUSERR],
+			after.errors[I2C_STATUS_CLTO], after.errors[I2C_STATUS_BITO], after.stuck);
+	return sim_report("test_i2c_fault");
+}
@@ -0,0 +1,315 @@
+/**
+ * @file test_scheduler.c
+ * @brief Checks the lock-free event bits and message queue of scheduler.c
+ * against interrupts, both raised at exact points and run as threads
+ *
+ * The deterministic cases raise an interrupt between an LDREX and its
+ * STREX, or between claiming a queue slot and publishing it, with
+ * sim_preempt(), and check nothing is lost and the order is kept. The
+ * stress cases run threads standing in for interrupt handlers. Threads
+ * really run at the same time, which a single core never does, so they
+ * hit every interleaving an interrupt can and more. Each thread yields
+ * between its LDREX and STREX, with sim_exclusive_yield(), so the others
+ * run in that gap even on a single CPU.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+//** User/developer include files
+#include "scheduler.h"
+#include "sim.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define EVENT_A					(1u << 3)
+#define EVENT_B					(1u << 17)
+#define STRESS_THREADS			4		// interrupt handlers, each owns every 4th event bit
+#define STRESS_ROUNDS			200000	// events raised per thread
+#define POST_THREADS			3
+#define POST_MSGS				200000	// messages posted per thread
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+static volatile uint32_t raised[SCHEDULER_MAX_EVENTS];		// by the handler threads
+static volatile uint32_t serviced[SCHEDULER_MAX_EVENTS];	// by the main loop
+static volatile uint32_t post_failures[POST_THREADS];
+static volatile uint32_t threads_done;
+static volatile bool isr_ran, isr_saw_msg;
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void isr_add_b(void);
+static void isr_remove_b(void);
+static void isr_post_b(void);
+static void isr_post_b_peek(void);
+static void check_msg(uint32_t event, uint32_t payload, const char *what);
+static void *event_thread(void *arg);
+static void *post_thread(void *arg);
+static void preemption_cases(void);
+static void stress_events(void);
+static void stress_posts(void);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Interrupt handlers raised by sim_preempt()
+ *
+ ******************************************************************************/
+static void isr_add_b(void){
+	isr_ran = true;
+	add_scheduled_event(EVENT_B);
+}
+
+static void isr_remove_b(void){
+	isr_ran = true;
+	remove_scheduled_event(EVENT_B);
+}
+
+static void isr_post_b(void){
+	isr_ran = true;
+	scheduler_post(EVENT_B, 2);
+}
+
+static void isr_post_b_peek(void){
+	SCHEDULER_MSG_STRUCT msg;
+	isr_post_b();
+	isr_saw_msg = scheduler_get_msg(&msg);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Takes the next message and checks it is the one expected
+ *
+ ******************************************************************************/
+static void check_msg(uint32_t event, uint32_t payload, const char *what){
+	SCHEDULER_MSG_STRUCT msg;
+	sim_check(scheduler_get_msg(&msg) && msg.event == event && msg.payload == payload, what);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Interrupts at the exact points the lock-free code must survive
+ *
+ ******************************************************************************/
+static void preemption_cases(void){
+	uint32_t outer, inner;
+
+	// an add from an interrupt between the LDREX and STREX of an add or remove
+	scheduler_open();
+	isr_ran = false;
+	sim_preempt(LETIMER0_IRQn, isr_add_b, SIM_POINT_LDREX, 1);
+	add_scheduled_event(EVENT_A);
+	sim_check(isr_ran && get_scheduled_events() == (EVENT_A | EVENT_B), "add preempted by add keeps both");
+
+	scheduler_open();
+	add_scheduled_event(EVENT_A);
+	sim_preempt(LETIMER0_IRQn, isr_add_b, SIM_POINT_LDREX, 1);
+	remove_scheduled_event(EVENT_A);
+	sim_check(get_scheduled_events() == EVENT_B, "remove preempted by add keeps the add");
+
+	scheduler_open();
+	add_scheduled_event(EVENT_B);
+	sim_preempt(LETIMER0_IRQn, isr_remove_b, SIM_POINT_LDREX, 1);
+	add_scheduled_event(EVENT_A);
+	sim_check(get_scheduled_events() == EVENT_A, "add preempted by remove keeps the remove");
+
+	// a post from an interrupt while the main loop posts: before the slot is
+	// claimed it goes first, after it it waits for the main loop to publish
+	scheduler_open();
+	sim_preempt(LETIMER0_IRQn, isr_post_b, SIM_POINT_LDREX, 1);
+	scheduler_post(EVENT_A, 1);
+	check_msg(EVENT_B, 2, "post preempted before its claim, the interrupt's goes first");
+	check_msg(EVENT_A, 1, "post preempted before its claim, then the main loop's");
+
+	scheduler_open();
+	isr_saw_msg = true;
+	sim_preempt(LETIMER0_IRQn, isr_post_b_peek, SIM_POINT_DMB, 1);
+	scheduler_post(EVENT_A, 1);
+	sim_check(!isr_saw_msg, "claimed slot not read before it is published");
+	check_msg(EVENT_A, 1, "post preempted after its claim keeps its place");
+	check_msg(EVENT_B, 2, "then the interrupt's");
+	sim_check(scheduler_idle(), "queue empty");
+
+	// critical sections nest, and posting events leaves PRIMASK alone
+	scheduler_open();
+	isr_ran = false;
+	outer = critical_enter();
+	inner = critical_enter();
+	sim_check(outer == 0 && inner == 1, "critical_enter() returns the PRIMASK it found");
+	sim_preempt(LETIMER0_IRQn, isr_add_b, SIM_POINT_LDREX, 1);
+	add_scheduled_event(EVENT_A);
+	sim_check(__get_PRIMASK() == 1, "add_scheduled_event() leaves interrupts masked");
+	sim_check(!isr_ran, "no interrupt inside a critical section");
+	critical_exit(inner);
+	sim_check(__get_PRIMASK() == 1 && !isr_ran, "inner critical_exit() stays masked");
+	critical_exit(outer);
+	sim_check(__get_PRIMASK() == 0 && isr_ran, "outer critical_exit() takes the pending interrupt");
+	sim_check(get_scheduled_events() == (EVENT_A | EVENT_B), "both events kept");
+	sim_preempt(LETIMER0_IRQn, 0, SIM_POINT_LDREX, 0);
+
+	// the queue keeps posting order and counts what does not fit
+	scheduler_open();
+	for(uint32_t i = 0; i < SCHEDULER_QUEUE_SIZE; i++){
+		sim_check(scheduler_post(EVENT_A, i), "post while the queue has room");
+	}
+	sim_check(!scheduler_post(EVENT_A, SCHEDULER_QUEUE_SIZE), "post refused with the queue full");
+	sim_check(scheduler_queue_overflows() == 1, "overflow counted");
+	for(uint32_t i = 0; i < SCHEDULER_QUEUE_SIZE; i++){
+		check_msg(EVENT_A, i, "messages in posting order");
+	}
+	sim_check(scheduler_idle(), "queue empty after the overflow");
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Interrupt handler thread, raises its events as soon as the main loop
+ *	has serviced them
+ *
+ * @details
+ *	Only this thread raises its bits and only the main loop clears them, so
+ *	each bit must be serviced exactly as often as it is raised. A lost add
+ *	leaves serviced short, a lost remove services a bit twice.
+ *
+ ******************************************************************************/
+static void *event_thread(void *arg){
+	uint32_t id = (uintptr_t)arg;
+	for(uint32_t n = 0; n < STRESS_ROUNDS; n++){
+		uint32_t bit = id + STRESS_THREADS * (n % (SCHEDULER_MAX_EVENTS / STRESS_THREADS));
+		while(get_scheduled_events() & (1u << bit)) sched_yield();
+		raised[bit]++;
+		add_scheduled_event(1u << bit);
+	}
+	__atomic_add_fetch(&threads_done, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Main loop servicing event bits raised by handler threads
+ *
+ ******************************************************************************/
+static void stress_events(void){
+	pthread_t threads[STRESS_THREADS];
+	uint32_t total = 0, lost = 0;
+
+	scheduler_open();
+	threads_done = 0;
+	uint32_t failures = sim_strex_failures();
+	sim_exclusive_yield(true);
+	for(uintptr_t id = 0; id < STRESS_THREADS; id++){
+		pthread_create(&threads[id], 0, event_thread, (void *)id);
+	}
+	for(;;){
+		// read the threads before the events, so their last adds are seen
+		bool done = __atomic_load_n(&threads_done, __ATOMIC_SEQ_CST) == STRESS_THREADS;
+		uint32_t events = get_scheduled_events();
+		if(done && !events) break;
+		if(!events) sched_yield();
+		while(events){
+			uint32_t bit = 31 - __builtin_clz(events);
+			events &= ~(1u << bit);
+			remove_scheduled_event(1u << bit);
+			serviced[bit]++;
+			total++;
+		}
+	}
+	for(int id = 0; id < STRESS_THREADS; id++){
+		pthread_join(threads[id], 0);
+	}
+	sim_exclusive_yield(false);
+	failures = sim_strex_failures() - failures;
+	for(int bit = 0; bit < SCHEDULER_MAX_EVENTS; bit++){
+		lost += raised[bit] != serviced[bit];
+	}
+	sim_check(lost == 0 && total == STRESS_THREADS * STRESS_ROUNDS, "every raised event serviced once");
+	sim_check(get_scheduled_events() == 0, "no event left behind");
+	sim_check(failures > 0, "threads ran between an LDREX and its STREX");
+	printf("test_scheduler: %u events from %u handler threads, %u STREX retried, %u bits lost\n",
+			total, STRESS_THREADS, failures, lost);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Interrupt handler thread posting numbered messages
+ *
+ ******************************************************************************/
+static void *post_thread(void *arg){
+	uint32_t id = (uintptr_t)arg;
+	for(uint32_t n = 0; n < POST_MSGS; n++){
+		while(!scheduler_post(1u << id, n)){
+			post_failures[id]++;
+			sched_yield();
+		}
+	}
+	return 0;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Main loop reading messages posted by handler threads
+ *
+ * @details
+ *	Each thread's messages must arrive once each and in the order it posted
+ *	them, and the overflow count must match the refused posts.
+ *
+ ******************************************************************************/
+static void stress_posts(void){
+	pthread_t threads[POST_THREADS];
+	uint32_t next[POST_THREADS] = { 0 };
+	uint32_t received = 0, out_of_order = 0, failures = 0;
+	SCHEDULER_MSG_STRUCT msg;
+
+	scheduler_open();
+	sim_exclusive_yield(true);
+	for(uintptr_t id = 0; id < POST_THREADS; id++){
+		pthread_create(&threads[id], 0, post_thread, (void *)id);
+	}
+	while(received < POST_THREADS * POST_MSGS){
+		if(!scheduler_get_msg(&msg)){
+			sched_yield();
+			continue;
+		}
+		uint32_t id = 31 - __builtin_clz(msg.event);
+		if(id >= POST_THREADS || msg.payload != next[id]){
+			out_of_order++;
+		} else {
+			next[id]++;
+		}
+		received++;
+	}
+	for(int id = 0; id < POST_THREADS; id++){
+		pthread_join(threads[id], 0);
+		failures += post_failures[id];
+	}
+	sim_exclusive_yield(false);
+	sim_check(out_of_order == 0, "each thread's messages in its order");
+	sim_check(!scheduler_get_msg(&msg) && scheduler_idle(), "no message twice");
+	sim_check(scheduler_queue_overflows() == failures, "every refused post counted");
+	printf("test_scheduler: %u messages from %u handler threads, %u refused with the queue full\n",
+			received, POST_THREADS, failures);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs the deterministic cases, then the stress cases
+ *
+ ******************************************************************************/
+int main(void){
+	preemption_cases();
+	stress_events();
+	stress_posts();
+	return sim_report("test_scheduler");
+}
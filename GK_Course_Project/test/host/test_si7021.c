@@ -0,0 +1,177 @@
+/**
+ * @file test_si7021.c
+ * @brief Runs si7021_test() and si7021_bench() against the simulated I2C1
+ * and Si7021, then measures how many transactions per second of host time
+ * the driver and the simulation get through
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//** User/developer include files
+#include "SI7021.h"
+#include "gpio.h"
+#include "i2c.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+#include "sim.h"
+#include "sim_si7021.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define THROUGHPUT_TRANSACTIONS		20000	// per case, or the first argument
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+static SIM_SI7021_STRUCT si;
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void check_bus_clean(const char *after);
+static void throughput(const char *name, void (*start)(uint32_t event), uint32_t count);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Checks the I2C1 queue is empty, nothing failed and EM2 is not blocked
+ *
+ ******************************************************************************/
+static void check_bus_clean(const char *after){
+	char what[96];
+	I2C_ERROR_STATS_STRUCT errors;
+	uint32_t failed = 0;
+
+	i2c_error_stats(SI7021_I2C, &errors);
+	for(int status = I2C_STATUS_OK + 1; status < I2C_STATUSES; status++){
+		failed += errors.errors[status];
+	}
+	snprintf(what, sizeof(what), "no failed transaction after %s", after);
+	sim_check(failed == 0 && errors.recoveries == 0, what);
+	snprintf(what, sizeof(what), "I2C queue empty after %s", after);
+	sim_check(i2c_queue_depth(SI7021_I2C) == 0, what);
+	snprintf(what, sizeof(what), "I2C EM2 block released after %s", after);
+	sim_check(sim_sleep_blocks(EM2, SLEEP_OWNER_I2C) == 0, what);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Runs count transactions back to back and prints their rate in host time
+ *
+ * @details
+ *	Each transaction is started and waited for like si7021_test() does, so
+ *	the rate covers the driver, its interrupts and the simulation together.
+ *	The simulated bus time per transaction is printed alongside.
+ *
+ ******************************************************************************/
+static void throughput(const char *name, void (*start)(uint32_t event), uint32_t count){
+	struct timespec t0, t1;
+	I2C_QUEUE_STATS_STRUCT stats;
+	uint64_t sim_start = sim_time_ns();
+
+	i2c_queue_stats_reset(SI7021_I2C);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(uint32_t n = 0; n < count; n++){
+		start(0);
+		while(!i2c_idle(SI7021_I2C));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	i2c_queue_stats(SI7021_I2C, &stats);
+
+	double host_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("  %-30s %6u transactions, %9.0f per second of host time, %7.1f us simulated each\n",
+			name, count, count / host_s, (sim_time_ns() - sim_start) / 1e3 / count);
+	sim_check(stats.completed == count, "every throughput transaction completed");
+}
+
+/***************************************************************************//**
+ * @brief
+ *	SNB read with the LDMA turned off for the throughput run
+ *
+ ******************************************************************************/
+static void read_snb_irq(uint32_t event){
+	i2c_ldma_enable(SI7021_I2C, false);
+	si7021_read_SNB(event);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	SNB read with the LDMA turned on for the throughput run
+ *
+ ******************************************************************************/
+static void read_snb_ldma(uint32_t event){
+	i2c_ldma_enable(SI7021_I2C, true);
+	si7021_read_SNB(event);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Boots like app.c, then runs the firmware's own tests and the benchmarks
+ *
+ ******************************************************************************/
+int main(int argc, char **argv){
+	uint32_t count = argc > 1 ? strtoul(argv[1], 0, 0) : THROUGHPUT_TRANSACTIONS;
+	I2C_CPU_STATS_STRUCT cpu;
+	SIM_LDMA_STATS_STRUCT ldma;
+	SIM_BUS_STATS_STRUCT bus;
+
+	sim_si7021_init(&si, SI7021_DEV_ADDR);
+	sim_i2c_attach(SI7021_I2C, &si.dev);
+
+	scheduler_open();
+	si7021_i2c_open();
+	sim_check(sim_pin_toggles(SI7021_SCL_PORT, SI7021_SCL_PIN) == RESET_TOGGLE_NUMBER,
+			"i2c_open() clocks SCL for the bus reset");
+	sim_check(sim_i2c_freq(SI7021_I2C) == SI7021_I2C_FREQ, "I2C1 opened at the Si7021 speed");
+
+	// the four tests of the firmware, with EFM_ASSERT counted by the simulation
+	si7021_test();
+	sim_check(si.ur1 == 0xBA, "UR1 of the sensor holds the byte written by test 2");
+	sim_check(si7021_resolution() == SI7021_RES_RH10_T13, "cached UR1 follows the write");
+	sim_check(si.busy_nacks > 0, "test 3 polled the converting sensor");
+	sim_ldma_stats(1, &ldma);
+	sim_check(ldma.transfers > 0 && ldma.signals == ((1u << ldmaPeripheralSignal_I2C1_TXBL)
+			| (1u << ldmaPeripheralSignal_I2C1_RXDATAV)), "I2C1 phases moved by LDMA channel 1");
+	check_bus_clean("si7021_test()");
+
+	// a sample reads the RH with its checksum, then the temperature from it
+	si7021_sample(0);
+	while(!i2c_idle(SI7021_I2C));
+	sim_check(si7021_sample_ok(), "sample read and passed its CRC");
+	sim_check(abs(si7021_convert_rh() - si.rh_m / 10) < 20, "sample RH matches the environment");
+	sim_check(abs(si7021_convert_temp_f() - (si.temp_mc * 9 / 50 + 3200)) < 5,
+			"sample temperature matches the environment");
+
+	// the benchmark of the firmware, its own EFM_ASSERTs compare the cases
+	si7021_bench();
+	i2c_cpu_stats(SI7021_I2C, &cpu);
+	sim_check(cpu.last_polls == 1, "conversion policy polls once");
+	sim_check(sim_timers_active() == 0, "no backoff timer left running");
+	check_bus_clean("si7021_bench()");
+
+	sim_i2c_stats(SI7021_I2C, &bus);
+	printf("test_si7021: %u addresses, %u NACKed, %u bytes, %u stops on I2C1, %u Si7021 conversions\n",
+			bus.addresses, bus.nacks, bus.bytes, bus.stops, si.conversions);
+
+	printf("throughput:\n");
+	throughput("UR1 read", si7021_read_ur1, count);
+	throughput("SNB read, interrupt per byte", read_snb_irq, count);
+	throughput("SNB read, LDMA", read_snb_ldma, count);
+	throughput("RH read, conversion backoff", si7021_read_rh, count / 10);
+	i2c_ldma_enable(SI7021_I2C, SI7021_I2C_LDMA);
+	sim_check(si7021_snb()[0] == 0x15, "SNB still reads the Si7021 part number");
+	check_bus_clean("the throughput runs");
+
+	return sim_report("test_si7021");
+}
@@ -0,0 +1,291 @@
+/**
+ * @file test_two_bus.c
+ * @brief Runs transactions on I2C0 and I2C1 at the same time and checks
+ * each bus keeps its own queue, EM2 block, LDMA channel and state machine
+ *
+ * A simulated EEPROM sits on each bus, with different contents so a read
+ * that crossed buses would show. I2C0 is opened at standard mode, I2C1 at
+ * fast mode like the board's.
+ *
+ */
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+#include <stdio.h>
+#include <string.h>
+
+//** Silicon Lab include files
+#include "em_i2c.h"
+#include "em_gpio.h"
+#include "em_ldma.h"
+
+//** User/developer include files
+#include "i2c.h"
+#include "scheduler.h"
+#include "sleep_routines.h"
+#include "sim.h"
+#include "sim_eeprom.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define TWO_BUS_EVENT(bus)		(1u << (6 + (bus)))
+#define TWO_BUS_PATTERN(bus)	((bus) ? 0xA5 : 0x5A)	// EEPROM contents, byte i is i ^ pattern
+#define TWO_BUS_ROUNDS			50000
+#define TWO_BUS_KINDS			4
+
+//***********************************************************************************
+// private variables
+//***********************************************************************************
+typedef enum {
+	KIND_BYTE_READ,
+	KIND_BLOCK_READ,
+	KIND_WORD_READ,
+	KIND_BYTE_WRITE
+} TWO_BUS_KIND;
+
+typedef struct {
+	TWO_BUS_KIND		kind;
+	uint8_t				pointer;
+	uint8_t				value;
+	I2C_SEGMENT_STRUCT	segments[2];
+	uint8_t				data[6];
+} TWO_BUS_RECORD_STRUCT;
+
+static I2C_TypeDef *const i2cs[I2C_BUSES] = { I2C0, I2C1 };
+static const uint32_t freqs[I2C_BUSES] = { I2C_FREQ_STANDARD_MAX, I2C_FREQ_FAST_MAX };
+static const I2C_IO_STRUCT ios[I2C_BUSES] = {
+	{ .sda_port = gpioPortB, .sda_pin = 12u, .scl_port = gpioPortB, .scl_pin = 11u },
+	{ .sda_port = gpioPortC, .sda_pin = 10u, .scl_port = gpioPortC, .scl_pin = 11u }
+};
+static const uint8_t pointers[TWO_BUS_KINDS] = { 0x10, 0x20, 0x30, 0x40 };
+static const uint8_t lengths[TWO_BUS_KINDS] = { 1, 6, 2, 0 };
+
+static SIM_EEPROM_STRUCT eeproms[I2C_BUSES];
+static TWO_BUS_RECORD_STRUCT records[I2C_BUSES][I2C_QUEUE_SIZE];
+static uint32_t started[I2C_BUSES], finished[I2C_BUSES], missed_events, failed, wrong_data;
+
+//***********************************************************************************
+// private function prototypes
+//***********************************************************************************
+static void open_bus(uint32_t bus);
+static bool two_bus_start(uint32_t bus, TWO_BUS_KIND kind);
+static void two_bus_drain(void);
+static bool two_bus_idle(void);
+
+//***********************************************************************************
+// functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ * @brief
+ *	Opens a bus at its speed, on its own pins
+ *
+ ******************************************************************************/
+static void open_bus(uint32_t bus){
+	I2C_IO_STRUCT io = ios[bus];
+	I2C_OPEN_STRUCT open = {
+		.enable = true,
+		.master = true,
+		.refFreq = 0,
+		.freq = freqs[bus],
+		.chlr = bus ? i2cClockHLRAsymetric : i2cClockHLRStandard,
+		.sda_route0 = bus ? _I2C_ROUTELOC0_SDALOC_LOC19 : _I2C_ROUTELOC0_SDALOC_LOC15,
+		.scl_route0 = bus ? _I2C_ROUTELOC0_SCLLOC_LOC19 : _I2C_ROUTELOC0_SCLLOC_LOC15,
+		.sda_en = true,
+		.scl_en = true,
+		.ldma = true
+	};
+	i2c_open(i2cs[bus], &open, &io);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Queues a transaction on a bus if it has room
+ *
+ * @details
+ *	Transactions of a bus complete in the order they were queued, so the
+ *	record of each is the next in a ring of I2C_QUEUE_SIZE, and stays put
+ *	until two_bus_drain() sees it completed. A write sends the word address
+ *	and the data as two segments, and stores what the EEPROM already holds
+ *	so reads keep their expected data.
+ *
+ * @return
+ * 	false if the queue of the bus is full.
+ *
+ ******************************************************************************/
+static bool two_bus_start(uint32_t bus, TWO_BUS_KIND kind){
+	if(started[bus] - finished[bus] >= I2C_QUEUE_SIZE) return false;
+
+	TWO_BUS_RECORD_STRUCT *r = &records[bus][started[bus] % I2C_QUEUE_SIZE];
+
+	memset(r, 0, sizeof(*r));
+	r->kind = kind;
+	r->pointer = pointers[kind];
+	r->value = r->pointer ^ TWO_BUS_PATTERN(bus);
+	r->segments[0] = (I2C_SEGMENT_STRUCT){ &r->pointer, 1 };
+	r->segments[1] = (I2C_SEGMENT_STRUCT){ &r->value, 1 };
+	I2C_START_STRUCT start = {
+		.device_address = SIM_EEPROM_ADDR,
+		.read = lengths[kind] != 0,
+		.segments = r->segments,
+		.segment_count = kind == KIND_BYTE_WRITE ? 2 : 1,
+		.read_arr = r->data,
+		.read_length = lengths[kind],
+		.event = TWO_BUS_EVENT(bus)
+	};
+	sim_check(i2c_start(i2cs[bus], &start), "transaction queued");
+	started[bus]++;
+	return true;
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Checks the transactions completed since the last call
+ *
+ * @details
+ *	A read must hold what its own EEPROM does, and each transaction must
+ *	have posted its bus's event with I2C_STATUS_OK. The messages are taken
+ *	with the counts in one critical section, so none posted in between is
+ *	lost.
+ *
+ ******************************************************************************/
+static void two_bus_drain(void){
+	I2C_QUEUE_STATS_STRUCT queue;
+	SCHEDULER_MSG_STRUCT msg;
+	uint32_t completed[I2C_BUSES], posted[I2C_BUSES] = { 0 };
+
+	uint32_t primask = critical_enter();
+	while(scheduler_get_msg(&msg)){
+		for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+			if(msg.event == TWO_BUS_EVENT(bus)) posted[bus]++;
+		}
+		if(msg.payload != I2C_STATUS_OK) failed++;
+	}
+	for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+		i2c_queue_stats(i2cs[bus], &queue);
+		completed[bus] = queue.completed;
+	}
+	critical_exit(primask);
+
+	for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+		if(posted[bus] != completed[bus] - finished[bus]) missed_events++;
+		for(; finished[bus] < completed[bus]; finished[bus]++){
+			TWO_BUS_RECORD_STRUCT *r = &records[bus][finished[bus] % I2C_QUEUE_SIZE];
+			for(int i = 0; i < lengths[r->kind]; i++){
+				if(r->data[i] != (uint8_t)((pointers[r->kind] + i) ^ TWO_BUS_PATTERN(bus))) wrong_data++;
+			}
+		}
+	}
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Returns true once neither bus has a transaction
+ *
+ ******************************************************************************/
+static bool two_bus_idle(void){
+	return i2c_idle(I2C0) && i2c_idle(I2C1);
+}
+
+/***************************************************************************//**
+ * @brief
+ *	Opens both buses and runs the cases
+ *
+ ******************************************************************************/
+int main(void){
+	I2C_QUEUE_STATS_STRUCT queue[I2C_BUSES];
+	I2C_CPU_STATS_STRUCT cpu[2];
+	SIM_BUS_STATS_STRUCT bus_before[I2C_BUSES], bus_after[I2C_BUSES];
+	SIM_LDMA_STATS_STRUCT ldma;
+
+	scheduler_open();
+	for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+		sim_eeprom_init(&eeproms[bus], SIM_EEPROM_ADDR, 0);
+		for(int i = 0; i < SIM_EEPROM_SIZE; i++){
+			eeproms[bus].memory[i] = i ^ TWO_BUS_PATTERN(bus);
+		}
+		sim_i2c_attach(i2cs[bus], &eeproms[bus].dev);
+		open_bus(bus);
+	}
+	sim_check(sim_i2c_freq(I2C0) == I2C_FREQ_STANDARD_MAX && sim_i2c_freq(I2C1) == I2C_FREQ_FAST_MAX,
+			"each bus at its own speed");
+	sim_check(sim_pin_toggles(ios[0].scl_port, ios[0].scl_pin) == RESET_TOGGLE_NUMBER
+			&& sim_pin_toggles(ios[1].scl_port, ios[1].scl_pin) == RESET_TOGGLE_NUMBER,
+			"each bus reset on its own pins");
+
+	// one block read on each bus, run side by side
+	uint64_t t0 = sim_time_ns();
+	for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+		sim_i2c_stats(i2cs[bus], &bus_before[bus]);
+		two_bus_start(bus, KIND_BLOCK_READ);
+	}
+	sim_step();
+	sim_check(sim_sleep_blocks(EM2, SLEEP_OWNER_I2C) == 2, "an EM2 block per busy bus");
+	while(!two_bus_idle());
+	uint64_t elapsed = sim_time_ns() - t0;
+	for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+		sim_i2c_stats(i2cs[bus], &bus_after[bus]);
+	}
+	uint64_t busy0 = bus_after[0].busy_ns - bus_before[0].busy_ns;
+	uint64_t busy1 = bus_after[1].busy_ns - bus_before[1].busy_ns;
+	sim_check(elapsed < busy0 + busy1 && elapsed >= (busy0 > busy1 ? busy0 : busy1),
+			"both buses transferred at the same time");
+	sim_check(sim_sleep_blocks(EM2, SLEEP_OWNER_I2C) == 0, "EM2 blocks released");
+	two_bus_drain();
+
+	// the LDMA takes the data phases of a block read off the interrupt handler
+	for(int mode = 0; mode < 2; mode++){
+		i2c_ldma_enable(I2C1, mode);
+		i2c_cpu_stats_reset(I2C1);
+		two_bus_start(1, KIND_BLOCK_READ);
+		while(!two_bus_idle());
+		i2c_cpu_stats(I2C1, &cpu[mode]);
+	}
+	two_bus_drain();
+	sim_check(cpu[1].irqs < cpu[0].irqs, "fewer interrupts for a block read with the LDMA");
+
+	// each bus queues on its own
+	for(int i = 0; i < 3; i++) two_bus_start(0, KIND_BYTE_READ);
+	for(int i = 0; i < 6; i++) two_bus_start(1, KIND_WORD_READ);
+	sim_check(i2c_queue_depth(I2C0) == 3 && i2c_queue_depth(I2C1) == 6, "a queue per bus");
+	while(!two_bus_idle());
+	two_bus_drain();
+
+	// interleaved mix, each bus kept as full as its queue allows
+	for(uint32_t round = 0; round < TWO_BUS_ROUNDS; round++){
+		for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+			two_bus_start(bus, (round + 3 * bus) % TWO_BUS_KINDS);
+		}
+		sim_step();
+		two_bus_drain();
+	}
+	while(!two_bus_idle());
+	two_bus_drain();
+
+	for(uint32_t bus = 0; bus < I2C_BUSES; bus++){
+		i2c_queue_stats(i2cs[bus], &queue[bus]);
+		sim_check(finished[bus] == started[bus] && queue[bus].completed == started[bus],
+				"every transaction of each bus completed on it");
+		sim_check(queue[bus].rejected == 0, "no transaction refused");
+	}
+	sim_check(missed_events == 0, "each transaction posted its own bus's event");
+	sim_check(failed == 0, "each event posted with I2C_STATUS_OK");
+	sim_check(wrong_data == 0, "reads got their own EEPROM's data");
+	sim_ldma_stats(0, &ldma);
+	sim_check(ldma.transfers > 0 && ldma.signals == ((1u << ldmaPeripheralSignal_I2C0_TXBL)
+			| (1u << ldmaPeripheralSignal_I2C0_RXDATAV)), "I2C0 moved by LDMA channel 0 only");
+	sim_ldma_stats(1, &ldma);
+	sim_check(ldma.transfers > 0 && ldma.signals == ((1u << ldmaPeripheralSignal_I2C1_TXBL)
+			| (1u << ldmaPeripheralSignal_I2C1_RXDATAV)), "I2C1 moved by LDMA channel 1 only");
+	sim_check(sim_irq_count(LDMA_IRQn) == 0, "no LDMA interrupt for the I2C phases");
+	sim_check(sim_sleep_blocks(EM2, SLEEP_OWNER_I2C) == 0, "EM2 blocks released at the end");
+
+	printf("test_two_bus: %u transactions on I2C0, %u on I2C1, %u and %u interrupts\n",
+			started[0], started[1], sim_irq_count(I2C0_IRQn), sim_irq_count(I2C1_IRQn));
+	printf("test_two_bus: block read takes %u interrupts by byte, %u with the LDMA\n",
+			cpu[0].irqs, cpu[1].irqs);
+	return sim_report("test_two_bus");
+}
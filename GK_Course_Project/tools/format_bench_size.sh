@@ -0,0 +1,70 @@
+#!/bin/sh
+# Measure the flash cost of FORMAT_BENCH_ENABLED.
+#
+# Builds the project twice with the toolchain and flags from .cproject
+# (GNU ARM 7.2.1, -O2, newlib nano), once as shipped and once with
+# -DFORMAT_BENCH_ENABLED, and prints arm-none-eabi-size for both and the
+# difference. The difference is app_format_bench(), its float reference and
+# the sprintf() and soft float library code they pull back in.
+#
+# usage: format_bench_size.sh <Gecko SDK path> [toolchain bin directory]
+#
+# The SDK path is the one Simplicity Studio shows for
+# com.silabs.sdk.stack.super 2.5.0, e.g.
+#   ~/SimplicityStudio/v4/developer/sdks/gecko_sdk_suite/v2.5
+# and the toolchain directory its gnu_arm/7.2_2017q4/bin. Without the second
+# argument arm-none-eabi-gcc is taken from the PATH.
+
+set -e
+
+if [ $# -lt 1 ]; then
+	sed -n '2,16s/^# \{0,1\}//p' "$0"
+	exit 1
+fi
+
+SDK=$1
+if [ $# -ge 2 ]; then
+	PREFIX=$2/arm-none-eabi-
+else
+	PREFIX=arm-none-eabi-
+fi
+
+PROJ=$(cd "$(dirname "$0")/.." && pwd)
+DEVICE=$SDK/platform/Device/SiliconLabs/EFM32PG12B
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+CFLAGS="-mcpu=cortex-m4 -mthumb -mfpu=fpv4-sp-d16 -mfloat-abi=softfp \
+	-std=c99 -O2 -g3 -ffunction-sections -fdata-sections \
+	-DEFM32PG12B500F1024GL125=1 -DDEBUG_EFM=1 -DRETARGET_VCOM=1 \
+	-I$PROJ/src/Header_files -I$PROJ/src/Source_files \
+	-I$SDK/platform/emlib/inc -I$SDK/platform/CMSIS/Include \
+	-I$SDK/hardware/kit/SLSTK3402A_EFM32PG12/config \
+	-I$SDK/hardware/kit/common/bsp -I$SDK/hardware/kit/common/drivers \
+	-I$DEVICE/Include"
+
+SOURCES="$PROJ/src/main.c $PROJ/src/Source_files/*.c \
+	$SDK/platform/emlib/src/*.c \
+	$DEVICE/Source/system_efm32pg12b.c $DEVICE/Source/GCC/startup_efm32pg12b.c"
+
+# build <name> [extra cflags]
+build(){
+	mkdir -p "$OUT/$1"
+	for src in $SOURCES; do
+		obj=$OUT/$1/$(basename "$src" .c).o
+		"${PREFIX}gcc" $CFLAGS $2 -c "$src" -o "$obj"
+	done
+	"${PREFIX}gcc" -mcpu=cortex-m4 -mthumb -mfpu=fpv4-sp-d16 -mfloat-abi=softfp \
+		-T "$DEVICE/Source/GCC/efm32pg12b.ld" --specs=nano.specs \
+		-Wl,--gc-sections -Wl,-Map="$OUT/$1.map" \
+		"$OUT/$1"/*.o -o "$OUT/$1.axf" \
+		-Wl,--start-group -lgcc -lc -lnosys -Wl,--end-group
+	"${PREFIX}size" "$OUT/$1.axf" | tail -n 1
+}
+
+echo "   text	   data	    bss	    dec	    hex	filename"
+base=$(build shipped)
+bench=$(build bench -DFORMAT_BENCH_ENABLED)
+echo "$base"
+echo "$bench"
+echo "$base $bench" | awk '{ printf "FORMAT_BENCH_ENABLED adds %d bytes of .text, %d of .data\n", $7 - $1, $8 - $2 }'
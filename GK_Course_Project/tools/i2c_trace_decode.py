@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Decode an I2C trace dump captured from the BLE log.
+
+The firmware (I2C_TRACE_ENABLED in i2c.h) sends a failed transfer's trace as
+
+    TRACE <entries>
+    T <bus> <event> <state> <byte hex> <cycles>
+    ...
+    TRACE END
+
+This prints each dump as a ladder diagram between the MCU and the device,
+then the time spent in each state machine state and per transaction. The
+byte column is the last byte the CPU wrote to TXDATA or read from RXDATA
+when the event was handled; bytes moved by the LDMA do not appear.
+
+The cycle counter stops while the core sleeps, so time spent sleeping in a
+backoff between polls is not included.
+
+usage: i2c_trace_decode.py [log file] [--hz core clock, default 19000000]
+"""
+
+import argparse
+import sys
+
+# order of the enums in i2c.h
+STATES = ["IDLE", "REQUEST_DEVICE", "WRITE_DATA", "REQUEST_DATA",
+          "READ_DATA", "CLOSE_FUNCTION", "BACKOFF", "NACKED"]
+EVENTS = ["BEGIN", "ACK", "NACK", "RXDATAV", "TXC", "MSTOP", "FAULT", "POLL"]
+STATUSES = ["OK", "NACK", "ARBLOST", "BUSERR", "CLTO", "BITO", "PROTOCOL", "CHECKSUM"]
+
+WIDTH = 34  # width of the ladder between the two lanes
+
+
+def name(table, index):
+    return table[index] if index < len(table) else str(index)
+
+
+def read_dumps(lines):
+    """Returns the list of dumps, each a list of (bus, event, state, byte, cycles)."""
+    dumps, entries = [], None
+    for line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == "TRACE":
+            if len(fields) > 1 and fields[1] == "END":
+                if entries is not None:
+                    dumps.append(entries)
+                entries = None
+            else:
+                entries = []
+        elif fields[0] == "T" and entries is not None and len(fields) == 6:
+            bus, event, state = (int(f) for f in fields[1:4])
+            entries.append((bus, event, state, int(fields[4], 16), int(fields[5])))
+    if entries:
+        dumps.append(entries)  # log ended mid dump
+    return dumps
+
+
+def arrow(label, to_device):
+    if to_device:
+        return (label + " ").ljust(WIDTH - 1, "-") + ">"
+    return "<" + (" " + label).rjust(WIDTH - 1, "-")
+
+
+def ladder_row(event, byte):
+    """Returns the ladder cell for one entry."""
+    ev = name(EVENTS, event)
+    if ev in ("BEGIN", "POLL"):
+        rw = "R" if byte & 1 else "W"
+        return arrow("START %02x (%s)" % (byte, rw), True)
+    if ev == "ACK":
+        return arrow("ACK", False)
+    if ev == "NACK":
+        return arrow("NACK", False)
+    if ev == "RXDATAV":
+        return arrow("data %02x" % byte, False)
+    if ev == "TXC":
+        return arrow("TXC (LDMA write done)", False)
+    if ev == "MSTOP":
+        return arrow("STOP", True)
+    if ev == "FAULT":
+        return ("!! FAULT " + name(STATUSES, byte)).center(WIDTH)
+    return ev.center(WIDTH)
+
+
+def delta_us(start, end, hz):
+    return ((end - start) & 0xFFFFFFFF) * 1e6 / hz
+
+
+def decode(entries, hz, out):
+    first = entries[0][4]
+    out.write("%10s  %-5s %-4s %-*s  %s\n" % ("t (us)", "bus", "byte", WIDTH,
+                                             "MCU" + "device".rjust(WIDTH - 3), "state"))
+    for bus, event, state, byte, cycles in entries:
+        out.write("%10.1f  I2C%d  %02x   %s  %s\n" % (delta_us(first, cycles, hz), bus, byte,
+                                                     ladder_row(event, byte), name(STATES, state)))
+
+    # time in each state, from the entry that entered it to the next entry of the bus
+    phases, transactions, last, begun = {}, [], {}, {}
+    for bus, event, state, byte, cycles in entries:
+        if bus in last:
+            prev_state, prev_cycles = last[bus]
+            phases.setdefault(prev_state, []).append(delta_us(prev_cycles, cycles, hz))
+        last[bus] = (state, cycles)
+        if name(EVENTS, event) == "BEGIN":
+            # a queued transaction starts inside the stop of the one before it
+            if bus in begun:
+                transactions.append((bus, delta_us(begun[bus], cycles, hz), False))
+            begun[bus] = cycles
+        elif bus in begun and (state == 0 or name(EVENTS, event) == "FAULT"):
+            transactions.append((bus, delta_us(begun.pop(bus), cycles, hz),
+                                 name(EVENTS, event) == "FAULT"))
+
+    out.write("\n%-16s %6s %10s %10s %10s\n" % ("state", "count", "total us", "mean us", "max us"))
+    for state in sorted(phases):
+        times = phases[state]
+        out.write("%-16s %6d %10.1f %10.1f %10.1f\n" % (name(STATES, state), len(times),
+                                                          sum(times), sum(times) / len(times), max(times)))
+    for bus, us, failed in transactions:
+        out.write("I2C%d transaction %.1f us%s\n" % (bus, us, " (failed)" if failed else ""))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="BLE log, standard input if omitted")
+    parser.add_argument("--hz", type=float, default=19e6, help="core clock in Hz")
+    args = parser.parse_args()
+
+    lines = open(args.log) if args.log else sys.stdin
+    dumps = read_dumps(lines)
+    if not dumps:
+        sys.exit("no TRACE dump found")
+    for n, entries in enumerate(dumps):
+        if n:
+            sys.stdout.write("\n")
+        sys.stdout.write("dump %d, %d entries\n" % (n + 1, len(entries)))
+        if entries:
+            decode(entries, args.hz, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()